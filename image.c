@@ -26,6 +26,8 @@
 #include <microlib.h>
 
 #include <cache.h>
+#include <arena.h>
+#include <config.h>
 #include "image.h"
 
 
@@ -64,35 +66,91 @@ int ensure_image_is_accessible(const void *image)
 
 
 /**
- * Converts a 32-bit devicetree location (e.g. our subimage location)
- * into a full 64-bit address.
+ * Ensures that the header of a valid FDT is accessible, and prepares to make
+ * the rest of it accessible on demand. Rather than invalidating the whole
+ * FDT up front, only the header, memory reservations and strings block are
+ * invalidated here; the structure block is invalidated as it's read.
  *
- * @param metalocation The location of the location in the device tree.
+ * @param fdt The FDT to be made accessible.
+ * @param cache The tracker to be initialized for the FDT, which should then
+ *    be passed to fdt_index_build_lazy().
+ * @return SUCCESS, or an FDT error code.
  */
-void * image_location_from_devicetree(const uint64_t* metalocation)
+int ensure_fdt_is_accessible_lazily(const void *fdt, struct lazy_cache *cache)
 {
-    uint64_t high_word_cpu, low_word_cpu;
-    uintptr_t location;
+    const struct fdt_reserve_entry *reservation;
+    int rc;
+
+    // As above, the first line should hold the FDT's magic number and size...
+    __invalidate_cache_line(fdt);
+
+    // ... which are all we need to tell where the rest of the header ends.
+    __invalidate_cache_region(fdt, sizeof(struct fdt_header));
+    rc = fdt_check_header(fdt);
+    if(rc)
+        return rc;
 
-    // Break the encoded location into its FDT-constituent parts.
-    uint32_t *high_word_fdt = (uint32_t *) metalocation;
-    uint32_t *low_word_fdt  = ((uint32_t *)metalocation) + 1;
+    rc = lazy_cache_init(cache, fdt, fdt_totalsize(fdt));
+    if(rc)
+        return rc;
+
+    lazy_cache_touch(cache, fdt, sizeof(struct fdt_header));
 
-    // Compute the full location.
-    high_word_cpu  = fdt32_to_cpu(*high_word_fdt);
-    low_word_cpu   = fdt32_to_cpu(*low_word_fdt);
-    location       = (high_word_cpu << 32ULL) | low_word_cpu;
+    // The reservation map ends with an all-zeroes entry.
+    reservation = (const void *)((const char *)fdt + fdt_off_mem_rsvmap(fdt));
+    do {
+        lazy_cache_touch(cache, reservation, sizeof(*reservation));
+    } while((reservation++)->size);
 
-    return (void *)location;
+    // Property names are looked up on almost every access, so make the
+    // whole strings block visible now.
+    lazy_cache_touch(cache, (const char *)fdt + fdt_off_dt_strings(fdt), fdt_size_dt_strings(fdt));
+
+    return SUCCESS;
 }
 
+
 /**
- * Converts a 32-bit devicetree location (e.g. our subimage location)
- * into a full 64-bit address.
+ * The alignment each type of FIT subimage needs to be used in place.
+ * Kernels are always copied or decompressed to their load address anyway.
  */
-size_t image_size_from_devicetree(const uint64_t *metasize)
+static const size_t fit_subimage_alignment[FIT_SUBIMAGE_TYPES] = {
+    [FIT_KERNEL]  = 1,
+    [FIT_FDT]     = 8,
+    [FIT_RAMDISK] = 1,
+};
+
+
+/**
+ * Finds one of the subimages selected from a FIT, copying it into the arena
+ * only if it isn't suitably aligned where it is.
+ */
+int find_fit_subimage(const struct fit_configuration *config, enum fit_subimage_type type,
+    const void **out_data, size_t *out_size)
 {
-    return (size_t)image_location_from_devicetree(metasize);
+    const struct fit_subimage *sub = &config->subimages[type];
+    void *copy;
+
+    if(sub->node < 0)
+        return -FDT_ERR_NOTFOUND;
+
+    if(out_size)
+        *out_size = sub->size;
+
+    if(!((uintptr_t)sub->data & (fit_subimage_alignment[type] - 1))) {
+        *out_data = sub->data;
+        return SUCCESS;
+    }
+
+    copy = arena_alloc(sub->size);
+    if(!copy) {
+        printf("ERROR: Could not make an aligned copy of a FIT subimage (%d bytes)!\n", (int)sub->size);
+        return -FDT_ERR_NOSPACE;
+    }
+
+    memcpy(copy, sub->data, sub->size);
+    *out_data = copy;
+    return SUCCESS;
 }
 
 
@@ -114,275 +172,656 @@ int find_node(const void * image, const char * path)
 }
 
 /**
- * Gets a CPU-friendly representation of a memory table entry.
+ * Reads a value that spans one or more FDT cells.
  *
- * @param memory_table_entry A four-byte FDT addray in <addr_h, addr_l, size_h, size_l> format.
- * @param out_addr Out argument. Recieves the bank's start address.
- * @param outsize Out argument. Recieves the bank's size
+ * @param cells The cells to be read, in FDT (big-endian) order.
+ * @param count The number of cells that make up the value. Values wider than
+ *    64 bits keep only their low 64 bits, as nothing we run on can address more.
  */
-static void _from_mem_table_entry(const uint32_t *memory_table_entry, uint64_t *out_addr, uint64_t *out_size)
+static uint64_t read_cells(const fdt32_t *cells, int count)
 {
-    // Get the CPU-endian representations of each memory attribute...
-    uint64_t cpu_addr_high = fdt32_to_cpu(memory_table_entry[0]);
-    uint64_t cpu_addr_low  = fdt32_to_cpu(memory_table_entry[1]);
-    uint64_t cpu_size_high = fdt32_to_cpu(memory_table_entry[2]);
-    uint64_t cpu_size_low  = fdt32_to_cpu(memory_table_entry[3]);
-
-    // ... and combine them into the requested format.
-    *out_addr = (cpu_addr_high << 32ULL) | cpu_addr_low;
-    *out_size = (cpu_size_high << 32ULL) | cpu_size_low;
+    uint64_t value = 0;
+
+    while(count--) {
+        value = (value << 32ULL) | fdt32_to_cpu(*cells);
+        ++cells;
+    }
+
+    return value;
 }
 
 /**
- * Gets a CPU-friendly representation of a memory table entry.
+ * Writes a value that spans one or two FDT cells.
  *
- * @param memory_table_entry A four-byte FDT addray in <addr_h, addr_l, size_h, size_l> format.
- * @param out_addr Out argument. Recieves the bank's start address.
- * @param outsize Out argument. Recieves the bank's size
+ * @return SUCCESS, or -FDT_ERR_BADVALUE if the value won't fit in the given cells.
  */
-static void _to_mem_table_entry(uint32_t *memory_table_entry, uint64_t addr, uint64_t size)
+static int write_cells(fdt32_t *cells, int count, uint64_t value)
 {
-    // Get the CPU-endian representations of each memory attribute...
-    uint64_t cpu_addr_high = addr >> 32ULL;
-    uint64_t cpu_addr_low  = addr & 0xFFFFFFFFULL;
-    uint64_t cpu_size_high = size >> 32ULL;
-    uint64_t cpu_size_low  = size & 0xFFFFFFFFULL;
-
-    // ... and combine them into the requested format.
-    memory_table_entry[0] = cpu_to_fdt32(cpu_addr_high);
-    memory_table_entry[1] = cpu_to_fdt32(cpu_addr_low);
-    memory_table_entry[2] = cpu_to_fdt32(cpu_size_high);
-    memory_table_entry[3] = cpu_to_fdt32(cpu_size_low);
+    if((count == 1) && (value >> 32ULL))
+        return -FDT_ERR_BADVALUE;
+
+    if(count == 2)
+        *cells++ = cpu_to_fdt32(value >> 32ULL);
+
+    *cells = cpu_to_fdt32(value & 0xFFFFFFFFULL);
+    return SUCCESS;
 }
 
+
 /**
- * Copies a given memory table entry from a source table to the target table, excluding
- * the relevant region. May produce two entries, depending on the 
+ * Reads the system's memory map from each of the FDT's memory nodes,
+ * respecting the root's #address-cells and #size-cells.
+ *
+ * @param index An index of the FDT to be read.
+ * @param regions Out argument. An initialized region set, which will receive
+ *    a normalized copy of the system's memory map.
+ *
+ * @return SUCCESS, or an FDT error code on failure
  */
-static size_t copy_or_split_memory_table_entries(const uint32_t *source_entry, uint32_t *target_entry,
-    uintptr_t exclude_start, uintptr_t exclude_end)
+int read_memory_regions(const struct fdt_index *index, struct region_set *regions)
 {
-    size_t entries_generated = 0;
-    uint64_t source_entry_addr, source_entry_size, source_entry_end;
+    const void *fdt = index->fdt;
+    int address_cells, size_cells, entry_cells;
+    int i, rc;
+
+    // Memory nodes live directly under the root, so they use its cell sizes.
+    address_cells = fdt_address_cells(fdt, 0);
+    size_cells = fdt_size_cells(fdt, 0);
+    if(address_cells < 0)
+        return address_cells;
+    if(size_cells < 0)
+        return size_cells;
+
+    entry_cells = address_cells + size_cells;
+
+    for(i = 0; i < index->memory_count; ++i) {
+        const fdt32_t *reg;
+        int length, entry;
+
+        reg = fdt_index_getprop(index, index->memory[i], "reg", &length);
+        if(!reg) {
+            printf("ERROR: Could not process the bootloader-provided memory topology!\n");
+            return -FDT_ERR_BADVALUE;
+        }
 
+        // Empty banks are skipped by the region set.
+        for(entry = 0; entry < length / (int)(entry_cells * sizeof(*reg)); ++entry) {
+            const fdt32_t *cells = &reg[entry * entry_cells];
 
-    // Interpret the source entry.
-    _from_mem_table_entry(source_entry, &source_entry_addr, &source_entry_size);
-    source_entry_end = source_entry_addr + source_entry_size;
+            rc = region_set_insert(regions, read_cells(cells, address_cells),
+                read_cells(&cells[address_cells], size_cells));
+            if(rc) {
+                printf("ERROR: Ran out of space while reading the FDT's memory map!\n");
+                return rc;
+            }
+        }
+    }
 
-    // Case 1: Do we have a region before the exlcusion region? If so, include it.
-    if (source_entry_addr < exclude_start) {
+    region_set_normalize(regions);
+    return SUCCESS;
+}
 
-        // Determine where the new entry ends.
-        uint64_t new_entry_end = min(source_entry_end, exclude_start);
-        uint64_t new_entry_size = new_entry_end - source_entry_addr;
 
-        // Generate the new entry, and add it to the entry table.
-        _to_mem_table_entry(&target_entry[entries_generated * 4], source_entry_addr, new_entry_size);
-        ++entries_generated;
+/**
+ * Reads each region of memory the FDT asks us to keep out of: its /memreserve/
+ * entries, and any /reserved-memory children with fixed addresses.
+ */
+int read_reserved_regions(const struct fdt_index *index, struct region_set *regions)
+{
+    const void *fdt = index->fdt;
+    int address_cells, size_cells, entry_cells;
+    uint64_t address, size;
+    int i, node, rc;
+
+    for(i = 0; i < fdt_num_mem_rsv(fdt); ++i) {
+        rc = fdt_get_mem_rsv(fdt, i, &address, &size);
+        if(!rc)
+            rc = region_set_insert(regions, address, size);
+        if(rc)
+            return rc;
     }
 
-    // Case 2: Do we have a region after the exlcusion region? If so, include it.
-    if (source_entry_end > exclude_end) {
+    if(index->reserved_memory >= 0) {
+        address_cells = fdt_address_cells(fdt, index->reserved_memory);
+        size_cells = fdt_size_cells(fdt, index->reserved_memory);
+        if(address_cells < 0)
+            return address_cells;
+        if(size_cells < 0)
+            return size_cells;
+
+        entry_cells = address_cells + size_cells;
+
+        // Dynamically-placed reservations (those with only a size) haven't
+        // been allocated yet, so they don't get in our way.
+        for(node = fdt_first_subnode(fdt, index->reserved_memory); node >= 0; node = fdt_next_subnode(fdt, node)) {
+            const fdt32_t *reg;
+            int length, entry;
+
+            reg = fdt_index_getprop(index, node, "reg", &length);
+            if(!reg)
+                continue;
+
+            for(entry = 0; entry < length / (int)(entry_cells * sizeof(*reg)); ++entry) {
+                const fdt32_t *cells = &reg[entry * entry_cells];
+
+                rc = region_set_insert(regions, read_cells(cells, address_cells),
+                    read_cells(&cells[address_cells], size_cells));
+                if(rc)
+                    return rc;
+            }
+        }
+    }
 
-        // Determine where the new entry ends.
-        uint64_t new_entry_start = max(source_entry_addr, exclude_end);
-        uint64_t new_entry_size = source_entry_end - new_entry_start;
+    region_set_normalize(regions);
+    return SUCCESS;
+}
 
-        // Generate the new entry, and add it to the entry table.
-        _to_mem_table_entry(&target_entry[entries_generated * 4], new_entry_start, new_entry_size);
-        ++entries_generated;
-    }
 
-    // Return the number of entries we've generated.
-    return entries_generated;
+/**
+ * Helper function that prints out a memory table.
+ *
+ * @param regions The region set to be printed.
+ */
+static void print_memory_table(const struct region_set *regions)
+{
+    size_t i;
+
+    for(i = 0; i < regions->count; ++i)
+        printf("  memory bank at 0x%p, size 0x%p\n", regions->regions[i].start, regions->regions[i].size);
 }
 
+
 /**
- * Helper function that prints out a memory table entry.
+ * Encodes a memory table as a 'reg' property, using the given cell sizes.
  *
- * @param memory_table A memory table, as extracted from an FDT.
- * @param entries The number of entries in the memory table.
+ * @param out_length Out argument. Receives the length of the encoded property, in bytes.
+ * @return SUCCESS, or an FDT error code on failure
  */
-static void print_memory_table(uint32_t *memory_table, size_t entries)
+static int encode_memory_table(const struct region_set *regions,
+    int address_cells, int size_cells, fdt32_t *out_reg, int *out_length)
 {
-    uint32_t *current_entry = memory_table;
+    size_t i;
+    int rc;
+
+    if(address_cells < 1 || address_cells > 2 || size_cells < 1 || size_cells > 2)
+        return -FDT_ERR_BADNCELLS;
+
+    for(i = 0; i < regions->count; ++i) {
+        rc = write_cells(out_reg, address_cells, regions->regions[i].start);
+        if(rc)
+            return rc;
+        out_reg += address_cells;
+
+        rc = write_cells(out_reg, size_cells, regions->regions[i].size);
+        if(rc)
+            return rc;
+        out_reg += size_cells;
+    }
+
+    *out_length = regions->count * (address_cells + size_cells) * sizeof(*out_reg);
+    return SUCCESS;
+}
 
-    // Iterate over each entry in the table.
-    while(entries--) {
-        uint64_t addr, size;
 
-        // Print the memory table entry.
-        _from_mem_table_entry(current_entry, &addr, &size);
+/**
+ * Replaces the FDT's memory map with the given one. The whole map is written
+ * to the first memory node; any others are removed.
+ *
+ * @return SUCCESS, or an FDT error code on failure
+ */
+static int rewrite_memory_nodes(struct fdt_journal *journal, const struct fdt_index *index,
+    const struct region_set *memory)
+{
+    const void *fdt = index->fdt;
+    int rc, i, reg_length;
+    fdt32_t *target_reg;
+
+    // Encode the new table using the root's cell sizes, which the memory nodes share.
+    // Each entry takes at most four cells.
+    target_reg = arena_alloc(memory->count * 4 * sizeof(*target_reg));
+    if(!target_reg)
+        return -FDT_ERR_NOSPACE;
+
+    rc = encode_memory_table(memory, fdt_address_cells(fdt, 0), fdt_size_cells(fdt, 0),
+        target_reg, &reg_length);
+    if (rc) {
+        printf("ERROR: Could not encode the new FDT memory table! (%d)\n", rc);
+        return rc;
+    }
 
-        if ((addr == 0) && (size == 0)) {
-          printf("  end of table");
-        } else {
-          printf("  memory bank at 0x%p, size 0x%p\n", addr, size);
+    // The whole map now lives in the first memory node, so retire any others.
+    for(i = 1; i < index->memory_count; ++i) {
+        rc = fdt_journal_del_node(journal, index->memory[i]);
+        if (rc) {
+            printf("ERROR: Could not remove a stale FDT memory node! (%d)\n", rc);
+            return rc;
         }
+    }
 
-        // Move to the next memory table entry.
-        current_entry += 4;
+    // Copy the memory topology over to the target FDT.
+    rc = fdt_journal_setprop(journal, index->memory[0], "reg", target_reg, reg_length);
+    if (rc) {
+        printf("ERROR: Could not update the FDT memory table! (%d)\n", rc);
     }
+
+    return rc;
 }
 
 
 /**
- * Helper function that finds the start of RAM.
+ * Generates a reserved-memory child node name (e.g. "bfstub@f0000000") for
+ * the region at the given address.
  *
- * @param memory_table A memory table, as extracted from an FDT.
- * @param entries The number of entries in the memory table.
+ * @param name Buffer to receive the name; must be at least 24 bytes.
  */
-static void *find_start_of_ram(uint32_t *memory_table, size_t entries)
+static void reserved_memory_node_name(char *name, uint64_t address)
 {
-    uint32_t *current_entry = memory_table;
-    uint64_t start_of_ram = -1ULL;
+    static const char prefix[] = "bfstub@";
+    static const char digits[] = "0123456789abcdef";
+    int shift, started = false;
 
-    // Iterate over each entry in the table.
-    while(entries--) {
-        uint64_t addr, size;
+    memcpy(name, prefix, sizeof(prefix) - 1);
+    name += sizeof(prefix) - 1;
 
-        // Parse the memory table entry...
-        _from_mem_table_entry(current_entry, &addr, &size);
+    // Unit addresses are written in hex, without leading zeroes.
+    for(shift = 60; shift >= 0; shift -= 4) {
+        int digit = (address >> shift) & 0xf;
 
-        // If we've hit our senitnel, abort.
-        if(!addr)
-            break;
+        if(digit || started || !shift) {
+            *name++ = digits[digit];
+            started = true;
+        }
+    }
+
+    *name = '\0';
+}
+
+
+/**
+ * Describes each excluded region with a no-map child of /reserved-memory,
+ * leaving the memory nodes untouched. This lets Linux keep its linear map
+ * in large blocks, and only appends to the FDT.
+ *
+ * @return SUCCESS, or an FDT error code on failure
+ */
+static int add_reserved_memory_nodes(struct fdt_journal *journal, const struct fdt_index *index,
+    const struct region_set *exclusions)
+{
+    const void *fdt = index->fdt;
+    int rc, parent = index->reserved_memory;
+    int address_cells, size_cells, reg_length;
+    fdt32_t reg[4];
+    size_t i;
+
+    // If the bootloader didn't give us a /reserved-memory node, create one.
+    // Its cell sizes must match the root's, and it maps addresses one-to-one.
+    if(parent < 0) {
+        address_cells = fdt_address_cells(fdt, 0);
+        size_cells = fdt_size_cells(fdt, 0);
+
+        parent = fdt_journal_add_subnode(journal, 0, "reserved-memory");
+        if(parent < 0)
+            return parent;
+
+        rc = fdt_journal_setprop_u32(journal, parent, "#address-cells", address_cells);
+        if(!rc)
+            rc = fdt_journal_setprop_u32(journal, parent, "#size-cells", size_cells);
+        if(!rc)
+            rc = fdt_journal_setprop(journal, parent, "ranges", NULL, 0);
+        if(rc)
+            return rc;
+    } else {
+        address_cells = fdt_address_cells(fdt, parent);
+        size_cells = fdt_size_cells(fdt, parent);
+    }
 
-        // Otherwise, update the lowest seen RAM address.
-        start_of_ram = min(addr, start_of_ram);
+    for(i = 0; i < exclusions->count; ++i) {
+        struct region_set region = { &exclusions->regions[i], 1, 1 };
+        char name[24];
+        int node;
+
+        rc = encode_memory_table(&region, address_cells, size_cells, reg, &reg_length);
+        if(rc)
+            return rc;
+
+        reserved_memory_node_name(name, exclusions->regions[i].start);
+        node = fdt_journal_add_subnode(journal, parent, name);
+        if(node < 0)
+            return node;
+
+        rc = fdt_journal_setprop(journal, node, "reg", reg, reg_length);
+        if(!rc)
+            rc = fdt_journal_setprop(journal, node, "no-map", NULL, 0);
+        if(rc)
+            return rc;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Describes each excluded region with a /memreserve/ entry, leaving the
+ * memory nodes untouched.
+ *
+ * @return SUCCESS, or an FDT error code on failure
+ */
+static int add_memreserve_entries(struct fdt_journal *journal, const struct region_set *exclusions)
+{
+    size_t i;
+    int rc;
 
-        // Move to the next memory table entry.
-        current_entry += 4;
+    for(i = 0; i < exclusions->count; ++i) {
+        rc = fdt_journal_add_mem_rsv(journal, exclusions->regions[i].start, exclusions->regions[i].size);
+        if(rc)
+            return rc;
     }
 
-    return (void *)start_of_ram;
+    return SUCCESS;
 }
 
 
 /**
- * Adjust the target FDT's memory to exclude the provided region. This allows
+ * Adjust the target FDT's memory to exclude the provided regions. This allows
  * the stub to carve out memory for itself that e.g. Linux knows not to touch.
+ * How the regions are excluded is selected by CONFIG_MEMORY_CARVEOUT_METHOD.
  *
- * @param fdt The FDT to be updated.
- * @param start_addr The start of the memory region to be excluded.
- * @param end_addr The end of the memory region to be excluded.
+ * @param journal The journal to record the FDT's edits in.
+ * @param index An index of the FDT being edited.
+ * @param exclusions The set of memory regions to be excluded. All regions
+ *    are removed in a single pass.
  * @param out_start_of_ram Out arugument. Will be popualted with the address of the first available RAM.
  *
  * @return SUCCESS, or an error code on failure
  */
-int update_fdt_to_exclude_memory(void *fdt, uintptr_t start_addr,
-    uintptr_t end_addr, void **out_start_of_ram)
+int update_fdt_to_exclude_memory(struct fdt_journal *journal, const struct fdt_index *index,
+    struct region_set *exclusions, void **out_start_of_ram)
 {
-    const struct fdt_property *source_reg;
-
-    int memory_node, rc;
-    size_t source_memory_table_entries, target_memory_table_entries = 0;
-
-    uint32_t *source_memory_table;
-    uint32_t target_memory_table[MAX_MEM_TABLE_ENTRIES * sizeof(uint32_t) *  4];
+    int rc;
+    struct region_set memory;
 
     // Find the description of the system's memory in the FDT.
-    memory_node = find_node(fdt, "/memory");
-
     // If we weren't able to resolve the memory node, fail out.
-    if(memory_node < 0) {
-        printf("ERROR: Could not find a description of the system's memory (%s)!\n", fdt_strerror(memory_node));
-        return memory_node;
+    if(!index->memory_count) {
+        printf("ERROR: Could not find a description of the system's memory (%s)!\n", fdt_strerror(-FDT_ERR_NOTFOUND));
+        return -FDT_ERR_NOTFOUND;
     }
 
-    // Retreive the property that contains the bootloader-provided memory topology.
-    source_reg = fdt_get_property(fdt, memory_node, "reg", NULL);
-    if(!source_reg)
-    {
-        printf("ERROR: Could not process the bootloader-provided memory topology!\n");
-        return -FDT_ERR_BADVALUE;
-    }
+    // Read the bootloader-provided memory topology, from every memory node.
+    rc = region_set_init(&memory, index->memory_count);
+    if(!rc)
+        rc = read_memory_regions(index, &memory);
+    if(rc)
+        return rc;
 
-    // Start off assuming we're keeping the memory table the same size. If we expand it,
-    // we'll update this buffer accordingly.
-    source_memory_table_entries = fdt32_to_cpu(source_reg->len) / (sizeof(*source_memory_table) * 4);
-    source_memory_table = (uint32_t *)source_reg->data;
-
-    // Iterate through the memory table, which we expect to be in the format
-    // <address_high address_low size_high size_low>. Technically device trees can violate
-    // this by changing their cell sizes. FIXME: Support cell sizes other than 4-bytes.
-    for(int i = 0; i < source_memory_table_entries; i++) {
-
-        // If we don't have space to potentially generate two entries, fail out.
-        // (Theoretically we could continue if we knew this was only going to generate one entry
-        //  and we knew we had one entry left, but this implementation favors simplicity.)
-        if(target_memory_table_entries + 2 > MAX_MEM_TABLE_ENTRIES) {
-            printf("ERROR: Not enough space to populate the FDT with an updated memory map (need >%d entires)!\n", target_memory_table_entries + 2);
-            return -FDT_ERR_NOSPACE;
-        }
+    printf("\nOriginal memory table:\n");
+    print_memory_table(&memory);
 
-        // Generate the new memory table entries...
-        target_memory_table_entries += copy_or_split_memory_table_entries(&source_memory_table[i * 4],
-            &target_memory_table[target_memory_table_entries * 4], start_addr, end_addr);
+    // Generate a new memory table without any of the excluded regions.
+    rc = region_set_subtract(&memory, exclusions);
+    if(rc) {
+        printf("ERROR: Ran out of space while updating the FDT's memory map!\n");
+        return rc;
     }
 
-    // Print the source and destination tables.
-    printf("\nOriginal memory table:\n");
-    print_memory_table(source_memory_table, source_memory_table_entries);
-    printf("\nUpdated memory table:\n");
-    print_memory_table(target_memory_table, target_memory_table_entries);
+    printf("\nUsable memory table:\n");
+    print_memory_table(&memory);
 
-    // Find the start of RAM.
-    if(out_start_of_ram) {
-        *out_start_of_ram = find_start_of_ram(target_memory_table, target_memory_table_entries);
+    // Find the start of RAM; as our table is sorted, this is the first entry.
+    if(out_start_of_ram && memory.count) {
+        *out_start_of_ram = (void *)memory.regions[0].start;
     }
 
-    // Copy the memory topology over to the target FDT. For now, we assume the cell sizes
-    // (address and size) match the target, as discharge does.
-    rc = fdt_setprop(fdt, memory_node, "reg", target_memory_table, target_memory_table_entries * sizeof(*target_memory_table));
-    if (rc) {
-        printf("ERROR: Could not update the FDT memory table! (%d)\n", rc);
-        return -rc;
+    switch(CONFIG_MEMORY_CARVEOUT_METHOD) {
+        case CARVEOUT_RESERVED_MEMORY:
+            printf("\nReserving excluded memory with /reserved-memory nodes.\n");
+            rc = add_reserved_memory_nodes(journal, index, exclusions);
+            break;
+
+        case CARVEOUT_MEMRESERVE:
+            printf("\nReserving excluded memory with /memreserve/ entries.\n");
+            rc = add_memreserve_entries(journal, exclusions);
+            break;
+
+        default:
+            rc = rewrite_memory_nodes(journal, index, &memory);
+            break;
     }
 
-    return SUCCESS;
+    if(rc)
+        printf("ERROR: Could not exclude memory from the FDT! (%s)\n", fdt_strerror(rc));
+
+    return rc;
 }
 
 
 
 /**
  * Finds the extents (start, length) of a given image, as passed from our
- * bootloader via the FDT.
+ * bootloader via the FDT. The image's reg property is decoded using its
+ * parent's #address-cells and #size-cells.
  *
- * @param fdt The FDT passed from the previous-stage bootloader.
+ * @param index An index of the FDT passed from the previous-stage bootloader.
  * @param image_node The bootloader node corresponding to the relevant image.
+ * @param parent_node The image node's parent.
  * @param description String description of the image, for error messages.
  * @param out_location Out argument; if non-null, will be populated with the
  *    starting location of the relevant image.
  * @param out_size Out argument; if non-null, will be populated with the
+ *    size of the relevant image.
+ * @return SUCCESS, or an FDT error code.
  */
-int get_image_extents(const void *fdt, int image_node,
+int get_image_extents(const struct fdt_index *index, int image_node, int parent_node,
     const char *description, void **out_location, size_t *out_size)
 {
-    int subimage_location_size;
-
-    // Unfortunately, image locations received in the FDT are stored as 32-bit
-    // integers for backwards compatibility. We'll have to expand this out
-    // to a full 64-bit image ourselves.
-    const uint64_t *subimage_location;
-
-    // Find the location of the initrd property, which holds our subimage...
-    subimage_location = fdt_getprop(fdt, image_node, "reg", &subimage_location_size);
-    if(subimage_location_size <= 0) {
-        printf("ERROR: Could not find the %s image location! (%d)\n", description, subimage_location);
-        return -subimage_location_size;
+    int address_cells, size_cells, length;
+    const fdt32_t *reg;
+
+    address_cells = fdt_address_cells(index->fdt, parent_node);
+    size_cells = fdt_size_cells(index->fdt, parent_node);
+    if(address_cells < 0)
+        return address_cells;
+    if(size_cells < 0)
+        return size_cells;
+
+    // Find the image's reg property, which holds its location and size...
+    reg = fdt_index_getprop(index, image_node, "reg", &length);
+    if(!reg) {
+        printf("ERROR: Could not find the %s image location! (%s)\n", description, fdt_strerror(length));
+        return length;
+    }
+
+    // ... and make sure it's long enough to hold both.
+    if((size_t)length < (address_cells + size_cells) * sizeof(*reg)) {
+        printf("ERROR: The %s image location is malformed! (%d bytes)\n", description, length);
+        return -FDT_ERR_BADVALUE;
     }
 
     // Populate our extents, if we have a valid pointer to populate them into.
     if (out_location) {
-        *out_location = image_location_from_devicetree(subimage_location);
+        *out_location = (void *)(uintptr_t)read_cells(reg, address_cells);
     }
     if (out_size) {
-        *out_size = image_size_from_devicetree(&subimage_location[1]);
+        *out_size = read_cells(&reg[address_cells], size_cells);
     }
 
+    return SUCCESS;
+}
+
+
+/**
+ * Reads an address property (e.g. linux,initrd-start), which may be either
+ * one or two cells long.
+ *
+ * @return SUCCESS, or an FDT error code.
+ */
+static int read_address_property(const struct fdt_index *index, int node, const char *name, uint64_t *out_value)
+{
+    int length;
+    const fdt32_t *value = fdt_index_getprop(index, node, name, &length);
+
+    if(!value)
+        return length;
+
+    if(length == sizeof(uint32_t))
+        *out_value = fdt32_to_cpu(value[0]);
+    else if(length == sizeof(uint64_t))
+        *out_value = ((uint64_t)fdt32_to_cpu(value[0]) << 32ULL) | fdt32_to_cpu(value[1]);
+    else
+        return -FDT_ERR_BADVALUE;
 
     return SUCCESS;
 }
 
+
+/**
+ * Reads the digests the bootloader says a payload should have. For now, that's
+ * a CRC-32C in the payload node's bfstub,crc32c property.
+ */
+static void read_payload_digests(const struct fdt_index *index, struct payload *payload)
+{
+    int length;
+    const fdt32_t *crc = fdt_index_getprop(index, payload->node, "bfstub,crc32c", &length);
+
+    payload->digests.sha256 = NULL;
+    payload->digests.has_crc32c = crc && (length == sizeof(*crc));
+    payload->digests.crc32c = payload->digests.has_crc32c ? fdt32_to_cpu(*crc) : 0;
+}
+
+
+/**
+ * Marks any payloads whose type we couldn't determine by compatible string
+ * using the multiboot convention: the first is the kernel, the second is the ramdisk.
+ */
+static void assign_untyped_payloads(struct payload_table *table, const int *untyped, int untyped_count)
+{
+    int i;
+
+    for(i = 0; i < untyped_count; ++i) {
+        struct payload *payload = &table->entries[untyped[i]];
+
+        if(!find_payload(table, PAYLOAD_KERNEL))
+            payload->type = PAYLOAD_KERNEL;
+        else if(!find_payload(table, PAYLOAD_RAMDISK))
+            payload->type = PAYLOAD_RAMDISK;
+    }
+}
+
+
+/**
+ * Determines what kind of payload the given node describes, from its
+ * compatible string.
+ *
+ * @param out_type Out argument; receives the payload's type.
+ * @return True iff the node describes a payload. Nodes named 'module' are
+ *    always payloads, even without a compatible string we recognize.
+ */
+static int classify_payload_node(const struct fdt_index *index, int node, enum payload_type *out_type)
+{
+    int length, name_length;
+    const char *compatible = fdt_index_getprop(index, node, "compatible", &length);
+    const char *name = fdt_get_name(index->fdt, node, &name_length);
+
+    *out_type = PAYLOAD_MODULE;
+
+    if(compatible && fdt_stringlist_contains(compatible, length, "multiboot,kernel"))
+        *out_type = PAYLOAD_KERNEL;
+    else if(compatible && fdt_stringlist_contains(compatible, length, "multiboot,ramdisk"))
+        *out_type = PAYLOAD_RAMDISK;
+    else if(compatible && fdt_stringlist_contains(compatible, length, "multiboot,module"))
+        return true;
+    else
+        return name && (name_length >= 6) && !memcmp(name, "module", 6) &&
+            ((name_length == 6) || (name[6] == '@'));
+
+    return true;
+}
+
+
+/**
+ * Builds a table of each payload passed in by the bootloader, identifying
+ * each by its compatible string.
+ *
+ * @param index An index of the FDT passed from the previous-stage bootloader.
+ * @param table The table to be populated.
+ * @return SUCCESS, or an FDT error code. If the bootloader passed more modules
+ *    than we can track, returns -FDT_ERR_NOSPACE rather than drop any.
+ */
+int find_payloads(const struct fdt_index *index, struct payload_table *table)
+{
+    int untyped[MAX_PAYLOADS];
+    int untyped_count = 0;
+    int i, rc;
+
+    table->count = 0;
+
+    // Our index already found each child of /chosen and each root module as
+    // it walked the tree, so we only need to look at those-- not rescan the
+    // tree for each compatible string.
+    for(i = 0; i < index->payload_node_count; ++i) {
+        struct payload *payload = &table->entries[table->count];
+        int node = index->payload_nodes[i];
+        enum payload_type type;
+
+        if(!classify_payload_node(index, node, &type))
+            continue;
+
+        if(table->count == MAX_MODULES) {
+            printf("ERROR: The bootloader passed more than %d modules, which is all we can handle!\n",
+                MAX_MODULES);
+            return -FDT_ERR_NOSPACE;
+        }
+
+        payload->node = node;
+        payload->type = type;
+
+        rc = get_image_extents(index, node, index->payload_parents[i], "module",
+            &payload->location, &payload->size);
+        if(rc != SUCCESS)
+            continue;
+
+        read_payload_digests(index, payload);
+
+        if(type == PAYLOAD_MODULE)
+            untyped[untyped_count++] = table->count;
+
+        ++table->count;
+    }
+
+    assign_untyped_payloads(table, untyped, untyped_count);
+
+    // Some bootloaders pass the ramdisk using the Linux /chosen properties instead.
+    if(!find_payload(table, PAYLOAD_RAMDISK) && (index->chosen >= 0)) {
+        uint64_t start, end;
+
+        if((read_address_property(index, index->chosen, "linux,initrd-start", &start) == SUCCESS) &&
+           (read_address_property(index, index->chosen, "linux,initrd-end", &end) == SUCCESS) &&
+           (end > start)) {
+            struct payload *payload = &table->entries[table->count++];
+
+            payload->type = PAYLOAD_RAMDISK;
+            payload->location = (void *)start;
+            payload->size = end - start;
+            payload->node = index->chosen;
+            payload->digests.sha256 = NULL;
+            payload->digests.has_crc32c = false;
+        }
+    }
+
+    return table->count ? SUCCESS : -FDT_ERR_NOTFOUND;
+}
+
+
+/**
+ * Returns the first payload of the given type, or NULL if there isn't one.
+ */
+const struct payload *find_payload(const struct payload_table *table, enum payload_type type)
+{
+    int i;
+
+    for(i = 0; i < table->count; ++i)
+        if(table->entries[i].type == type)
+            return &table->entries[i];
+
+    return NULL;
+}
@@ -28,14 +28,97 @@
 
 #include <microlib.h>
 #include <libfdt.h>
+#include <fdt_index.h>
+#include <regions.h>
+#include <fdt_journal.h>
+#include <fit.h>
 
 /**
- * Maximum entries in a supported memory table. Up this if we need to work
- * with particularly complex memory tables.
+ * The size of the header at the start of an arm64 Linux Image. Among other
+ * things, it holds the image's text_offset (the second 64-bit word).
  */
-#define MAX_MEM_TABLE_ENTRIES (8)
+#define LINUX_IMAGE_HEADER_BYTES  (64)
 
-const void * find_fit_subimage(void *fdt);
+/**
+ * The kinds of payload the previous-stage bootloader can pass us.
+ */
+enum payload_type {
+    PAYLOAD_KERNEL,
+    PAYLOAD_RAMDISK,
+    PAYLOAD_MODULE,
+};
+
+/**
+ * The digests a payload is expected to have, for integrity checking.
+ */
+struct payload_digests {
+    // From a FIT hash node; or NULL if there's no SHA-256 to check.
+    const uint8_t *sha256;
+
+    // From the payload's bfstub,crc32c property, if it has one.
+    int has_crc32c;
+    uint32_t crc32c;
+};
+
+/**
+ * The extents of a single payload, as passed in by the bootloader.
+ */
+struct payload {
+    enum payload_type type;
+    void *location;
+    size_t size;
+
+    // The FDT node that describes the payload; or, for payloads unpacked
+    // from a FIT, the subimage's node in the FIT.
+    int node;
+
+    struct payload_digests digests;
+};
+
+/**
+ * Maximum payloads we'll track: each module, plus a ramdisk passed via /chosen.
+ */
+#define MAX_MODULES (16)
+#define MAX_PAYLOADS (MAX_MODULES + 1)
+
+/**
+ * Table of each of the payloads passed in by the bootloader.
+ */
+struct payload_table {
+    struct payload entries[MAX_PAYLOADS];
+    int count;
+};
+
+/**
+ * Finds one of the subimages selected from a FIT. Where the subimage's
+ * alignment allows, this points straight into the FIT; otherwise (e.g. for an
+ * FDT that isn't 8-byte aligned), the subimage is copied into the arena.
+ *
+ * @param config The configuration selected from the FIT.
+ * @param type The type of subimage to be returned.
+ * @param out_data Out argument; receives the subimage's contents.
+ * @param out_size Out argument; if non-null, receives the subimage's size.
+ * @return SUCCESS; -FDT_ERR_NOTFOUND if the configuration doesn't select a
+ *    subimage of this type; or -FDT_ERR_NOSPACE if it needed copying, and
+ *    the arena couldn't hold the copy.
+ */
+int find_fit_subimage(const struct fit_configuration *config, enum fit_subimage_type type,
+    const void **out_data, size_t *out_size);
+
+/**
+ * Builds a table of each payload passed in by the bootloader, identifying
+ * each by its compatible string.
+ *
+ * @param index An index of the FDT passed from the previous-stage bootloader.
+ * @param table The table to be populated.
+ * @return SUCCESS, or an FDT error code.
+ */
+int find_payloads(const struct fdt_index *index, struct payload_table *table);
+
+/**
+ * Returns the first payload of the given type, or NULL if there isn't one.
+ */
+const struct payload *find_payload(const struct payload_table *table, enum payload_type type);
 
 /**
  * Ensures that a valid FDT/image is accessible for the system, performing any
@@ -45,6 +128,17 @@ const void * find_fit_subimage(void *fdt);
  */
 int ensure_image_is_accessible(const void *image);
 
+/**
+ * Ensures that the header of a valid FDT is accessible, and prepares to make
+ * the rest of it accessible on demand, as it's indexed and read.
+ *
+ * @param fdt The FDT to be made accessible.
+ * @param cache The tracker to be initialized for the FDT, which should then
+ *    be passed to fdt_index_build_lazy().
+ * @return SUCCESS, or an FDT error code.
+ */
+int ensure_fdt_is_accessible_lazily(const void *fdt, struct lazy_cache *cache);
+
 /**
  * Finds the chosen node in the Discharged FDT, which contains
  * e.g. the location of our final payload.
@@ -53,31 +147,63 @@ int find_node(const void * image, const char * path);
 
 /**
  * Finds the extents (start, length) of a given image, as passed from our
- * bootloader via the FDT.
+ * bootloader via the FDT. The image's reg property is decoded using its
+ * parent's #address-cells and #size-cells.
  *
- * @param fdt The FDT passed from the previous-stage bootloader.
+ * @param index An index of the FDT passed from the previous-stage bootloader.
  * @param image_node The bootloader node corresponding to the relevant image.
+ * @param parent_node The image node's parent.
  * @param description String description of the image, for error messages.
  * @param out_location Out argument; if non-null, will be populated with the
  *    starting location of the relevant image.
  * @param out_size Out argument; if non-null, will be populated with the
+ *    size of the relevant image.
+ * @return SUCCESS, or an FDT error code.
  */
-int get_image_extents(const void *fdt, int image_node,
+int get_image_extents(const struct fdt_index *index, int image_node, int parent_node,
     const char *description, void **out_location, size_t *out_size);
 
 
 /**
- * Adjust the target FDT's memory to exclude the provided region. This allows
+ * Reads the system's memory map from each of the FDT's memory nodes,
+ * respecting the root's #address-cells and #size-cells.
+ *
+ * @param index An index of the FDT to be read.
+ * @param regions Out argument. An initialized region set, which will receive
+ *    a normalized copy of the system's memory map.
+ *
+ * @return SUCCESS, or an FDT error code on failure
+ */
+int read_memory_regions(const struct fdt_index *index, struct region_set *regions);
+
+
+/**
+ * Reads the regions of memory the FDT reserves: each /memreserve/ entry, and
+ * each statically-placed /reserved-memory child.
+ *
+ * @param index An index of the FDT to be read.
+ * @param regions Out argument. An initialized region set, which will receive
+ *    a normalized set of the reserved regions.
+ *
+ * @return SUCCESS, or an FDT error code on failure
+ */
+int read_reserved_regions(const struct fdt_index *index, struct region_set *regions);
+
+
+/**
+ * Adjust the target FDT's memory to exclude the provided regions. This allows
  * the stub to carve out memory for itself that e.g. Linux knows not to touch.
+ * How the regions are excluded is selected by CONFIG_MEMORY_CARVEOUT_METHOD.
  *
- * @param fdt The FDT to be updated.
- * @param start_addr The start of the memory region to be excluded.
- * @param end_addr The end of the memory region to be excluded.
+ * @param journal The journal to record the FDT's edits in.
+ * @param index An index of the FDT being edited.
+ * @param exclusions The set of memory regions to be excluded. All regions
+ *    are removed in a single pass.
  * @param out_start_of_ram Out arugument. Will be popualted with the address of the first available RAM.
  *
  * @return SUCCESS, or an error code on failure
  */
-int update_fdt_to_exclude_memory(void *fdt, uintptr_t start_addr,
-    uintptr_t end_addr, void **out_start_of_ram);
+int update_fdt_to_exclude_memory(struct fdt_journal *journal, const struct fdt_index *index,
+    struct region_set *exclusions, void **out_start_of_ram);
 
 #endif
@@ -31,13 +31,82 @@
 #define __CACHE_H__
 
 /**
- * Invalidate the cache line relevant to the provided address.
+ * Returns the number of bytes per data cache line.
+ */
+size_t __dcache_line_bytes(void);
+
+/**
+ * Returns the number of bytes per instruction cache line.
+ */
+size_t __icache_line_bytes(void);
+
+
+/**
+ * Cleans every line of every data cache to the point of coherency, by set/way.
+ * Only reaches this core's caches, so only for handing the machine to the next
+ * exception level or stage, once no other core has its caches on.
+ */
+void __clean_dcache_all(void);
+
+/**
+ * Cleans and invalidates every line of every data cache, by set/way. Only
+ * reaches this core's caches, so only safe while no other core has its
+ * caches on.
+ */
+void __clean_invalidate_dcache_all(void);
+
+
+/*
+ * Range-based cache maintenance. Each of these handles regions that don't
+ * start or end on a line boundary, and waits for its maintenance to complete
+ * before returning, so callers don't need any barriers of their own. These
+ * always work by address, so they're safe no matter what else is in the cache.
+ */
+
+/**
+ * Cleans any data cache lines for the given region to the point of coherency.
+ * Use when we've written data with our caches on that must be seen by
+ * something without them.
+ */
+void __clean_dcache_region(const void *addr, size_t length);
+
+/**
+ * Discards any data cache lines for the given region, without writing them
+ * back. Use before writing a region with our caches off, so stale lines can't
+ * later be written over our data. Partial lines at the edges are cleaned and
+ * invalidated instead, so neighbouring data isn't lost.
+ */
+void __invalidate_dcache_region(const void *addr, size_t length);
+
+/**
+ * Cleans and invalidates any data cache lines for the given region. Use when
+ * we need to read data that a previous stage may have left in its cache.
+ */
+void __clean_invalidate_dcache_region(const void *addr, size_t length);
+
+/**
+ * Makes newly-written code in the given region visible to instruction fetch.
+ */
+void __sync_icache_region(const void *addr, size_t length);
+
+
+/**
+ * Zeroes a region of memory, using DC ZVA where it's safe to.
+ *
+ * @return dest
+ */
+void *__zero_region(void *dest, size_t length);
+
+
+/**
+ * Cleans and invalidates the cache line relevant to the provided address.
  */
 void __invalidate_cache_line(const void * addr);
 
 
 /**
- * Invalides any cache lines that store data relevant to a given regsion.
+ * Cleans and invalidates any cache lines that store data relevant to a given
+ * region. Equivalent to __clean_invalidate_dcache_region.
  */
 void __invalidate_cache_region(const void * addr, size_t length);
 
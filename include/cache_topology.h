@@ -0,0 +1,100 @@
+/**
+ * Cache topology probing for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CACHE_TOPOLOGY_H__
+#define __CACHE_TOPOLOGY_H__
+
+#include <microlib.h>
+
+/**
+ * The most cache levels the architecture can describe.
+ */
+#define CACHE_MAX_LEVELS    (7)
+
+/**
+ * The kinds of cache that can exist at a given level, as reported by CLIDR_EL1.
+ */
+enum cache_type {
+    CACHE_TYPE_NONE         = 0,
+    CACHE_TYPE_INSTRUCTION  = 1,
+    CACHE_TYPE_DATA         = 2,
+    CACHE_TYPE_SEPARATE     = 3,
+    CACHE_TYPE_UNIFIED      = 4,
+};
+
+/**
+ * The geometry of a single cache.
+ */
+struct cache_geometry {
+    uint32_t line_bytes;
+    uint32_t ways;
+    uint32_t sets;
+    size_t size;
+};
+
+/**
+ * Everything we know about the system's caches, probed once at boot.
+ */
+struct cache_topology {
+
+    // The number of levels that need maintenance to reach the point of coherency.
+    int levels;
+
+    // The kind of cache at each level, and the geometry of its data (or
+    // unified) and instruction sides. Sides that don't exist are zeroed.
+    enum cache_type type[CACHE_MAX_LEVELS];
+    struct cache_geometry data[CACHE_MAX_LEVELS];
+    struct cache_geometry instruction[CACHE_MAX_LEVELS];
+
+    // The smallest line size of any data / instruction cache, from CTR_EL0.
+    // These are the safe strides for maintenance by address.
+    uint32_t dcache_min_line_bytes;
+    uint32_t icache_min_line_bytes;
+
+    // The largest line size of any data cache.
+    uint32_t dcache_max_line_bytes;
+
+    // The block size zeroed by DC ZVA, or 0 if DC ZVA is prohibited.
+    uint32_t zva_block_bytes;
+};
+
+/**
+ * Returns the system's cache topology, probing it on first use.
+ */
+const struct cache_topology *cache_topology(void);
+
+/**
+ * Returns true iff DC ZVA can be used right now. Besides being permitted,
+ * this requires the MMU and data cache to be on, as DC ZVA faults on the
+ * Device memory we see with the MMU off.
+ */
+int cache_zva_usable(void);
+
+/**
+ * Prints a summary of the system's caches.
+ */
+void cache_topology_print(void);
+
+#endif
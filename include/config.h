@@ -30,7 +30,87 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
-const char * const initrd_node = "linux,initrd-start";
+/**
+ * The /chosen property used to tell Linux where its initrd starts.
+ */
+#define INITRD_NODE "linux,initrd-start"
+
+/**
+ * The /chosen property used to tell Linux where its initrd ends.
+ */
+#define INITRD_END_NODE "linux,initrd-end"
+
+/**
+ * If set, the stub will wake the system's secondary cores during boot, and use
+ * them to share large jobs-- like relocating the kernel-- with the boot core.
+ * Each secondary core is returned to its parking state before Linux is started.
+ */
+#ifndef CONFIG_PARALLEL_BOOT
+#define CONFIG_PARALLEL_BOOT 0
+#endif
+
+/**
+ * The maximum number of cores the stub will manage, including the boot core.
+ */
+#ifndef CONFIG_MAX_CPUS
+#define CONFIG_MAX_CPUS 8
+#endif
+
+/**
+ * The size of the boot-time arena, which backs data structures whose size
+ * depends on the platform (e.g. the memory map). This memory is handed back
+ * to the next-stage kernel, so it can be generous.
+ */
+#ifndef CONFIG_ARENA_SIZE
+#define CONFIG_ARENA_SIZE (1024 * 1024)
+#endif
+
+/**
+ * Ways the stub can hide its own memory from the next-stage kernel:
+ *   CARVEOUT_REWRITE_MEMORY rewrites the memory nodes to leave out our memory.
+ *   CARVEOUT_RESERVED_MEMORY adds no-map children to /reserved-memory.
+ *   CARVEOUT_MEMRESERVE adds /memreserve/ entries to the FDT header.
+ * The latter two leave the memory nodes intact, so Linux can keep its linear
+ * map in large blocks.
+ */
+#define CARVEOUT_REWRITE_MEMORY   0
+#define CARVEOUT_RESERVED_MEMORY  1
+#define CARVEOUT_MEMRESERVE       2
+
+#ifndef CONFIG_MEMORY_CARVEOUT_METHOD
+#define CONFIG_MEMORY_CARVEOUT_METHOD CARVEOUT_RESERVED_MEMORY
+#endif
+
+/**
+ * The size of the buffer the stub builds the final FDT in. Linux won't accept an
+ * FDT larger than 2 MiB, so there's no use in making this any larger.
+ */
+#ifndef CONFIG_FINAL_FDT_SIZE
+#define CONFIG_FINAL_FDT_SIZE (2 * 1024 * 1024)
+#endif
+
+/**
+ * If set, the stub only invalidates the parts of the bootloader's FDT it reads,
+ * as it reads them, rather than invalidating the whole FDT up front. Anything
+ * left over is invalidated just before the final FDT is built.
+ */
+#ifndef CONFIG_LAZY_FDT_INVALIDATION
+#define CONFIG_LAZY_FDT_INVALIDATION 1
+#endif
 
+/**
+ * If set, the stub moves itself to the top of RAM before it leaves EL2, so
+ * the memory it keeps for itself doesn't split the kernel's memory map in
+ * two. The stub is placed at the highest 2 MiB-aligned address that's clear
+ * of the FDT, the bootloader's payloads, and any reserved memory.
+ */
+#ifndef CONFIG_RELOCATE_TO_TOP_OF_RAM
+#define CONFIG_RELOCATE_TO_TOP_OF_RAM 0
+#endif
+
+/**
+ * The alignment the stub is given when it's moved to the top of RAM.
+ */
+#define STUB_RELOCATION_ALIGN (2 * 1024 * 1024ULL)
 
 #endif
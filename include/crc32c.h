@@ -0,0 +1,68 @@
+/**
+ * CRC-32C (Castagnoli) for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+#include <microlib.h>
+
+/**
+ * @return True iff the ARMv8 CRC32 instructions are available.
+ */
+int crc32c_hardware_available(void);
+
+/**
+ * Computes the CRC-32C of a block of memory.
+ *
+ * @param crc The CRC of any data that came before this block, or 0 to start
+ *    a new CRC. This allows CRCs to be computed incrementally.
+ * @param data The data to be checksummed.
+ * @param length The length of the data, in bytes.
+ * @return The CRC of all data so far.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+/**
+ * Copies a block of memory, computing its CRC-32C as it goes, so each byte
+ * is read only once. The source and destination must not overlap, unless
+ * dest is below src.
+ *
+ * @param crc The CRC of any data that came before this block, or 0.
+ * @return The CRC of all data so far.
+ */
+uint32_t crc32c_copy(uint32_t crc, void *dest, const void *src, size_t length);
+
+/**
+ * Combines the CRCs of two adjacent blocks into the CRC of both. This lets
+ * blocks be checksummed separately (e.g. on different cores).
+ *
+ * @param crc1 The CRC of the first block.
+ * @param crc2 The CRC of the second block.
+ * @param length2 The length of the second block, in bytes.
+ * @return The CRC of the first block followed by the second.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t length2);
+
+#endif
@@ -0,0 +1,168 @@
+/**
+ * Single-pass FDT indexer for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __FDT_INDEX_H__
+#define __FDT_INDEX_H__
+
+#include <microlib.h>
+#include <lazy_cache.h>
+
+/**
+ * The deepest node whose path the index hashes. Deeper nodes can still be
+ * found, but only by the (slower) libfdt lookups.
+ */
+#define FDT_INDEX_MAX_DEPTH         (32)
+
+/**
+ * Bounds on the size of the index's hash tables, in entries. Tables are sized
+ * from the FDT's structure block, and live in the boot-time arena.
+ */
+#define FDT_INDEX_MIN_TABLE_SIZE    (256)
+#define FDT_INDEX_MAX_TABLE_SIZE    (65536)
+
+/**
+ * A single entry in one of the index's hash tables. The key is a path hash,
+ * or a phandle. Path entries also record the node's parent, so a lookup can
+ * check every component of a path rather than trusting its hash.
+ */
+struct fdt_index_entry {
+    uint32_t key;
+    int offset;
+    int parent;
+};
+
+/**
+ * An open-addressed hash table mapping keys to node offsets.
+ */
+struct fdt_index_table {
+    struct fdt_index_entry *entries;
+    uint32_t size;
+    uint32_t used;
+};
+
+/**
+ * Index of the nodes the stub cares about, built with a single walk of the tree.
+ * Each offset is negative if the relevant node wasn't found.
+ */
+struct fdt_index {
+    const void *fdt;
+
+    int chosen;
+    int cpus;
+    int reserved_memory;
+    int psci;
+    int aliases;
+    int stdout;
+
+    // Every memory node in the tree, and every node that may describe a
+    // payload: each child of /chosen, plus any module node in the root. These
+    // lists live in the arena, and grow as needed; there's no limit on how
+    // many we'll record.
+    int *memory;
+    int memory_count;
+    int memory_capacity;
+
+    int *payload_nodes;
+    int payload_node_count;
+    int payload_node_capacity;
+
+    // The parent of each payload node: either the root, or /chosen. Needed to
+    // decode the node's reg property.
+    int *payload_parents;
+    int payload_parent_capacity;
+
+    // Hash tables for lookups that aren't covered above.
+    struct fdt_index_table paths;
+    struct fdt_index_table phandles;
+    int node_count;
+
+    // Used to tell whether the FDT has changed since it was indexed.
+    int valid;
+    uint32_t size_dt_struct;
+
+    // If non-NULL, the FDT's cache lines are invalidated as they're read.
+    struct lazy_cache *cache;
+};
+
+/**
+ * Walks the given FDT once, recording the location of each node of interest.
+ *
+ * @param index The index to be populated.
+ * @param fdt The FDT to be indexed.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_index_build(struct fdt_index *index, const void *fdt);
+
+/**
+ * Walks the given FDT once, recording the location of each node of interest.
+ * Only the parts of the FDT the walk reads are invalidated, using the given
+ * tracker; property values are invalidated as they're read through
+ * fdt_index_getprop().
+ *
+ * @param index The index to be populated.
+ * @param fdt The FDT to be indexed.
+ * @param cache The tracker for the FDT's cache lines, or NULL if the whole
+ *    FDT is already accessible.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_index_build_lazy(struct fdt_index *index, const void *fdt, struct lazy_cache *cache);
+
+/**
+ * Reads a property from the indexed FDT, making sure its value is visible
+ * first. Behaves like fdt_getprop.
+ */
+const void *fdt_index_getprop(const struct fdt_index *index, int node, const char *name, int *lenp);
+
+/**
+ * Finds the offset of the node with the given path, using the index where
+ * possible. Behaves like fdt_path_offset_namelen.
+ */
+int fdt_index_path_offset_namelen(const struct fdt_index *index, const char *path, int namelen);
+
+/**
+ * Finds the offset of the node with the given path, using the index where
+ * possible. Behaves like fdt_path_offset.
+ */
+int fdt_index_path_offset(const struct fdt_index *index, const char *path);
+
+/**
+ * Finds the offset of the node with the given phandle, using the index where
+ * possible. Behaves like fdt_node_offset_by_phandle.
+ */
+int fdt_index_node_offset_by_phandle(const struct fdt_index *index, uint32_t phandle);
+
+/**
+ * Marks the index as stale; all further lookups will go straight to libfdt.
+ * Should be called after any edit that moves nodes around in the FDT.
+ */
+void fdt_index_invalidate(struct fdt_index *index);
+
+/**
+ * @return True iff the index still describes its FDT. Edits that change the
+ *    size of the structure block are detected automatically.
+ */
+int fdt_index_is_current(const struct fdt_index *index);
+
+#endif
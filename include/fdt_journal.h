@@ -0,0 +1,143 @@
+/**
+ * Batched FDT edit journal for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __FDT_JOURNAL_H__
+#define __FDT_JOURNAL_H__
+
+#include <microlib.h>
+
+/**
+ * Nodes added through the journal don't have an offset in the source FDT,
+ * so they're referred to by handles starting at this value instead.
+ */
+#define FDT_JOURNAL_NEW_NODE_BASE   (0x40000000)
+#define FDT_JOURNAL_MAX_DEPTH       (64)
+
+/**
+ * The kinds of edit the journal can record.
+ */
+enum fdt_journal_op {
+    FDT_JOURNAL_ADD_MEM_RSV,
+    FDT_JOURNAL_SETPROP,
+    FDT_JOURNAL_DELPROP,
+    FDT_JOURNAL_ADD_NODE,
+    FDT_JOURNAL_DEL_NODE,
+};
+
+/**
+ * A single recorded edit. Names and values are copied into the arena, so
+ * callers don't need to keep them around.
+ */
+struct fdt_journal_entry {
+    enum fdt_journal_op op;
+
+    // The node being edited; for added nodes, the new node's parent.
+    int node;
+
+    // For added nodes, the handle used to refer to the new node.
+    int handle;
+
+    const char *name;
+    const void *value;
+    int length;
+
+    // For /memreserve/ entries.
+    uint64_t address;
+    uint64_t size;
+};
+
+/**
+ * A set of edits to be applied to a (read-only) source FDT.
+ */
+struct fdt_journal {
+    const void *fdt;
+
+    struct fdt_journal_entry *entries;
+    int count;
+    int capacity;
+
+    int nodes_added;
+};
+
+/**
+ * Creates an empty journal of edits against the given FDT. The source FDT
+ * isn't modified; offsets passed to the journal are offsets into it.
+ *
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_journal_init(struct fdt_journal *journal, const void *fdt);
+
+/**
+ * Records setting a property, replacing any existing value.
+ *
+ * @param node The offset of the node in the source FDT, or the handle of a
+ *    node added through the journal.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_journal_setprop(struct fdt_journal *journal, int node, const char *name,
+    const void *value, int length);
+
+/**
+ * Records setting a property to a single 32-bit cell.
+ */
+int fdt_journal_setprop_u32(struct fdt_journal *journal, int node, const char *name, uint32_t value);
+
+/**
+ * Records deleting a property, if it exists.
+ */
+int fdt_journal_delprop(struct fdt_journal *journal, int node, const char *name);
+
+/**
+ * Records adding a new node. The new node is placed after any of its
+ * parent's existing subnodes.
+ *
+ * @return A handle for the new node, which can be used as a node in later
+ *    edits; or an FDT error code.
+ */
+int fdt_journal_add_subnode(struct fdt_journal *journal, int parent, const char *name);
+
+/**
+ * Records deleting a node, along with all of its subnodes.
+ */
+int fdt_journal_del_node(struct fdt_journal *journal, int node);
+
+/**
+ * Records adding a /memreserve/ entry.
+ */
+int fdt_journal_add_mem_rsv(struct fdt_journal *journal, uint64_t address, uint64_t size);
+
+/**
+ * Applies each edit in the journal, writing the resulting FDT to the given
+ * buffer. The new FDT is built with a single pass over the source.
+ *
+ * @param journal The journal to be applied.
+ * @param buf The buffer to receive the new FDT; must not overlap the source.
+ * @param bufsize The size of the buffer, in bytes.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_journal_serialize(struct fdt_journal *journal, void *buf, int bufsize);
+
+#endif
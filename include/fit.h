@@ -0,0 +1,114 @@
+/**
+ * Flattened Image Tree (FIT) parser for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __FIT_H__
+#define __FIT_H__
+
+#include <microlib.h>
+
+/**
+ * Limits on the FIT contents we track. Images and configurations past these
+ * limits are ignored.
+ */
+#define FIT_MAX_IMAGES          (32)
+#define FIT_MAX_CONFIGURATIONS  (32)
+
+/**
+ * The size of a SHA-256 digest in a FIT hash node.
+ */
+#define FIT_SHA256_BYTES        (32)
+
+/**
+ * The subimages a configuration can select.
+ */
+enum fit_subimage_type {
+    FIT_KERNEL,
+    FIT_FDT,
+    FIT_RAMDISK,
+
+    FIT_SUBIMAGE_TYPES
+};
+
+/**
+ * A single subimage from a FIT's /images node.
+ */
+struct fit_subimage {
+    const char *name;
+
+    // The subimage's node within the FIT, or negative if it isn't present.
+    int node;
+
+    // The subimage's contents. These point into the FIT itself.
+    const void *data;
+    size_t size;
+
+    // The subimage's compression, or NULL if none was specified.
+    const char *compression;
+
+    // The expected SHA-256 digest of the data, from the subimage's hash
+    // node; or NULL if it doesn't have one.
+    const uint8_t *sha256;
+};
+
+/**
+ * The configuration selected from a FIT, and the subimages it references.
+ */
+struct fit_configuration {
+    const void *fit;
+
+    const char *name;
+    int node;
+
+    struct fit_subimage subimages[FIT_SUBIMAGE_TYPES];
+};
+
+/**
+ * @return True iff the given (accessible) image appears to be a FIT.
+ */
+int fit_is_fit(const void *image);
+
+/**
+ * Selects a configuration from a FIT, and locates each of its subimages.
+ * The FIT is walked once to find its images and configurations.
+ *
+ * Configurations are matched against the board's compatible list, as U-Boot
+ * does: a configuration matches if its own compatible property, or the root
+ * compatible of its FDT, lists one of the board's strings; earlier board
+ * strings are more specific, and so are preferred. If nothing matches, the
+ * FIT's default configuration is used.
+ *
+ * @param fit The FIT to be parsed. All of its data must be accessible.
+ * @param fit_size The size of the buffer holding the FIT, including any
+ *    external data placed after the FIT's structure.
+ * @param board_compatible The board's compatible stringlist, or NULL to
+ *    always use the default configuration.
+ * @param board_compatible_length The length of the stringlist.
+ * @param config Out argument; receives the selected configuration.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fit_select_configuration(const void *fit, size_t fit_size, const char *board_compatible,
+    int board_compatible_length, struct fit_configuration *config);
+
+#endif
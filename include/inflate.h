@@ -0,0 +1,71 @@
+/**
+ * Freestanding gzip/DEFLATE decompressor for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __INFLATE_H__
+#define __INFLATE_H__
+
+#include <microlib.h>
+
+/**
+ * Returns true iff the given buffer appears to hold a gzip stream.
+ */
+int gunzip_is_gzip(const void *src, size_t src_size);
+
+/**
+ * Returns the size of a gzip stream's contents, as recorded in its trailer.
+ * Only the low 32 bits are recorded, so this is only meaningful for
+ * contents smaller than 4 GiB.
+ */
+size_t gunzip_uncompressed_size(const void *src, size_t src_size);
+
+/**
+ * Decompresses a gzip stream into the given buffer. The decompressor uses no
+ * heap and no separate window: back-references are resolved from the output
+ * buffer itself, so the whole output must fit in dest.
+ *
+ * @param dest The buffer to receive the decompressed data.
+ * @param dest_size The size of the destination buffer.
+ * @param src The gzip stream to be decompressed.
+ * @param src_size The size of the gzip stream.
+ * @param out_length Out argument; if non-null, receives the number of bytes
+ *    produced.
+ * @return SUCCESS; -FDT_ERR_NOSPACE if the output didn't fit; -FDT_ERR_BADMAGIC
+ *    if src isn't a gzip stream; -FDT_ERR_TRUNCATED if the stream ended early;
+ *    or -FDT_ERR_BADVALUE if the stream is corrupt.
+ */
+int gunzip(void *dest, size_t dest_size, const void *src, size_t src_size, size_t *out_length);
+
+/**
+ * Decompresses only the start of a gzip stream; e.g. to read a header out of
+ * the compressed data before deciding where the rest should go.
+ *
+ * @param dest The buffer to receive the start of the decompressed data.
+ * @param length The number of bytes to be decompressed.
+ * @return SUCCESS, or an error code as for gunzip(). Streams whose contents
+ *    are shorter than length fail with -FDT_ERR_TRUNCATED.
+ */
+int gunzip_prefix(void *dest, size_t length, const void *src, size_t src_size);
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * On-demand cache invalidation for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LAZY_CACHE_H__
+#define __LAZY_CACHE_H__
+
+#include <microlib.h>
+
+/**
+ * Tracks which cache lines of a region have already been invalidated, so each
+ * line is invalidated just before it's first read-- and only once.
+ */
+struct lazy_cache {
+    uintptr_t base;
+    size_t length;
+    size_t line_bytes;
+
+    // One bit per cache line; set once the line has been invalidated.
+    uint64_t *bitmap;
+};
+
+/**
+ * Operation used to invalidate any lines that were never touched.
+ */
+typedef void (*lazy_cache_region_op)(const void *addr, size_t length);
+
+/**
+ * Starts tracking a region, none of which has been invalidated yet.
+ *
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int lazy_cache_init(struct lazy_cache *cache, const void *base, size_t length);
+
+/**
+ * Invalidates any lines in the given range that haven't been invalidated
+ * yet. Should be called before the range is read. Does nothing if cache is
+ * NULL, so callers can use the same code whether or not they're being lazy.
+ */
+void lazy_cache_touch(struct lazy_cache *cache, const void *addr, size_t length);
+
+/**
+ * Invalidates lines starting at the given string, until the string's
+ * terminator has been made visible.
+ */
+void lazy_cache_touch_string(struct lazy_cache *cache, const char *string);
+
+/**
+ * Invalidates every line that hasn't been touched yet, in as few calls to
+ * the given operation as possible.
+ *
+ * @param op The operation used to invalidate each run of lines, or NULL to
+ *    use __clean_invalidate_dcache_region.
+ */
+void lazy_cache_finish(struct lazy_cache *cache, lazy_cache_region_op op);
+
+#endif
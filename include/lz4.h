@@ -0,0 +1,70 @@
+/**
+ * Freestanding LZ4 decompressor for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __LZ4_H__
+#define __LZ4_H__
+
+#include <microlib.h>
+
+/**
+ * Returns true iff the given buffer appears to hold an LZ4 stream; either an
+ * LZ4 frame, or the legacy format produced by 'lz4 -l' (as used for Linux's
+ * Image.lz4).
+ */
+int lz4_is_lz4(const void *src, size_t src_size);
+
+/**
+ * Returns the size of an LZ4 stream's contents, if the stream records it;
+ * or 0 if it doesn't (e.g. legacy streams).
+ */
+size_t lz4_content_size(const void *src, size_t src_size);
+
+/**
+ * Decompresses an LZ4 stream into the given buffer. Like gunzip(), this uses
+ * the output buffer as its window, so the whole output must fit in dest.
+ *
+ * @param dest The buffer to receive the decompressed data.
+ * @param dest_size The size of the destination buffer.
+ * @param src The LZ4 stream to be decompressed.
+ * @param src_size The size of the LZ4 stream.
+ * @param out_length Out argument; if non-null, receives the number of bytes
+ *    produced.
+ * @return SUCCESS; -FDT_ERR_NOSPACE if the output didn't fit; -FDT_ERR_BADMAGIC
+ *    if src isn't an LZ4 stream; -FDT_ERR_TRUNCATED if the stream ended early;
+ *    or -FDT_ERR_BADVALUE if the stream is corrupt.
+ */
+int lz4_decompress(void *dest, size_t dest_size, const void *src, size_t src_size, size_t *out_length);
+
+/**
+ * Decompresses only the start of an LZ4 stream.
+ *
+ * @param dest The buffer to receive the start of the decompressed data.
+ * @param length The number of bytes to be decompressed.
+ * @return SUCCESS, or an error code as for lz4_decompress(). Streams whose
+ *    contents are shorter than length fail with -FDT_ERR_TRUNCATED.
+ */
+int lz4_decompress_prefix(void *dest, size_t length, const void *src, size_t src_size);
+
+#endif
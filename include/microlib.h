@@ -34,8 +34,26 @@
 
 static const int SUCCESS = 0;
 
-static const int true = 1;
-static const int false = 0;
+/**
+ * C++ (e.g. our unit tests) already has booleans, and its own min and max,
+ * which our macros would trample.
+ */
+#ifndef __cplusplus
+  static const int true = 1;
+  static const int false = 0;
+
+  /**
+   * Min and max macros.
+   */
+  #define max(a,b) \
+     ({ __typeof__ (a) _a = (a); \
+         __typeof__ (b) _b = (b); \
+       _a > _b ? _a : _b; })
+  #define min(a,b) \
+     ({ __typeof__ (a) _a = (a); \
+         __typeof__ (b) _b = (b); \
+       _a < _b ? _a : _b; })
+#endif
 
 
 /**
@@ -54,18 +72,6 @@ static const int false = 0;
   #define stdin 0
 
 
-  /**
-   * Min and max macros.
-   */
-  #define max(a,b) \
-     ({ __typeof__ (a) _a = (a); \
-         __typeof__ (b) _b = (b); \
-       _a > _b ? _a : _b; })
-  #define min(a,b) \
-     ({ __typeof__ (a) _a = (a); \
-         __typeof__ (b) _b = (b); \
-       _a < _b ? _a : _b; })
-
   void * memcpy(void * dest, const void * src, size_t n);
   void * memmove(void *dst0, const void *src0, register size_t length);
 
@@ -92,4 +98,10 @@ static const int false = 0;
 void reboot(void);
 
 
+/**
+ * Prints an error message and terminates execution. Implemented in main.c.
+ */
+void panic(const char * message);
+
+
 #endif
@@ -0,0 +1,142 @@
+/**
+ * Payload placement planner for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __PLACEMENT_H__
+#define __PLACEMENT_H__
+
+#include <microlib.h>
+#include <regions.h>
+
+/**
+ * The most regions a single plan can track.
+ */
+#define PLACEMENT_MAX_REGIONS (16)
+
+/**
+ * The constraints on where a region can end up.
+ */
+enum placement_kind {
+    // Must stay exactly where it is (e.g. the stub, or its stacks).
+    PLACEMENT_RESIDENT,
+
+    // Must be moved to a given destination (e.g. the kernel).
+    PLACEMENT_FIXED,
+
+    // Can live anywhere in RAM, and stays put unless it's in the way
+    // (e.g. the ramdisk).
+    PLACEMENT_FLOATING,
+};
+
+/**
+ * A single region of memory whose contents are in use during boot.
+ */
+struct placement_region {
+    const char *name;
+    enum placement_kind kind;
+
+    // Where the region lives now, and how much of it must be preserved.
+    uint64_t start;
+    uint64_t size;
+
+    // Where the region must end up, and how much space it takes there; this
+    // can be more than its size, e.g. for a kernel's BSS. Filled in by the
+    // planner for floating regions.
+    uint64_t destination;
+    uint64_t footprint;
+
+    // True iff the region's move copes with its source and destination
+    // overlapping, as memmove does. Decompression, for example, doesn't.
+    int may_overlap;
+};
+
+/**
+ * A set of regions, and-- once solved-- the order to move them in.
+ */
+struct placement_plan {
+    struct placement_region regions[PLACEMENT_MAX_REGIONS];
+    int count;
+
+    // The indices of each region that needs to move, in the order they
+    // should be moved. Each region moves at most once.
+    int moves[PLACEMENT_MAX_REGIONS];
+    int move_count;
+};
+
+/**
+ * Creates an empty plan.
+ */
+void placement_init(struct placement_plan *plan);
+
+/**
+ * Adds a region that must stay where it is.
+ *
+ * @return The index of the new region, or -FDT_ERR_NOSPACE if the plan is full.
+ */
+int placement_add_resident(struct placement_plan *plan, const char *name, uint64_t start, uint64_t size);
+
+/**
+ * Adds a region that must be moved to a fixed destination.
+ *
+ * @param start The region's current location.
+ * @param size The number of bytes to be moved.
+ * @param destination The location the region must be moved to.
+ * @param footprint The number of bytes the region occupies at its destination.
+ * @param may_overlap True iff the move copes with an overlapping destination.
+ * @return The index of the new region, or -FDT_ERR_NOSPACE if the plan is full.
+ */
+int placement_add_fixed(struct placement_plan *plan, const char *name, uint64_t start, uint64_t size,
+    uint64_t destination, uint64_t footprint, int may_overlap);
+
+/**
+ * Adds a region that can live anywhere in RAM.
+ *
+ * @return The index of the new region, or -FDT_ERR_NOSPACE if the plan is full.
+ */
+int placement_add_floating(struct placement_plan *plan, const char *name, uint64_t start, uint64_t size);
+
+/**
+ * Works out where each floating region should live, and the order in which
+ * regions should be moved, so that no move overwrites anything that's still
+ * needed. Floating regions are only moved if they're in the way; when they
+ * are, they're given the lowest free spot in memory.
+ *
+ * @param plan The plan to be solved.
+ * @param memory A normalized set of the memory floating regions can be moved into.
+ * @param alignment The alignment for any floating regions that are moved;
+ *    must be a power of two.
+ * @return SUCCESS; -FDT_ERR_NOSPACE if a floating region has nowhere to go;
+ *    or -FDT_ERR_BADLAYOUT if the fixed regions can't all be placed.
+ */
+int placement_solve(struct placement_plan *plan, const struct region_set *memory, uint64_t alignment);
+
+/**
+ * @return True iff the given region needs to be moved.
+ */
+static inline int placement_region_moves(const struct placement_region *region)
+{
+    return region->kind != PLACEMENT_RESIDENT && region->destination != region->start;
+}
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * Physical memory region sets for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __REGIONS_H__
+#define __REGIONS_H__
+
+#include <microlib.h>
+
+/**
+ * A single region of physical memory.
+ */
+struct mem_region {
+    uint64_t start;
+    uint64_t size;
+};
+
+/**
+ * A growable set of memory regions, backed by the boot-time arena.
+ * Once normalized, the regions are sorted by start address, and no two
+ * regions overlap or touch.
+ */
+struct region_set {
+    struct mem_region *regions;
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * Creates an empty region set.
+ *
+ * @param set The set to be initialized.
+ * @param capacity The number of regions to make room for up front; the set
+ *    will grow past this if needed.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int region_set_init(struct region_set *set, size_t capacity);
+
+/**
+ * Adds a region to the set. Empty regions are ignored. The set is not
+ * normalized until region_set_normalize() is called.
+ *
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int region_set_insert(struct region_set *set, uint64_t start, uint64_t size);
+
+/**
+ * Sorts the set by start address, and merges any regions that overlap or touch.
+ * Runs in O(n log n).
+ */
+void region_set_normalize(struct region_set *set);
+
+/**
+ * Removes every region in a set of exclusions from the given set, splitting
+ * regions as needed. Both sets are normalized first, after which this takes
+ * a single pass over each.
+ *
+ * @param set The set to be modified.
+ * @param exclusions The regions to be removed from the set.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int region_set_subtract(struct region_set *set, struct region_set *exclusions);
+
+#endif
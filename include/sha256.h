@@ -0,0 +1,83 @@
+/**
+ * SHA-256 for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#include <microlib.h>
+
+#define SHA256_DIGEST_BYTES  (32)
+#define SHA256_BLOCK_BYTES   (64)
+
+/**
+ * The state of a SHA-256 computation in progress.
+ */
+struct sha256_context {
+    uint32_t state[8];
+    uint64_t length;
+
+    // Data waiting for a complete block.
+    uint8_t buffer[SHA256_BLOCK_BYTES];
+    size_t buffered;
+};
+
+/**
+ * @return True iff the ARMv8 Crypto Extensions' SHA-256 instructions are
+ *    available (and have been enabled for our use).
+ */
+int sha256_hardware_available(void);
+
+/**
+ * Prepares to compute a new SHA-256 digest.
+ */
+void sha256_init(struct sha256_context *context);
+
+/**
+ * Adds data to a SHA-256 computation.
+ */
+void sha256_update(struct sha256_context *context, const void *data, size_t length);
+
+/**
+ * Copies a block of memory, adding it to a SHA-256 computation as it goes.
+ * Each byte is read only once, which matters when running with the caches off.
+ * The source and destination must not overlap, unless dest is below src.
+ *
+ * @return dest
+ */
+void *sha256_copy(struct sha256_context *context, void *dest, const void *src, size_t length);
+
+/**
+ * Completes a SHA-256 computation.
+ *
+ * @param digest Out argument; receives the SHA-256 digest.
+ */
+void sha256_final(struct sha256_context *context, uint8_t digest[SHA256_DIGEST_BYTES]);
+
+/**
+ * Computes the SHA-256 digest of a block of memory.
+ */
+void sha256(const void *data, size_t length, uint8_t digest[SHA256_DIGEST_BYTES]);
+
+#endif
@@ -0,0 +1,100 @@
+/**
+ * Boot-time arena allocator for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <config.h>
+
+#include <arena.h>
+
+#define ARENA_ALIGN (16)
+
+/**
+ * The arena itself. On hardware, this lives in its own NOLOAD section after
+ * the EL1 stack, so it isn't zeroed along with .bss, and is handed back to
+ * the next-stage kernel along with the EL1 stack.
+ */
+#ifdef __RUNNING_ON_OS__
+static uint8_t arena[CONFIG_ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+#else
+static uint8_t arena[CONFIG_ARENA_SIZE] __attribute__((section(".noinit"), aligned(ARENA_ALIGN)));
+#endif
+
+/**
+ * The offset of the first free byte in the arena.
+ */
+static size_t arena_used;
+
+
+/**
+ * Allocates a block of memory from the boot-time arena. Allocations are
+ * aligned to 16 bytes, and are never individually freed.
+ *
+ * @param size The number of bytes to be allocated.
+ * @return A pointer to the new block, or NULL if the arena is exhausted.
+ */
+void *arena_alloc(size_t size)
+{
+    void *block;
+
+    // Round up, so the next allocation stays aligned.
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if(size > CONFIG_ARENA_SIZE - arena_used)
+        return NULL;
+
+    block = &arena[arena_used];
+    arena_used += size;
+    return block;
+}
+
+
+/**
+ * @return A mark that can be passed to arena_release() to free every
+ *    allocation made after this call.
+ */
+arena_mark_t arena_mark(void)
+{
+    return arena_used;
+}
+
+
+/**
+ * Frees every allocation made since the given mark was taken.
+ */
+void arena_release(arena_mark_t mark)
+{
+    if(mark < arena_used)
+        arena_used = mark;
+}
+
+
+/**
+ * @return The number of bytes still available in the arena.
+ */
+size_t arena_available(void)
+{
+    return CONFIG_ARENA_SIZE - arena_used;
+}
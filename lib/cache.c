@@ -33,60 +33,337 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <cache_topology.h>
+
 /**
- * Reads the CTRL_EL0 register.
+ * Returns the number of bytes per data cache line; or, for systems with
+ * several data caches, the smallest of their line sizes.
  */
-uint32_t raw_read_ctr_el0(void)
+size_t __dcache_line_bytes(void)
 {
-    uint32_t ctr_el0;
+    return cache_topology()->dcache_min_line_bytes;
+}
+
 
-    __asm__ __volatile__("mrs %0, CTR_EL0\n\t" : "=r" (ctr_el0) :  : "memory");
-    return ctr_el0;
+/**
+ * Returns the number of bytes per instruction cache line; or, for systems with
+ * several instruction caches, the smallest of their line sizes.
+ */
+size_t __icache_line_bytes(void)
+{
+    return cache_topology()->icache_min_line_bytes;
 }
 
 
 /**
- * Returns the number of bytes per cache line.
+ * The maintenance operations we can apply to a single cache line.
  */
-size_t __dcache_line_bytes(void)
+enum cache_line_op {
+    CACHE_CLEAN,
+    CACHE_INVALIDATE,
+    CACHE_CLEAN_INVALIDATE,
+    CACHE_CLEAN_TO_POU,
+    CACHE_INVALIDATE_INSTRUCTIONS,
+};
+
+
+/**
+ * Applies a maintenance operation to the line that holds the given address.
+ * Issues no barriers; callers are responsible for those.
+ */
+static inline void cache_line_op(enum cache_line_op op, uintptr_t addr)
+{
+    switch(op) {
+        case CACHE_CLEAN:
+            asm volatile("dc cvac, %0" :: "r" (addr) : "memory");
+            break;
+        case CACHE_INVALIDATE:
+            asm volatile("dc ivac, %0" :: "r" (addr) : "memory");
+            break;
+        case CACHE_CLEAN_INVALIDATE:
+            asm volatile("dc civac, %0" :: "r" (addr) : "memory");
+            break;
+        case CACHE_CLEAN_TO_POU:
+            asm volatile("dc cvau, %0" :: "r" (addr) : "memory");
+            break;
+        case CACHE_INVALIDATE_INSTRUCTIONS:
+            asm volatile("ic ivau, %0" :: "r" (addr) : "memory");
+            break;
+    }
+}
+
+
+/**
+ * Applies a maintenance operation to every line in [start, end), which must
+ * both be line-aligned. Issues no barriers.
+ *
+ * This is always inlined with a constant op, so the switch above disappears
+ * and we're left with a tight loop of cache maintenance instructions.
+ */
+static inline __attribute__((always_inline))
+void cache_range_op(enum cache_line_op op, uintptr_t start, uintptr_t end, size_t line_bytes)
 {
-    uint32_t ctr_el0;
-    static unsigned int line_bytes = 0;
+    uintptr_t addr = start;
 
-    if (line_bytes)
-        return line_bytes;
+    // Handle four lines per iteration, to keep loop overhead out of the way
+    // of the maintenance operations themselves...
+    while(end - addr >= 4 * line_bytes) {
+        cache_line_op(op, addr);
+        cache_line_op(op, addr + line_bytes);
+        cache_line_op(op, addr + 2 * line_bytes);
+        cache_line_op(op, addr + 3 * line_bytes);
+        addr += 4 * line_bytes;
+    }
 
-    ctr_el0 = raw_read_ctr_el0();
+    // ... and then mop up whatever's left.
+    while(addr < end) {
+        cache_line_op(op, addr);
+        addr += line_bytes;
+    }
+}
 
-    /* [19:16] - Indicates (Log2(number of words in cache line) */
-    line_bytes = 1 << ((ctr_el0 >> 16) & 0xf);
 
-    /* Bytes in a word (32-bit) */
-    line_bytes *= sizeof(uint32_t);
-    return line_bytes;
+/**
+ * Waits for all previously-issued cache maintenance to complete.
+ */
+static inline void cache_maintenance_barrier(void)
+{
+    asm volatile("dsb sy" ::: "memory");
 }
 
+
 /**
- * Cleans the cache line that represents the provided address.
+ * Rounds the given address down to the start of its cache line.
  */
-void __invalidate_cache_line(const void * addr)
+static inline uintptr_t line_start(uintptr_t addr, size_t line_bytes)
 {
-    asm volatile("dc civac, %0" :: "r" (addr));
+    return addr & ~(uintptr_t)(line_bytes - 1);
 }
 
 
 /**
- * Invalides any cache lines that store data relevant to a given regsion.
+ * Rounds the given address up to the start of the next cache line.
  */
-void __invalidate_cache_region(const void * addr, size_t length)
+static inline uintptr_t line_end(uintptr_t addr, size_t line_bytes)
 {
-    size_t bytes_per_line = __dcache_line_bytes();
-    const void * end_addr = addr + length;
+    return (addr + line_bytes - 1) & ~(uintptr_t)(line_bytes - 1);
+}
 
-    while(addr <= end_addr) {
-        __invalidate_cache_line(addr);
-        addr += bytes_per_line;
+
+/**
+ * Applies a set/way operation to every line of every data or unified cache
+ * up to the point of coherency. Issues no barriers.
+ *
+ * @param op Either CACHE_CLEAN or CACHE_CLEAN_INVALIDATE.
+ */
+static void cache_set_way_op(enum cache_line_op op)
+{
+    const struct cache_topology *topology = cache_topology();
+    unsigned int level, line_shift, way_shift, way, set;
+
+    for(level = 0; level < topology->levels; ++level) {
+        const struct cache_geometry *geometry = &topology->data[level];
+
+        if(!geometry->size)
+            continue;
+
+        line_shift = __builtin_ctz(geometry->line_bytes);
+
+        // The way number lives in the top bits of the operand.
+        way_shift = (geometry->ways > 1) ? __builtin_clz(geometry->ways - 1) : 0;
+
+        for(way = 0; way < geometry->ways; ++way) {
+            for(set = 0; set < geometry->sets; ++set) {
+                uint64_t operand = ((uint64_t)way << way_shift) |
+                    ((uint64_t)set << line_shift) | (level << 1);
+
+                if(op == CACHE_CLEAN)
+                    asm volatile("dc csw, %0" :: "r" (operand) : "memory");
+                else
+                    asm volatile("dc cisw, %0" :: "r" (operand) : "memory");
+            }
+        }
     }
 }
 
 
+/**
+ * Cleans every line of every data cache to the point of coherency.
+ *
+ * Set/way operations only reach this core's view of the caches, and can race
+ * with anything else touching memory, so this is only for the points where
+ * we hand the whole machine to the next exception level or stage-- never as
+ * a substitute for maintenance of a particular region.
+ */
+void __clean_dcache_all(void)
+{
+    cache_set_way_op(CACHE_CLEAN);
+    cache_maintenance_barrier();
+    asm volatile("isb" ::: "memory");
+}
+
+
+/**
+ * Cleans and invalidates every line of every data cache. See
+ * __clean_dcache_all for when this is safe.
+ */
+void __clean_invalidate_dcache_all(void)
+{
+    cache_set_way_op(CACHE_CLEAN_INVALIDATE);
+    cache_maintenance_barrier();
+    asm volatile("isb" ::: "memory");
+}
+
+
+/**
+ * Cleans any data cache lines for the given region to the point of coherency,
+ * so the region's contents can be seen by anything not using our cache
+ * (e.g. code running with its caches off, or DMA).
+ */
+void __clean_dcache_region(const void *addr, size_t length)
+{
+    size_t line_bytes = __dcache_line_bytes();
+    uintptr_t start = (uintptr_t)addr;
+
+    if(!length)
+        return;
+
+    cache_range_op(CACHE_CLEAN, line_start(start, line_bytes),
+        line_end(start + length, line_bytes), line_bytes);
+    cache_maintenance_barrier();
+}
+
+
+/**
+ * Discards any data cache lines for the given region without writing them
+ * back, so the region's contents will next be read from memory.
+ *
+ * Lines only partially covered by the region may also hold data we shouldn't
+ * discard, so those are cleaned and invalidated instead.
+ */
+void __invalidate_dcache_region(const void *addr, size_t length)
+{
+    size_t line_bytes = __dcache_line_bytes();
+    uintptr_t start = (uintptr_t)addr, end = start + length;
+    uintptr_t aligned_start = line_end(start, line_bytes);
+    uintptr_t aligned_end = line_start(end, line_bytes);
+
+    if(!length)
+        return;
+
+    // If the region lies within a single line, there's nothing we can safely discard.
+    if(aligned_start >= aligned_end) {
+        cache_range_op(CACHE_CLEAN_INVALIDATE, line_start(start, line_bytes),
+            line_end(end, line_bytes), line_bytes);
+        cache_maintenance_barrier();
+        return;
+    }
+
+    if(start != aligned_start)
+        cache_line_op(CACHE_CLEAN_INVALIDATE, line_start(start, line_bytes));
+    if(end != aligned_end)
+        cache_line_op(CACHE_CLEAN_INVALIDATE, aligned_end);
+
+    cache_range_op(CACHE_INVALIDATE, aligned_start, aligned_end, line_bytes);
+    cache_maintenance_barrier();
+}
+
+
+/**
+ * Cleans and invalidates any data cache lines for the given region. This is
+ * what we need to see data that a previous stage left in its cache, e.g. when
+ * it loaded us with its caches on.
+ */
+void __clean_invalidate_dcache_region(const void *addr, size_t length)
+{
+    size_t line_bytes = __dcache_line_bytes();
+    uintptr_t start = (uintptr_t)addr;
+
+    if(!length)
+        return;
+
+    cache_range_op(CACHE_CLEAN_INVALIDATE, line_start(start, line_bytes),
+        line_end(start + length, line_bytes), line_bytes);
+    cache_maintenance_barrier();
+}
+
+
+/**
+ * Makes newly-written code in the given region visible to instruction fetch:
+ * cleans the data cache to the point of unification, and then invalidates
+ * the relevant instruction cache lines.
+ */
+void __sync_icache_region(const void *addr, size_t length)
+{
+    size_t dline_bytes = __dcache_line_bytes();
+    size_t iline_bytes = __icache_line_bytes();
+    uintptr_t start = (uintptr_t)addr, end = start + length;
+
+    if(!length)
+        return;
+
+    cache_range_op(CACHE_CLEAN_TO_POU, line_start(start, dline_bytes),
+        line_end(end, dline_bytes), dline_bytes);
+
+    // The instruction cache refills from the point of unification, so our
+    // cleans have to land before we invalidate.
+    asm volatile("dsb ish" ::: "memory");
+
+    cache_range_op(CACHE_INVALIDATE_INSTRUCTIONS, line_start(start, iline_bytes),
+        line_end(end, iline_bytes), iline_bytes);
+
+    cache_maintenance_barrier();
+    asm volatile("isb" ::: "memory");
+}
+
+
+/**
+ * Zeroes a region of memory, using DC ZVA to zero whole blocks at a time when
+ * we're running with the MMU and data cache on. DC ZVA faults on Device
+ * memory, which is all we see with the MMU off; then, this is just memset.
+ */
+void *__zero_region(void *dest, size_t length)
+{
+    size_t block_bytes = cache_topology()->zva_block_bytes;
+    uintptr_t start = (uintptr_t)dest, end = start + length;
+    uintptr_t block_start, block_end;
+
+    if(!cache_zva_usable())
+        return memset(dest, 0, length);
+
+    block_start = (start + block_bytes - 1) & ~(uintptr_t)(block_bytes - 1);
+    block_end = end & ~(uintptr_t)(block_bytes - 1);
+
+    if(block_start >= block_end)
+        return memset(dest, 0, length);
+
+    // Zero the unaligned edges by hand, and everything between by block.
+    memset(dest, 0, block_start - start);
+    memset((void *)block_end, 0, end - block_end);
+
+    for(; block_start < block_end; block_start += block_bytes)
+        asm volatile("dc zva, %0" :: "r" (block_start) : "memory");
+
+    return dest;
+}
+
+
+/**
+ * Cleans and invalidates the cache line that represents the provided address.
+ */
+void __invalidate_cache_line(const void * addr)
+{
+    cache_line_op(CACHE_CLEAN_INVALIDATE, (uintptr_t)addr);
+    cache_maintenance_barrier();
+}
+
+
+/**
+ * Cleans and invalidates any cache lines that store data relevant to a given
+ * region. Kept for existing callers; equivalent to
+ * __clean_invalidate_dcache_region.
+ */
+void __invalidate_cache_region(const void * addr, size_t length)
+{
+    __clean_invalidate_dcache_region(addr, length);
+}
@@ -0,0 +1,200 @@
+/**
+ * Cache topology probing for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <cache_topology.h>
+
+/**
+ * Fields of the ID registers that describe the caches.
+ */
+#define CTR_IMINLINE_SHIFT      0
+#define CTR_DMINLINE_SHIFT      16
+#define CLIDR_LOC_SHIFT         24
+#define CLIDR_CTYPE_BITS        3
+#define CSSELR_INSTRUCTION      1
+#define DCZID_BS_MASK           0xf
+#define DCZID_DZP               (1 << 4)
+#define MMFR2_CCIDX_SHIFT       20
+#define SCTLR_M                 (1 << 0)
+#define SCTLR_C                 (1 << 2)
+
+static struct cache_topology topology;
+static int topology_probed;
+
+
+/**
+ * Returns true iff CCSIDR_EL1 uses the wider FEAT_CCIDX format.
+ */
+static int has_ccidx(void)
+{
+    uint64_t mmfr2;
+
+    asm volatile("mrs %0, ID_AA64MMFR2_EL1" : "=r" (mmfr2));
+    return ((mmfr2 >> MMFR2_CCIDX_SHIFT) & 0xf) != 0;
+}
+
+
+/**
+ * Reads the geometry of one side of the cache at the given level.
+ *
+ * @param level The cache level, where 0 is L1.
+ * @param instruction True to read the instruction side of a split cache.
+ * @param ccidx True iff CCSIDR_EL1 uses the FEAT_CCIDX format.
+ */
+static void probe_geometry(struct cache_geometry *geometry, int level, int instruction, int ccidx)
+{
+    uint64_t ccsidr;
+
+    asm volatile("msr CSSELR_EL1, %0" :: "r" ((uint64_t)(level << 1) | (instruction ? CSSELR_INSTRUCTION : 0)));
+    asm volatile("isb");
+    asm volatile("mrs %0, CCSIDR_EL1" : "=r" (ccsidr));
+
+    geometry->line_bytes = 1 << ((ccsidr & 0x7) + 4);
+    if(ccidx) {
+        geometry->ways = ((ccsidr >> 3) & 0x1fffff) + 1;
+        geometry->sets = ((ccsidr >> 32) & 0xffffff) + 1;
+    } else {
+        geometry->ways = ((ccsidr >> 3) & 0x3ff) + 1;
+        geometry->sets = ((ccsidr >> 13) & 0x7fff) + 1;
+    }
+
+    geometry->size = (size_t)geometry->line_bytes * geometry->ways * geometry->sets;
+}
+
+
+/**
+ * Reads everything we want to know about the caches from the ID registers.
+ */
+static void probe_topology(struct cache_topology *t)
+{
+    uint64_t ctr, clidr, dczid;
+    int level, ccidx = has_ccidx();
+
+    asm volatile("mrs %0, CTR_EL0" : "=r" (ctr));
+    asm volatile("mrs %0, CLIDR_EL1" : "=r" (clidr));
+    asm volatile("mrs %0, DCZID_EL0" : "=r" (dczid));
+
+    memset(t, 0, sizeof(*t));
+
+    // CTR_EL0 reports line sizes as log2 of the number of 4-byte words.
+    t->dcache_min_line_bytes = sizeof(uint32_t) << ((ctr >> CTR_DMINLINE_SHIFT) & 0xf);
+    t->icache_min_line_bytes = sizeof(uint32_t) << ((ctr >> CTR_IMINLINE_SHIFT) & 0xf);
+    t->dcache_max_line_bytes = t->dcache_min_line_bytes;
+
+    t->levels = (clidr >> CLIDR_LOC_SHIFT) & 0x7;
+
+    for(level = 0; level < t->levels; ++level) {
+        t->type[level] = (clidr >> (level * CLIDR_CTYPE_BITS)) & 0x7;
+
+        if(t->type[level] == CACHE_TYPE_INSTRUCTION || t->type[level] == CACHE_TYPE_SEPARATE)
+            probe_geometry(&t->instruction[level], level, true, ccidx);
+
+        if(t->type[level] >= CACHE_TYPE_DATA) {
+            probe_geometry(&t->data[level], level, false, ccidx);
+            t->dcache_max_line_bytes = max(t->dcache_max_line_bytes, t->data[level].line_bytes);
+        }
+    }
+
+    // DC ZVA zeroes blocks of 4-byte words, unless it's been prohibited.
+    if(!(dczid & DCZID_DZP))
+        t->zva_block_bytes = sizeof(uint32_t) << (dczid & DCZID_BS_MASK);
+}
+
+
+/**
+ * Returns the system's cache topology, probing it on first use.
+ */
+const struct cache_topology *cache_topology(void)
+{
+    if(!topology_probed) {
+        probe_topology(&topology);
+        topology_probed = true;
+    }
+
+    return &topology;
+}
+
+
+/**
+ * Returns true iff DC ZVA can be used right now.
+ */
+int cache_zva_usable(void)
+{
+    uint64_t current_el, sctlr;
+
+    if(!cache_topology()->zva_block_bytes)
+        return false;
+
+    // The SCTLR that governs us depends on where we're running.
+    asm volatile("mrs %0, CurrentEL" : "=r" (current_el));
+    if(((current_el >> 2) & 0x3) == 2)
+        asm volatile("mrs %0, SCTLR_EL2" : "=r" (sctlr));
+    else
+        asm volatile("mrs %0, SCTLR_EL1" : "=r" (sctlr));
+
+    return (sctlr & (SCTLR_M | SCTLR_C)) == (SCTLR_M | SCTLR_C);
+}
+
+
+/**
+ * Prints the geometry of a single cache, lined up with our other boot messages.
+ */
+static void print_geometry(int level, const char *kind, const struct cache_geometry *geometry)
+{
+    static const char padding[] = "                         ";
+
+    // Labels are "  Ln <kind> cache:", and values start at column 41.
+    size_t label_length = strlen("  Ln  cache:") + strlen(kind);
+
+    printf("  L%d %s cache:%s%u KiB, %u-way, %u sets, %u-byte lines\n",
+        level + 1, kind, padding + (sizeof(padding) - 1) - (41 - label_length),
+        (unsigned)(geometry->size / 1024), geometry->ways, geometry->sets, geometry->line_bytes);
+}
+
+
+/**
+ * Prints a summary of the system's caches.
+ */
+void cache_topology_print(void)
+{
+    const struct cache_topology *t = cache_topology();
+    int level;
+
+    for(level = 0; level < t->levels; ++level) {
+        if(t->instruction[level].size)
+            print_geometry(level, "instruction", &t->instruction[level]);
+
+        if(t->data[level].size)
+            print_geometry(level, (t->type[level] == CACHE_TYPE_UNIFIED) ? "unified" : "data", &t->data[level]);
+    }
+
+    printf("  minimum cache line size:               %u bytes (data), %u bytes (instruction)\n",
+        t->dcache_min_line_bytes, t->icache_min_line_bytes);
+
+    if(t->zva_block_bytes)
+        printf("  dc zva block size:                     %u bytes\n", t->zva_block_bytes);
+    else
+        printf("  dc zva block size:                     prohibited\n");
+}
@@ -0,0 +1,300 @@
+/**
+ * CRC-32C (Castagnoli) for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+
+#include <crc32c.h>
+
+/**
+ * The CRC-32C polynomial, in reversed (LSB-first) form.
+ */
+#define CRC32C_POLYNOMIAL  0x82f63b78
+
+/**
+ * Tables for the software implementation, which works eight bytes at a time
+ * ("slicing-by-8"). These are built on first use, rather than taking up 8 KiB
+ * of our image.
+ */
+static uint32_t crc32c_table[8][256];
+static int crc32c_table_ready;
+
+
+/**
+ * @return True iff the ARMv8 CRC32 instructions are available.
+ */
+int crc32c_hardware_available(void)
+{
+#ifndef __RUNNING_ON_OS__
+    static int available = -1;
+    uint64_t isar0;
+
+    if(available < 0) {
+        // ID_AA64ISAR0_EL1.CRC32 is non-zero if CRC32CX and friends are implemented.
+        asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r" (isar0));
+        available = ((isar0 >> 16) & 0xf) != 0;
+    }
+
+    return available;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * Builds the tables for the software implementation.
+ */
+static void crc32c_build_table(void)
+{
+    uint32_t crc;
+    int i, j;
+
+    for(i = 0; i < 256; ++i) {
+        crc = i;
+        for(j = 0; j < 8; ++j)
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+        crc32c_table[0][i] = crc;
+    }
+
+    // Each further table advances the CRC past another zero byte.
+    for(i = 0; i < 256; ++i)
+        for(j = 1; j < 8; ++j)
+            crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[j - 1][i] & 0xff];
+
+    crc32c_table_ready = true;
+}
+
+
+/**
+ * Stores a 64-bit word, a byte at a time, for destinations that aren't aligned.
+ */
+static inline void store_bytes(uint8_t *dest, uint64_t word)
+{
+    int i;
+
+    for(i = 0; i < sizeof(word); ++i)
+        dest[i] = word >> (8 * i);
+}
+
+
+/**
+ * Software CRC-32C, optionally copying the data as it's read. Works on the
+ * raw (inverted) CRC.
+ */
+static uint32_t crc32c_software(uint32_t crc, uint8_t *dest, const uint8_t *src, size_t length)
+{
+    int dest_aligned;
+
+    if(!crc32c_table_ready)
+        crc32c_build_table();
+
+    // Handle bytes until the source is aligned...
+    for(; length && ((uintptr_t)src & 7); --length) {
+        if(dest)
+            *dest++ = *src;
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *src++) & 0xff];
+    }
+
+    // ... then whole words...
+    dest_aligned = !((uintptr_t)dest & 7);
+    for(; length >= 8; length -= 8) {
+        uint64_t word = *(const uint64_t *)src;
+
+        if(dest && dest_aligned)
+            *(uint64_t *)dest = word;
+        else if(dest)
+            store_bytes(dest, word);
+
+        word ^= crc;
+        crc = crc32c_table[7][word & 0xff] ^ crc32c_table[6][(word >> 8) & 0xff] ^
+              crc32c_table[5][(word >> 16) & 0xff] ^ crc32c_table[4][(word >> 24) & 0xff] ^
+              crc32c_table[3][(word >> 32) & 0xff] ^ crc32c_table[2][(word >> 40) & 0xff] ^
+              crc32c_table[1][(word >> 48) & 0xff] ^ crc32c_table[0][word >> 56];
+
+        src += 8;
+        if(dest)
+            dest += 8;
+    }
+
+    // ... and then whatever's left.
+    for(; length; --length) {
+        if(dest)
+            *dest++ = *src;
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *src++) & 0xff];
+    }
+
+    return crc;
+}
+
+
+#ifndef __RUNNING_ON_OS__
+
+/**
+ * CRC-32C using the ARMv8 CRC32 instructions, optionally copying the data as
+ * it's read. Works on the raw (inverted) CRC. As above, words are only loaded
+ * from aligned addresses, as unaligned accesses fault with the MMU off.
+ *
+ * We build for plain ARMv8.0, where these instructions are optional, so each
+ * use enables them in the assembler explicitly.
+ */
+static uint32_t crc32c_hardware(uint32_t crc, uint8_t *dest, const uint8_t *src, size_t length)
+{
+    int dest_aligned;
+
+    for(; length && ((uintptr_t)src & 7); --length) {
+        if(dest)
+            *dest++ = *src;
+        asm(".arch_extension crc\n\tcrc32cb %w0, %w0, %w1" : "+r" (crc) : "r" ((uint32_t)*src++));
+    }
+
+    dest_aligned = !((uintptr_t)dest & 7);
+    for(; length >= 8; length -= 8) {
+        uint64_t word = *(const uint64_t *)src;
+
+        if(dest && dest_aligned)
+            *(uint64_t *)dest = word;
+        else if(dest)
+            store_bytes(dest, word);
+
+        asm(".arch_extension crc\n\tcrc32cx %w0, %w0, %x1" : "+r" (crc) : "r" (word));
+
+        src += 8;
+        if(dest)
+            dest += 8;
+    }
+
+    for(; length; --length) {
+        if(dest)
+            *dest++ = *src;
+        asm(".arch_extension crc\n\tcrc32cb %w0, %w0, %w1" : "+r" (crc) : "r" ((uint32_t)*src++));
+    }
+
+    return crc;
+}
+
+#endif
+
+
+/**
+ * Computes a CRC, optionally copying the data, using the fastest
+ * implementation we have.
+ */
+static uint32_t crc32c_process(uint32_t crc, uint8_t *dest, const uint8_t *src, size_t length)
+{
+#ifndef __RUNNING_ON_OS__
+    if(crc32c_hardware_available())
+        return ~crc32c_hardware(~crc, dest, src, length);
+#endif
+
+    return ~crc32c_software(~crc, dest, src, length);
+}
+
+
+/**
+ * Computes the CRC-32C of a block of memory.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length)
+{
+    return crc32c_process(crc, NULL, data, length);
+}
+
+
+/**
+ * Copies a block of memory, computing its CRC-32C as it goes.
+ */
+uint32_t crc32c_copy(uint32_t crc, void *dest, const void *src, size_t length)
+{
+    return crc32c_process(crc, dest, src, length);
+}
+
+
+/**
+ * Multiplies a vector by a matrix over GF(2); the matrix is 32 columns.
+ */
+static uint32_t gf2_matrix_times(const uint32_t *matrix, uint32_t vector)
+{
+    uint32_t sum = 0;
+
+    for(; vector; vector >>= 1, ++matrix)
+        if(vector & 1)
+            sum ^= *matrix;
+
+    return sum;
+}
+
+
+/**
+ * Squares a matrix over GF(2).
+ */
+static void gf2_matrix_square(uint32_t *square, const uint32_t *matrix)
+{
+    int i;
+
+    for(i = 0; i < 32; ++i)
+        square[i] = gf2_matrix_times(matrix, matrix[i]);
+}
+
+
+/**
+ * Combines the CRCs of two adjacent blocks into the CRC of both. This is the
+ * usual zlib approach: the first CRC is advanced past length2 zero bytes by
+ * repeatedly squaring the "advance by one zero bit" operator.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t length2)
+{
+    uint32_t even[32], odd[32];
+    uint32_t row = 1;
+    int i;
+
+    if(!length2)
+        return crc1;
+
+    // The operator for one zero bit...
+    odd[0] = CRC32C_POLYNOMIAL;
+    for(i = 1; i < 32; ++i, row <<= 1)
+        odd[i] = row;
+
+    // ... for two zero bits, and then for four.
+    gf2_matrix_square(even, odd);
+    gf2_matrix_square(odd, even);
+
+    // Apply the operator for each set bit of the length, in bytes.
+    do {
+        gf2_matrix_square(even, odd);
+        if(length2 & 1)
+            crc1 = gf2_matrix_times(even, crc1);
+        length2 >>= 1;
+
+        if(!length2)
+            break;
+
+        gf2_matrix_square(odd, even);
+        if(length2 & 1)
+            crc1 = gf2_matrix_times(odd, crc1);
+        length2 >>= 1;
+    } while(length2);
+
+    return crc1 ^ crc2;
+}
@@ -0,0 +1,656 @@
+/**
+ * Single-pass FDT indexer for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <arena.h>
+#include <fdt_index.h>
+
+/**
+ * FNV-1a parameters, used to hash node paths.
+ */
+#define FNV_OFFSET_BASIS  0x811c9dc5U
+#define FNV_PRIME         0x01000193U
+
+
+/**
+ * Extends an FNV-1a hash with the given bytes.
+ */
+static uint32_t hash_bytes(uint32_t hash, const char *bytes, int length)
+{
+    while(length--) {
+        hash ^= (unsigned char)*bytes++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+/**
+ * Returns true iff the given node name is the given path component, using the
+ * same rules as fdt_path_offset: a component without a unit address matches
+ * a node with any unit address.
+ */
+static int name_matches_component(const char *name, int name_len,
+    const char *component, int component_len)
+{
+    if(name_len < component_len)
+        return false;
+
+    if(memcmp(name, component, component_len))
+        return false;
+
+    if(name_len == component_len)
+        return true;
+
+    return !memchr(component, '@', component_len) && (name[component_len] == '@');
+}
+
+
+/**
+ * Allocates an empty hash table from the arena.
+ *
+ * @param size The number of entries in the table; must be a power of two.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+static int table_init(struct fdt_index_table *table, uint32_t size)
+{
+    table->entries = arena_alloc(size * sizeof(*table->entries));
+    if(!table->entries)
+        return -FDT_ERR_NOSPACE;
+
+    table->size = size;
+    table->used = 0;
+
+    // Empty slots have a negative offset.
+    memset(table->entries, 0xff, size * sizeof(*table->entries));
+    return SUCCESS;
+}
+
+
+/**
+ * Adds a key to the given hash table.
+ *
+ * @param parent For path entries, the offset of the node's parent; otherwise -1.
+ */
+static void table_insert(struct fdt_index_table *table, uint32_t key, int offset, int parent)
+{
+    uint32_t slot = key & (table->size - 1);
+
+    // Keep the table at most three-quarters full, so probes stay short.
+    // Anything we can't fit will be found by libfdt instead.
+    if(table->used >= (table->size / 4) * 3)
+        return;
+
+    while(table->entries[slot].offset >= 0)
+        slot = (slot + 1) & (table->size - 1);
+
+    table->entries[slot].key = key;
+    table->entries[slot].offset = offset;
+    table->entries[slot].parent = parent;
+    ++table->used;
+}
+
+
+/**
+ * Finds the child of the given parent with the given path hash, whose name
+ * matches the final component of its path.
+ *
+ * @param parent The offset of the node's parent, or -1 for the root.
+ * @return The node's offset, or -FDT_ERR_NOTFOUND.
+ */
+static int index_find(const struct fdt_index *index, uint32_t hash, int parent,
+    const char *component, int component_len)
+{
+    const struct fdt_index_table *table = &index->paths;
+    uint32_t slot = hash & (table->size - 1);
+
+    // Probe until we hit an empty slot. Entries with the same hash are stored
+    // in insertion-- and thus tree-- order, so we'll find the first match first.
+    while(table->entries[slot].offset >= 0) {
+        const struct fdt_index_entry *entry = &table->entries[slot];
+
+        if(entry->key == hash && entry->parent == parent) {
+            int name_len;
+            const char *name = fdt_get_name(index->fdt, entry->offset, &name_len);
+
+            if(name && name_matches_component(name, name_len, component, component_len))
+                return entry->offset;
+        }
+
+        slot = (slot + 1) & (table->size - 1);
+    }
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+
+/**
+ * Appends a node offset to one of the index's lists, growing the list in the
+ * arena if needed. The old list can't be freed, but lists only grow a handful
+ * of times.
+ *
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+static int list_append(int **list, int *count, int *capacity, int node)
+{
+    if(*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        int *new_list = arena_alloc(new_capacity * sizeof(*new_list));
+
+        if(!new_list)
+            return -FDT_ERR_NOSPACE;
+
+        if(*count)
+            memcpy(new_list, *list, *count * sizeof(*new_list));
+
+        *list = new_list;
+        *capacity = new_capacity;
+    }
+
+    (*list)[(*count)++] = node;
+    return SUCCESS;
+}
+
+
+/**
+ * Picks a hash table size for the given FDT. We can't know how many nodes
+ * there are without walking the tree, so we estimate from the size of the
+ * structure block; real-world trees average well over 64 bytes per node.
+ */
+static uint32_t table_size_for(const void *fdt)
+{
+    uint32_t estimate = fdt_size_dt_struct(fdt) / 64;
+    uint32_t size = FDT_INDEX_MIN_TABLE_SIZE;
+
+    while(size < estimate && size < FDT_INDEX_MAX_TABLE_SIZE)
+        size <<= 1;
+
+    return size;
+}
+
+
+/**
+ * Properties whose values are always read while indexing, or that are small
+ * and used all over (e.g. by libfdt's helpers). Their values are made
+ * visible as the index is built; everything else waits until it's read.
+ */
+static const char *const eager_properties[] = {
+    "#address-cells",
+    "#size-cells",
+    "phandle",
+    "linux,phandle",
+    "device_type",
+    "compatible",
+};
+
+
+/**
+ * Returns true iff the given NUL-terminated strings are equal.
+ */
+static int strings_equal(const char *a, const char *b)
+{
+    size_t length = strlen(a);
+    return (strlen(b) == length) && !memcmp(a, b, length);
+}
+
+
+/**
+ * Returns true iff the given property should be made visible while indexing.
+ */
+static int is_eager_property(const char *name)
+{
+    size_t i;
+
+    for(i = 0; i < sizeof(eager_properties) / sizeof(*eager_properties); ++i)
+        if(strings_equal(name, eager_properties[i]))
+            return true;
+
+    return false;
+}
+
+
+/**
+ * Records the given node in the index, if it's one of the nodes we track.
+ *
+ * @param depth The node's depth in the tree; the root is at depth zero.
+ * @param parent The offset of the node's parent.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+static int index_classify(struct fdt_index *index, int node, int depth, int parent,
+    const char *name, int name_len)
+{
+    // Payloads can be passed as any child of /chosen, or as a module node in
+    // the root (as Discharge does). We can't read compatible strings yet, so
+    // record every candidate; find_payloads picks out the payloads later.
+    int in_chosen = (depth == 2) && (index->chosen >= 0) && (parent == index->chosen);
+    if(in_chosen || (depth == 1 && name_matches_component(name, name_len, "module", 6))) {
+        int parent_count = index->payload_node_count;
+        int rc = list_append(&index->payload_parents, &parent_count, &index->payload_parent_capacity, parent);
+
+        return rc ? rc : list_append(&index->payload_nodes, &index->payload_node_count,
+            &index->payload_node_capacity, node);
+    }
+
+    // Everything else we track lives directly under the root.
+    if(depth != 1)
+        return SUCCESS;
+
+    if(name_matches_component(name, name_len, "chosen", 6))
+        index->chosen = node;
+    else if(name_matches_component(name, name_len, "cpus", 4))
+        index->cpus = node;
+    else if(name_matches_component(name, name_len, "reserved-memory", 15))
+        index->reserved_memory = node;
+    else if(name_matches_component(name, name_len, "psci", 4))
+        index->psci = node;
+    else if(name_matches_component(name, name_len, "aliases", 7))
+        index->aliases = node;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Records anything the index needs to know from the property at the given
+ * offset; e.g. the owning node's phandle.
+ *
+ * @param node The offset of the node that owns the property.
+ * @param depth The depth of the node that owns the property.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+static int index_property(struct fdt_index *index, int node, int depth, int offset)
+{
+    const struct fdt_property *property;
+    const char *name;
+    int length;
+
+    property = fdt_get_property_by_offset(index->fdt, offset, &length);
+    if(!property)
+        return SUCCESS;
+
+    name = fdt_string(index->fdt, fdt32_to_cpu(property->nameoff));
+    if(!name || !is_eager_property(name))
+        return SUCCESS;
+
+    lazy_cache_touch(index->cache, property->data, length);
+
+    // Note any phandle, so references can be resolved without a tree walk.
+    if((strings_equal(name, "phandle") || strings_equal(name, "linux,phandle")) && length == sizeof(fdt32_t)) {
+        uint32_t phandle = fdt32_to_cpu(*(const fdt32_t *)property->data);
+
+        if(phandle && phandle != (uint32_t)-1)
+            table_insert(&index->phandles, phandle, node, -1);
+    }
+
+    // Memory nodes are identified by their device type, rather than their name.
+    if(depth == 1 && strings_equal(name, "device_type") &&
+        fdt_stringlist_contains(property->data, length, "memory"))
+        return list_append(&index->memory, &index->memory_count, &index->memory_capacity, node);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Reads the tag at the given offset in the structure block, making sure the
+ * tag-- and, for nodes, the node's name-- are visible first.
+ * Behaves like fdt_next_tag.
+ */
+static uint32_t index_next_tag(const struct fdt_index *index, int offset, int *next_offset)
+{
+    const fdt32_t *tag;
+
+    // A property's header is the largest thing that can follow a tag directly.
+    tag = fdt_offset_ptr(index->fdt, offset, FDT_TAGSIZE);
+    lazy_cache_touch(index->cache, tag, sizeof(struct fdt_property));
+
+    if(tag && fdt32_to_cpu(*tag) == FDT_BEGIN_NODE)
+        lazy_cache_touch_string(index->cache, (const char *)tag + FDT_TAGSIZE);
+
+    return fdt_next_tag(index->fdt, offset, next_offset);
+}
+
+
+/**
+ * Finds the node used for the console, as described by /chosen's stdout-path.
+ */
+static int index_find_stdout(const struct fdt_index *index)
+{
+    const char *path, *separator;
+    int length;
+
+    if(index->chosen < 0)
+        return -FDT_ERR_NOTFOUND;
+
+    path = fdt_index_getprop(index, index->chosen, "stdout-path", &length);
+    if(!path)
+        path = fdt_index_getprop(index, index->chosen, "linux,stdout-path", &length);
+    if(!path || length <= 0)
+        return -FDT_ERR_NOTFOUND;
+
+    // The path may be followed by console options (e.g. ":115200n8").
+    length = strnlen(path, length);
+    separator = memchr(path, ':', length);
+    if(separator)
+        length = separator - path;
+
+    // The path may also be an alias, which we'll need to resolve.
+    if(path[0] != '/') {
+        if(index->aliases < 0)
+            return -FDT_ERR_NOTFOUND;
+
+        path = fdt_getprop_namelen(index->fdt, index->aliases, path, length, &length);
+        if(!path)
+            return -FDT_ERR_NOTFOUND;
+
+        lazy_cache_touch(index->cache, path, length);
+        length = strnlen(path, length);
+    }
+
+    return fdt_index_path_offset_namelen(index, path, length);
+}
+
+
+/**
+ * Walks the given FDT once, recording the location of each node of interest.
+ *
+ * @param index The index to be populated.
+ * @param fdt The FDT to be indexed.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_index_build(struct fdt_index *index, const void *fdt)
+{
+    return fdt_index_build_lazy(index, fdt, NULL);
+}
+
+
+/**
+ * Adds the node at the given offset to the index.
+ *
+ * @param path_hash The path hash of each of the node's ancestors.
+ * @param ancestors The offset of each of the node's ancestors.
+ * @return SUCCESS, or an FDT error code.
+ */
+static int index_node(struct fdt_index *index, int node, int depth,
+    uint32_t *path_hash, int *ancestors)
+{
+    const char *name, *unit_address;
+    uint32_t hash;
+    int name_len;
+
+    name = fdt_get_name(index->fdt, node, &name_len);
+    if(!name)
+        return name_len;
+
+    ++index->node_count;
+
+    // We can't hash paths deeper than our ancestor stack; leave those to libfdt.
+    if(depth > FDT_INDEX_MAX_DEPTH)
+        return SUCCESS;
+
+    // Compute this node's path hash from its parent's: "/", "/name", "/name/child".
+    if(depth == 0) {
+        hash = hash_bytes(FNV_OFFSET_BASIS, "/", 1);
+    } else {
+        hash = path_hash[depth - 1];
+        if(depth > 1)
+            hash = hash_bytes(hash, "/", 1);
+
+        // fdt_path_offset lets the final component omit a unit address,
+        // so index the node under its name without one, too-- unless
+        // an earlier sibling already claimed that path.
+        unit_address = memchr(name, '@', name_len);
+        if(unit_address) {
+            int base_len = unit_address - name;
+            uint32_t base_hash = hash_bytes(hash, name, base_len);
+
+            if(index_find(index, base_hash, ancestors[depth - 1], name, base_len) < 0)
+                table_insert(&index->paths, base_hash, node, ancestors[depth - 1]);
+        }
+
+        hash = hash_bytes(hash, name, name_len);
+    }
+
+    path_hash[depth] = hash;
+    ancestors[depth] = node;
+    table_insert(&index->paths, hash, node, depth ? ancestors[depth - 1] : -1);
+
+    return index_classify(index, node, depth, depth ? ancestors[depth - 1] : -1, name, name_len);
+}
+
+
+/**
+ * Walks the given FDT once, recording the location of each node of interest.
+ * Only the parts of the FDT the walk reads are invalidated, using the given
+ * tracker; property values are invalidated as they're read through
+ * fdt_index_getprop().
+ *
+ * @param index The index to be populated.
+ * @param fdt The FDT to be indexed.
+ * @param cache The tracker for the FDT's cache lines, or NULL if the whole
+ *    FDT is already accessible.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_index_build_lazy(struct fdt_index *index, const void *fdt, struct lazy_cache *cache)
+{
+    // The path hash of each of the current node's ancestors, and their offsets.
+    uint32_t path_hash[FDT_INDEX_MAX_DEPTH + 1];
+    int ancestors[FDT_INDEX_MAX_DEPTH + 1];
+
+    int node = -1, depth = -1, offset = 0, next_offset, rc;
+    uint32_t table_size, tag;
+
+    // Start from an empty index.
+    index->fdt = fdt;
+    index->cache = cache;
+    index->valid = false;
+    index->chosen = index->cpus = index->reserved_memory = -FDT_ERR_NOTFOUND;
+    index->psci = index->aliases = index->stdout = -FDT_ERR_NOTFOUND;
+    index->memory = index->payload_nodes = index->payload_parents = NULL;
+    index->memory_count = index->payload_node_count = 0;
+    index->memory_capacity = index->payload_node_capacity = index->payload_parent_capacity = 0;
+    index->node_count = 0;
+
+    rc = fdt_check_header(fdt);
+    if(rc)
+        return rc;
+
+    // Phandles are only found on nodes that are referenced, so they get a smaller table.
+    table_size = table_size_for(fdt);
+    rc = table_init(&index->paths, table_size);
+    if(!rc)
+        rc = table_init(&index->phandles, table_size / 2);
+    if(rc)
+        return rc;
+
+    // Walk each tag in the tree exactly once. We walk tags rather than nodes,
+    // so we can tell exactly which parts of the tree we've read.
+    do {
+        tag = index_next_tag(index, offset, &next_offset);
+
+        switch(tag) {
+            case FDT_BEGIN_NODE:
+                node = offset;
+                rc = index_node(index, node, ++depth, path_hash, ancestors);
+                if(rc)
+                    return rc;
+                break;
+
+            // Properties always belong to the most recently opened node.
+            case FDT_PROP:
+                rc = index_property(index, node, depth, offset);
+                if(rc)
+                    return rc;
+                break;
+
+            case FDT_END_NODE:
+                --depth;
+                break;
+
+            case FDT_NOP:
+                break;
+
+            case FDT_END:
+                // fdt_next_tag also reports FDT_END for a malformed tree.
+                if(next_offset < 0)
+                    return next_offset;
+                break;
+
+            default:
+                return -FDT_ERR_BADSTRUCTURE;
+        }
+
+        offset = next_offset;
+    } while(tag != FDT_END);
+
+    // The index is now usable; remember enough to notice if the tree changes.
+    index->valid = true;
+    index->size_dt_struct = fdt_size_dt_struct(fdt);
+
+    index->stdout = index_find_stdout(index);
+    return SUCCESS;
+}
+
+
+/**
+ * Marks the index as stale; all further lookups will go straight to libfdt.
+ * Should be called after any edit that moves nodes around in the FDT.
+ */
+void fdt_index_invalidate(struct fdt_index *index)
+{
+    index->valid = false;
+}
+
+
+/**
+ * @return True iff the index still describes its FDT. Edits that change the
+ *    size of the structure block are detected automatically.
+ */
+int fdt_index_is_current(const struct fdt_index *index)
+{
+    return index->valid && (fdt_size_dt_struct(index->fdt) == index->size_dt_struct);
+}
+
+
+/**
+ * Finds the offset of the node with the given path, using the index where
+ * possible. Behaves like fdt_path_offset_namelen.
+ */
+int fdt_index_path_offset_namelen(const struct fdt_index *index, const char *path, int namelen)
+{
+    uint32_t hash;
+    int offset, position;
+
+    // Aliases and relative paths aren't indexed, and a stale index is no use.
+    if(namelen <= 0 || path[0] != '/' || !fdt_index_is_current(index))
+        return fdt_path_offset_namelen(index->fdt, path, namelen);
+
+    // Ignore any trailing slash, as libfdt does.
+    while(namelen > 1 && path[namelen - 1] == '/')
+        --namelen;
+
+    // Walk down the path a component at a time, extending its hash as we go.
+    // Each node we find must be a child of the last, so two paths that merely
+    // hash alike can't be confused for one another.
+    hash = hash_bytes(FNV_OFFSET_BASIS, "/", 1);
+    offset = index_find(index, hash, -1, "", 0);
+
+    for(position = 1; offset >= 0 && position < namelen; ) {
+        const char *component = path + position;
+        const char *separator = memchr(component, '/', namelen - position);
+        int component_len = separator ? separator - component : namelen - position;
+
+        if(position > 1)
+            hash = hash_bytes(hash, "/", 1);
+        hash = hash_bytes(hash, component, component_len);
+
+        offset = index_find(index, hash, offset, component, component_len);
+        position += component_len + 1;
+    }
+
+    // If we missed, the node may be one we couldn't index; ask libfdt.
+    if(offset < 0)
+        return fdt_path_offset_namelen(index->fdt, path, namelen);
+
+    return offset;
+}
+
+
+/**
+ * Finds the offset of the node with the given path, using the index where
+ * possible. Behaves like fdt_path_offset.
+ */
+int fdt_index_path_offset(const struct fdt_index *index, const char *path)
+{
+    return fdt_index_path_offset_namelen(index, path, strlen(path));
+}
+
+
+/**
+ * Finds the offset of the node with the given phandle, using the index where
+ * possible. Behaves like fdt_node_offset_by_phandle.
+ */
+int fdt_index_node_offset_by_phandle(const struct fdt_index *index, uint32_t phandle)
+{
+    const struct fdt_index_table *table = &index->phandles;
+    uint32_t slot = phandle & (table->size - 1);
+
+    if(!phandle || phandle == (uint32_t)-1)
+        return -FDT_ERR_BADPHANDLE;
+
+    if(fdt_index_is_current(index)) {
+        while(table->entries[slot].offset >= 0) {
+            if(table->entries[slot].key == phandle)
+                return table->entries[slot].offset;
+
+            slot = (slot + 1) & (table->size - 1);
+        }
+    }
+
+    // If we missed, the node may be one we couldn't index; ask libfdt.
+    return fdt_node_offset_by_phandle(index->fdt, phandle);
+}
+
+
+/**
+ * Reads a property from the indexed FDT, making sure its value is visible
+ * first. Behaves like fdt_getprop.
+ */
+const void *fdt_index_getprop(const struct fdt_index *index, int node, const char *name, int *lenp)
+{
+    int length;
+    const void *value = fdt_getprop(index->fdt, node, name, &length);
+
+    if(value)
+        lazy_cache_touch(index->cache, value, length);
+
+    if(lenp)
+        *lenp = length;
+
+    return value;
+}
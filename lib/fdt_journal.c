@@ -0,0 +1,530 @@
+/**
+ * Batched FDT edit journal for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <arena.h>
+#include <fdt_journal.h>
+
+/**
+ * Creates an empty journal of edits against the given FDT. The source FDT
+ * isn't modified; offsets passed to the journal are offsets into it.
+ *
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_journal_init(struct fdt_journal *journal, const void *fdt)
+{
+    journal->fdt = fdt;
+    journal->entries = NULL;
+    journal->count = journal->capacity = 0;
+    journal->nodes_added = 0;
+
+    return fdt_check_header(fdt);
+}
+
+
+/**
+ * Copies a block of data into the arena.
+ */
+static const void *arena_copy(const void *data, int length)
+{
+    void *copy = arena_alloc(length);
+
+    if(copy)
+        memcpy(copy, data, length);
+
+    return copy;
+}
+
+
+/**
+ * Appends a new, empty entry to the journal.
+ *
+ * @return The new entry, or NULL if the arena is exhausted.
+ */
+static struct fdt_journal_entry *journal_append(struct fdt_journal *journal,
+    enum fdt_journal_op op, int node, const char *name)
+{
+    struct fdt_journal_entry *entry;
+
+    // Grow the entry array if we need to. The old array can't be freed, but
+    // journals are short-lived.
+    if(journal->count == journal->capacity) {
+        int capacity = journal->capacity ? journal->capacity * 2 : 32;
+        struct fdt_journal_entry *entries = arena_alloc(capacity * sizeof(*entries));
+
+        if(!entries)
+            return NULL;
+
+        if(journal->count)
+            memcpy(entries, journal->entries, journal->count * sizeof(*entries));
+
+        journal->entries = entries;
+        journal->capacity = capacity;
+    }
+
+    entry = &journal->entries[journal->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->op = op;
+    entry->node = node;
+
+    if(name) {
+        entry->name = arena_copy(name, strlen(name) + 1);
+        if(!entry->name)
+            return NULL;
+    }
+
+    ++journal->count;
+    return entry;
+}
+
+
+/**
+ * Records setting a property, replacing any existing value.
+ *
+ * @param node The offset of the node in the source FDT, or the handle of a
+ *    node added through the journal.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_journal_setprop(struct fdt_journal *journal, int node, const char *name,
+    const void *value, int length)
+{
+    struct fdt_journal_entry *entry = journal_append(journal, FDT_JOURNAL_SETPROP, node, name);
+
+    if(!entry)
+        return -FDT_ERR_NOSPACE;
+
+    if(length) {
+        entry->value = arena_copy(value, length);
+        if(!entry->value)
+            return -FDT_ERR_NOSPACE;
+    }
+
+    entry->length = length;
+    return SUCCESS;
+}
+
+
+/**
+ * Records setting a property to a single 32-bit cell.
+ */
+int fdt_journal_setprop_u32(struct fdt_journal *journal, int node, const char *name, uint32_t value)
+{
+    fdt32_t cell = cpu_to_fdt32(value);
+    return fdt_journal_setprop(journal, node, name, &cell, sizeof(cell));
+}
+
+
+/**
+ * Records deleting a property, if it exists.
+ */
+int fdt_journal_delprop(struct fdt_journal *journal, int node, const char *name)
+{
+    return journal_append(journal, FDT_JOURNAL_DELPROP, node, name) ? SUCCESS : -FDT_ERR_NOSPACE;
+}
+
+
+/**
+ * Records adding a new node. The new node is placed after any of its
+ * parent's existing subnodes.
+ *
+ * @return A handle for the new node, which can be used as a node in later
+ *    edits; or an FDT error code.
+ */
+int fdt_journal_add_subnode(struct fdt_journal *journal, int parent, const char *name)
+{
+    struct fdt_journal_entry *entry = journal_append(journal, FDT_JOURNAL_ADD_NODE, parent, name);
+
+    if(!entry)
+        return -FDT_ERR_NOSPACE;
+
+    entry->handle = FDT_JOURNAL_NEW_NODE_BASE + journal->nodes_added++;
+    return entry->handle;
+}
+
+
+/**
+ * Records deleting a node, along with all of its subnodes.
+ */
+int fdt_journal_del_node(struct fdt_journal *journal, int node)
+{
+    return journal_append(journal, FDT_JOURNAL_DEL_NODE, node, NULL) ? SUCCESS : -FDT_ERR_NOSPACE;
+}
+
+
+/**
+ * Records adding a /memreserve/ entry.
+ */
+int fdt_journal_add_mem_rsv(struct fdt_journal *journal, uint64_t address, uint64_t size)
+{
+    struct fdt_journal_entry *entry = journal_append(journal, FDT_JOURNAL_ADD_MEM_RSV, -1, NULL);
+
+    if(!entry)
+        return -FDT_ERR_NOSPACE;
+
+    entry->address = address;
+    entry->size = size;
+    return SUCCESS;
+}
+
+
+/**
+ * Sorts the journal's entries by the node they apply to, keeping edits to
+ * the same node in the order they were made. Edits are usually recorded
+ * roughly in tree order, so a simple insertion sort does well here.
+ */
+static void journal_sort(struct fdt_journal *journal)
+{
+    int i;
+
+    for(i = 1; i < journal->count; ++i) {
+        struct fdt_journal_entry current = journal->entries[i];
+        int j = i;
+
+        while(j > 0 && journal->entries[j - 1].node > current.node) {
+            journal->entries[j] = journal->entries[j - 1];
+            --j;
+        }
+
+        journal->entries[j] = current;
+    }
+}
+
+
+/**
+ * Finds the (sorted) journal entries that apply to the given node.
+ *
+ * @param out_first Out argument. Receives the index of the node's first entry.
+ * @return The number of entries that apply to the given node.
+ */
+static int journal_find_node(const struct fdt_journal *journal, int node, int *out_first)
+{
+    int low = 0, high = journal->count, end;
+
+    while(low < high) {
+        int middle = low + (high - low) / 2;
+
+        if(journal->entries[middle].node < node)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    for(end = low; end < journal->count && journal->entries[end].node == node; ++end);
+
+    *out_first = low;
+    return end - low;
+}
+
+
+/**
+ * Finds the last property edit made to the given property, which determines
+ * its final state.
+ *
+ * @return The relevant SETPROP or DELPROP entry, or NULL if the property wasn't edited.
+ */
+static const struct fdt_journal_entry *final_property_edit(const struct fdt_journal *journal,
+    int first, int count, const char *name)
+{
+    size_t length = strlen(name);
+    int i;
+
+    for(i = first + count - 1; i >= first; --i) {
+        const struct fdt_journal_entry *entry = &journal->entries[i];
+
+        if(entry->op != FDT_JOURNAL_SETPROP && entry->op != FDT_JOURNAL_DELPROP)
+            continue;
+
+        if((strlen(entry->name) == length) && !memcmp(entry->name, name, length))
+            return entry;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Returns true iff the journal deletes the given node.
+ */
+static int node_is_deleted(const struct fdt_journal *journal, int first, int count)
+{
+    int i;
+
+    for(i = first; i < first + count; ++i)
+        if(journal->entries[i].op == FDT_JOURNAL_DEL_NODE)
+            return true;
+
+    return false;
+}
+
+
+/**
+ * Emits each property the journal adds to a node that the node didn't
+ * already have.
+ *
+ * @param source_node The node's offset in the source FDT, or -1 for added nodes.
+ */
+static int emit_new_properties(const struct fdt_journal *journal, void *buf,
+    int source_node, int first, int count)
+{
+    int i, rc;
+
+    for(i = first; i < first + count; ++i) {
+        const struct fdt_journal_entry *entry = &journal->entries[i];
+
+        if(entry->op != FDT_JOURNAL_SETPROP)
+            continue;
+
+        // Only the final edit to each property counts.
+        if(final_property_edit(journal, first, count, entry->name) != entry)
+            continue;
+
+        // Properties that already existed were replaced in place.
+        if(source_node >= 0 && fdt_getprop(journal->fdt, source_node, entry->name, NULL))
+            continue;
+
+        rc = fdt_property(buf, entry->name, entry->value, entry->length);
+        if(rc)
+            return rc;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Emits each node the journal adds under the given parent, along with their
+ * properties and subnodes.
+ */
+static int emit_new_subnodes(const struct fdt_journal *journal, void *buf,
+    int first, int count, int depth)
+{
+    int i, rc;
+
+    if(depth > FDT_JOURNAL_MAX_DEPTH)
+        return -FDT_ERR_BADSTRUCTURE;
+
+    for(i = first; i < first + count; ++i) {
+        const struct fdt_journal_entry *entry = &journal->entries[i];
+        int child_first, child_count;
+
+        if(entry->op != FDT_JOURNAL_ADD_NODE)
+            continue;
+
+        child_count = journal_find_node(journal, entry->handle, &child_first);
+        if(node_is_deleted(journal, child_first, child_count))
+            continue;
+
+        rc = fdt_begin_node(buf, entry->name);
+        if(!rc)
+            rc = emit_new_properties(journal, buf, -1, child_first, child_count);
+        if(!rc)
+            rc = emit_new_subnodes(journal, buf, child_first, child_count, depth + 1);
+        if(!rc)
+            rc = fdt_end_node(buf);
+        if(rc)
+            return rc;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Emits the memory reservation map: the source's entries, followed by
+ * any the journal adds.
+ */
+static int emit_reservemap(const struct fdt_journal *journal, void *buf)
+{
+    int i, rc, first, count;
+    uint64_t address, size;
+
+    for(i = 0; i < fdt_num_mem_rsv(journal->fdt); ++i) {
+        rc = fdt_get_mem_rsv(journal->fdt, i, &address, &size);
+        if(!rc)
+            rc = fdt_add_reservemap_entry(buf, address, size);
+        if(rc)
+            return rc;
+    }
+
+    count = journal_find_node(journal, -1, &first);
+    for(i = first; i < first + count; ++i) {
+        rc = fdt_add_reservemap_entry(buf, journal->entries[i].address, journal->entries[i].size);
+        if(rc)
+            return rc;
+    }
+
+    return fdt_finish_reservemap(buf);
+}
+
+
+/**
+ * Applies each edit in the journal, writing the resulting FDT to the given
+ * buffer. The new FDT is built with a single pass over the source.
+ *
+ * @param journal The journal to be applied.
+ * @param buf The buffer to receive the new FDT; must not overlap the source.
+ * @param bufsize The size of the buffer, in bytes.
+ * @return SUCCESS, or an FDT error code.
+ */
+int fdt_journal_serialize(struct fdt_journal *journal, void *buf, int bufsize)
+{
+    const void *fdt = journal->fdt;
+
+    // For each node we're inside: its offset, the range of journal entries
+    // that apply to it, and whether we've emitted its new properties yet.
+    int nodes[FDT_JOURNAL_MAX_DEPTH];
+    int firsts[FDT_JOURNAL_MAX_DEPTH];
+    int counts[FDT_JOURNAL_MAX_DEPTH];
+    int properties_done[FDT_JOURNAL_MAX_DEPTH];
+
+    // The depth of the node we're in, and the depth of any deleted subtree we're skipping.
+    int depth = -1, skip_depth = -1;
+    int offset = 0, next_offset, rc;
+    uint32_t tag;
+
+    journal_sort(journal);
+
+    rc = fdt_create(buf, bufsize);
+    if(!rc)
+        rc = emit_reservemap(journal, buf);
+    if(rc)
+        return rc;
+
+    // Walk each tag in the source's structure block exactly once.
+    do {
+        tag = fdt_next_tag(fdt, offset, &next_offset);
+
+        switch(tag) {
+            case FDT_BEGIN_NODE:
+                ++depth;
+                if(depth >= FDT_JOURNAL_MAX_DEPTH)
+                    return -FDT_ERR_BADSTRUCTURE;
+
+                if(skip_depth >= 0)
+                    break;
+
+                // Properties always come before subnodes, so the parent's
+                // new properties have to be emitted before its first child.
+                if(depth > 0 && !properties_done[depth - 1]) {
+                    rc = emit_new_properties(journal, buf, nodes[depth - 1], firsts[depth - 1], counts[depth - 1]);
+                    if(rc)
+                        return rc;
+                    properties_done[depth - 1] = true;
+                }
+
+                nodes[depth] = offset;
+                counts[depth] = journal_find_node(journal, offset, &firsts[depth]);
+                properties_done[depth] = false;
+
+                if(node_is_deleted(journal, firsts[depth], counts[depth])) {
+                    skip_depth = depth;
+                    break;
+                }
+
+                rc = fdt_begin_node(buf, fdt_get_name(fdt, offset, NULL));
+                if(rc)
+                    return rc;
+                break;
+
+            case FDT_PROP: {
+                const struct fdt_property *property;
+                const struct fdt_journal_entry *edit;
+                const char *name;
+                int length;
+
+                if(skip_depth >= 0)
+                    break;
+
+                property = fdt_get_property_by_offset(fdt, offset, &length);
+                if(!property)
+                    return length;
+
+                name = fdt_string(fdt, fdt32_to_cpu(property->nameoff));
+                edit = final_property_edit(journal, firsts[depth], counts[depth], name);
+
+                // Replace edited properties in place, and drop deleted ones.
+                rc = SUCCESS;
+                if(!edit)
+                    rc = fdt_property(buf, name, property->data, length);
+                else if(edit->op == FDT_JOURNAL_SETPROP)
+                    rc = fdt_property(buf, name, edit->value, edit->length);
+
+                if(rc)
+                    return rc;
+                break;
+            }
+
+            case FDT_END_NODE:
+                if(depth < 0)
+                    return -FDT_ERR_BADSTRUCTURE;
+
+                if(skip_depth >= 0) {
+                    if(skip_depth == depth)
+                        skip_depth = -1;
+                    --depth;
+                    break;
+                }
+
+                // Add any new properties and subnodes before closing the node.
+                rc = SUCCESS;
+                if(!properties_done[depth])
+                    rc = emit_new_properties(journal, buf, nodes[depth], firsts[depth], counts[depth]);
+                if(!rc)
+                    rc = emit_new_subnodes(journal, buf, firsts[depth], counts[depth], depth + 1);
+                if(!rc)
+                    rc = fdt_end_node(buf);
+                if(rc)
+                    return rc;
+
+                --depth;
+                break;
+
+            case FDT_NOP:
+                break;
+
+            case FDT_END:
+                // libfdt reports a truncated or corrupt structure block as
+                // an early FDT_END; don't pass that off as a complete tree.
+                if(next_offset < 0)
+                    return next_offset;
+                break;
+
+            default:
+                return next_offset < 0 ? next_offset : -FDT_ERR_BADSTRUCTURE;
+        }
+
+        offset = next_offset;
+    } while(tag != FDT_END);
+
+    rc = fdt_finish(buf);
+    if(rc)
+        return rc;
+
+    fdt_set_boot_cpuid_phys(buf, fdt_boot_cpuid_phys(fdt));
+    return SUCCESS;
+}
@@ -0,0 +1,383 @@
+/**
+ * Flattened Image Tree (FIT) parser for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <fit.h>
+
+/**
+ * The nodes of interest in a FIT, as found by a single walk of the tree.
+ */
+struct fit_nodes {
+    int images[FIT_MAX_IMAGES];
+    int image_count;
+
+    int configurations_node;
+    int configurations[FIT_MAX_CONFIGURATIONS];
+    int configuration_count;
+};
+
+/**
+ * The sections of a FIT whose children we record.
+ */
+enum fit_section {
+    FIT_SECTION_OTHER,
+    FIT_SECTION_IMAGES,
+    FIT_SECTION_CONFIGURATIONS,
+};
+
+/**
+ * The configuration property that selects each subimage type.
+ */
+static const char *const subimage_properties[FIT_SUBIMAGE_TYPES] = {
+    [FIT_KERNEL]  = "kernel",
+    [FIT_FDT]     = "fdt",
+    [FIT_RAMDISK] = "ramdisk",
+};
+
+
+/**
+ * @return True iff the given node's name (including any unit address) is name.
+ */
+static int node_name_is(const void *fit, int node, const char *name)
+{
+    int length;
+    const char *node_name = fdt_get_name(fit, node, &length);
+
+    return node_name && (length == strlen(name)) && !memcmp(node_name, name, length);
+}
+
+
+/**
+ * Walks the FIT once, recording each image and configuration node.
+ *
+ * @return SUCCESS, or an FDT error code.
+ */
+static int fit_find_nodes(const void *fit, struct fit_nodes *nodes)
+{
+    enum fit_section section = FIT_SECTION_OTHER;
+    int offset = 0, depth = 0;
+
+    nodes->image_count = 0;
+    nodes->configuration_count = 0;
+    nodes->configurations_node = -FDT_ERR_NOTFOUND;
+
+    while(1) {
+        offset = fdt_next_node(fit, offset, &depth);
+
+        // Leaving the root node ends the walk.
+        if((offset < 0) || (depth < 0))
+            break;
+
+        // Top-level nodes tell us which section we're in...
+        if(depth == 1) {
+            if(node_name_is(fit, offset, "images")) {
+                section = FIT_SECTION_IMAGES;
+            } else if(node_name_is(fit, offset, "configurations")) {
+                section = FIT_SECTION_CONFIGURATIONS;
+                nodes->configurations_node = offset;
+            } else {
+                section = FIT_SECTION_OTHER;
+            }
+        }
+
+        // ... and their children are the images and configurations themselves.
+        if(depth != 2)
+            continue;
+
+        if(section == FIT_SECTION_IMAGES && nodes->image_count < FIT_MAX_IMAGES)
+            nodes->images[nodes->image_count++] = offset;
+        else if(section == FIT_SECTION_CONFIGURATIONS && nodes->configuration_count < FIT_MAX_CONFIGURATIONS)
+            nodes->configurations[nodes->configuration_count++] = offset;
+    }
+
+    if((offset < 0) && (offset != -FDT_ERR_NOTFOUND))
+        return offset;
+
+    return nodes->configuration_count ? SUCCESS : -FDT_ERR_NOTFOUND;
+}
+
+
+/**
+ * Finds the node in the given list with the given name.
+ *
+ * @return The node's offset, or -FDT_ERR_NOTFOUND.
+ */
+static int find_named_node(const void *fit, const int *list, int count, const char *name)
+{
+    int i;
+
+    for(i = 0; i < count; ++i)
+        if(node_name_is(fit, list[i], name))
+            return list[i];
+
+    return -FDT_ERR_NOTFOUND;
+}
+
+
+/**
+ * Reads a single-cell integer property.
+ *
+ * @return SUCCESS, or an FDT error code.
+ */
+static int read_u32_property(const void *fit, int node, const char *name, uint32_t *out_value)
+{
+    int length;
+    const fdt32_t *value = fdt_getprop(fit, node, name, &length);
+
+    if(!value)
+        return length;
+    if(length != sizeof(*value))
+        return -FDT_ERR_BADVALUE;
+
+    *out_value = fdt32_to_cpu(*value);
+    return SUCCESS;
+}
+
+
+/**
+ * Finds the SHA-256 digest among a subimage's hash nodes (named hash-1,
+ * hash@1, and so on), if it has one.
+ *
+ * @return The expected digest, or NULL if there isn't one.
+ */
+static const uint8_t *fit_find_sha256(const void *fit, int node)
+{
+    int hash, length;
+
+    for(hash = fdt_first_subnode(fit, node); hash >= 0; hash = fdt_next_subnode(fit, hash)) {
+        const char *name = fdt_get_name(fit, hash, &length);
+        const char *algorithm;
+        const uint8_t *value;
+
+        if(!name || (length < 4) || memcmp(name, "hash", 4))
+            continue;
+
+        algorithm = fdt_getprop(fit, hash, "algo", &length);
+        if(!algorithm || (length != sizeof("sha256")) || memcmp(algorithm, "sha256", length))
+            continue;
+
+        value = fdt_getprop(fit, hash, "value", &length);
+        if(value && (length == FIT_SHA256_BYTES))
+            return value;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Locates a subimage's data. The data can be embedded in the FIT's data
+ * property, or stored after the FIT's structure (as by 'mkimage -E'), in
+ * which case it's described by data-size and data-offset or data-position.
+ *
+ * @param sub The subimage to be populated. Its node must already be set.
+ * @return SUCCESS, or an FDT error code.
+ */
+static int fit_read_subimage(const void *fit, size_t fit_size, struct fit_subimage *sub)
+{
+    const char *fit_raw = fit;
+    uint32_t size, position;
+    int length, rc;
+
+    sub->data = fdt_getprop(fit, sub->node, "data", &length);
+    if(sub->data) {
+        sub->size = length;
+    } else {
+        rc = read_u32_property(fit, sub->node, "data-size", &size);
+        if(rc)
+            return rc;
+
+        // Positions are relative to the start of the FIT; offsets are relative
+        // to the (4-byte aligned) end of its structure.
+        if(read_u32_property(fit, sub->node, "data-position", &position) == SUCCESS)
+            sub->data = fit_raw + position;
+        else if(read_u32_property(fit, sub->node, "data-offset", &position) == SUCCESS)
+            sub->data = fit_raw + ((fdt_totalsize(fit) + 3) & ~3) + position;
+        else
+            return -FDT_ERR_NOTFOUND;
+
+        sub->size = size;
+
+        if(((const char *)sub->data < fit_raw) || ((const char *)sub->data + size > fit_raw + fit_size))
+            return -FDT_ERR_TRUNCATED;
+    }
+
+    sub->compression = fdt_getprop(fit, sub->node, "compression", &length);
+    if(sub->compression && (length == sizeof("none")) && !memcmp(sub->compression, "none", length))
+        sub->compression = NULL;
+
+    sub->sha256 = fit_find_sha256(fit, sub->node);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Finds the subimage of the given type that a configuration selects.
+ *
+ * @param sub Out argument; receives the relevant subimage. Its node is
+ *    negative if the configuration doesn't select one.
+ * @return SUCCESS, or an FDT error code. A configuration not selecting a
+ *    subimage isn't an error; but a configuration selecting a missing one is.
+ */
+static int fit_find_subimage(const void *fit, size_t fit_size, const struct fit_nodes *nodes,
+    int configuration, enum fit_subimage_type type, struct fit_subimage *sub)
+{
+    // For FDTs, this can be a list of a base tree and its overlays; we only
+    // use the base tree.
+    sub->name = fdt_getprop(fit, configuration, subimage_properties[type], NULL);
+    sub->data = NULL;
+    sub->size = 0;
+    sub->compression = NULL;
+    sub->sha256 = NULL;
+
+    if(!sub->name) {
+        sub->node = -FDT_ERR_NOTFOUND;
+        return SUCCESS;
+    }
+
+    sub->node = find_named_node(fit, nodes->images, nodes->image_count, sub->name);
+    if(sub->node < 0)
+        return sub->node;
+
+    return fit_read_subimage(fit, fit_size, sub);
+}
+
+
+/**
+ * Scores how well a configuration matches the board.
+ *
+ * @return The index of the first of the board's compatible strings that
+ *    the configuration matches, or -1 if it matches none of them.
+ */
+static int fit_score_configuration(const void *fit, size_t fit_size, const struct fit_nodes *nodes,
+    int configuration, const char *board_compatible, int board_compatible_length)
+{
+    const char *compatible, *fdt_compatible = NULL;
+    const char *board_string = board_compatible;
+    int length, fdt_compatible_length = 0;
+    struct fit_subimage fdt;
+    int i;
+
+    compatible = fdt_getprop(fit, configuration, "compatible", &length);
+
+    // Without a compatible of its own, a configuration is identified by its FDT.
+    if(!compatible && (fit_find_subimage(fit, fit_size, nodes, configuration, FIT_FDT, &fdt) == SUCCESS) &&
+       (fdt.node >= 0) && !fdt.compression && !fdt_check_header(fdt.data) &&
+       (fdt_totalsize(fdt.data) <= fdt.size))
+        fdt_compatible = fdt_getprop(fdt.data, 0, "compatible", &fdt_compatible_length);
+
+    if(!compatible) {
+        compatible = fdt_compatible;
+        length = fdt_compatible_length;
+    }
+
+    if(!compatible)
+        return -1;
+
+    for(i = 0; board_string < board_compatible + board_compatible_length; ++i) {
+        if(fdt_stringlist_contains(compatible, length, board_string))
+            return i;
+
+        board_string += strlen(board_string) + 1;
+    }
+
+    return -1;
+}
+
+
+/**
+ * @return True iff the given (accessible) image appears to be a FIT.
+ */
+int fit_is_fit(const void *image)
+{
+    if(fdt_check_header(image))
+        return false;
+
+    return fdt_subnode_offset(image, 0, "images") >= 0;
+}
+
+
+/**
+ * Selects a configuration from a FIT, and locates each of its subimages.
+ */
+int fit_select_configuration(const void *fit, size_t fit_size, const char *board_compatible,
+    int board_compatible_length, struct fit_configuration *config)
+{
+    struct fit_nodes nodes;
+    int best_score = -1;
+    int i, rc;
+
+    if(fdt_check_header(fit))
+        return -FDT_ERR_BADMAGIC;
+    if(fdt_totalsize(fit) > fit_size)
+        return -FDT_ERR_TRUNCATED;
+
+    rc = fit_find_nodes(fit, &nodes);
+    if(rc)
+        return rc;
+
+    config->fit = fit;
+    config->node = -FDT_ERR_NOTFOUND;
+
+    // Prefer the configuration that most specifically matches the board...
+    if(board_compatible) {
+        for(i = 0; i < nodes.configuration_count; ++i) {
+            int score = fit_score_configuration(fit, fit_size, &nodes, nodes.configurations[i],
+                board_compatible, board_compatible_length);
+
+            if((score >= 0) && ((best_score < 0) || (score < best_score))) {
+                best_score = score;
+                config->node = nodes.configurations[i];
+            }
+        }
+    }
+
+    // ... falling back to the default, or failing that, the first.
+    if(config->node < 0) {
+        const char *default_name = fdt_getprop(fit, nodes.configurations_node, "default", NULL);
+
+        if(default_name)
+            config->node = find_named_node(fit, nodes.configurations, nodes.configuration_count, default_name);
+        else
+            config->node = nodes.configurations[0];
+
+        if(config->node < 0)
+            return config->node;
+    }
+
+    config->name = fdt_get_name(fit, config->node, NULL);
+
+    for(i = 0; i < FIT_SUBIMAGE_TYPES; ++i) {
+        rc = fit_find_subimage(fit, fit_size, &nodes, config->node, i, &config->subimages[i]);
+        if(rc)
+            return rc;
+    }
+
+    // Every configuration we can boot needs a kernel.
+    return (config->subimages[FIT_KERNEL].node >= 0) ? SUCCESS : -FDT_ERR_NOTFOUND;
+}
@@ -0,0 +1,700 @@
+/**
+ * Freestanding gzip/DEFLATE decompressor for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <inflate.h>
+
+/**
+ * Limits imposed by the DEFLATE format.
+ */
+#define MAX_CODE_BITS       15
+#define MAX_LITERAL_CODES   288
+#define MAX_DISTANCE_CODES  30
+#define MAX_LENGTH_CODES    19
+
+/**
+ * Codes no longer than this are decoded with a single table lookup; longer
+ * ones fall back to a canonical, bit-at-a-time decode.
+ */
+#define FAST_BITS           10
+#define FAST_MASK           ((1 << FAST_BITS) - 1)
+
+/**
+ * gzip header fields.
+ */
+#define GZIP_MAGIC_0        0x1f
+#define GZIP_MAGIC_1        0x8b
+#define GZIP_METHOD_DEFLATE 8
+#define GZIP_FLAG_HCRC      (1 << 1)
+#define GZIP_FLAG_EXTRA     (1 << 2)
+#define GZIP_FLAG_NAME      (1 << 3)
+#define GZIP_FLAG_COMMENT   (1 << 4)
+#define GZIP_HEADER_BYTES   10
+#define GZIP_TRAILER_BYTES  8
+
+/**
+ * A Huffman code, in a form we can decode quickly.
+ */
+struct huffman {
+    // Indexed by the next FAST_BITS bits of input: (symbol << 4) | length,
+    // or zero if the code is longer than FAST_BITS.
+    uint16_t fast[1 << FAST_BITS];
+
+    // The canonical description of the code: the number of codes of each
+    // length, and the symbols in code order.
+    uint16_t count[MAX_CODE_BITS + 1];
+    uint16_t symbol[MAX_LITERAL_CODES];
+};
+
+/**
+ * The state of a single decompression.
+ */
+struct inflate_state {
+    const uint8_t *in;
+    const uint8_t *in_end;
+
+    // Bits we've read, but not yet consumed, least significant first.
+    uint64_t bits;
+    unsigned int bit_count;
+
+    // Zero bits we've added to the buffer past the end of the input, so
+    // lookups near the end never need to check for more input.
+    unsigned int padding;
+
+    uint8_t *out_start;
+    uint8_t *out;
+    uint8_t *out_end;
+
+    // If set, filling the output stops decompression, rather than failing it.
+    int stop_when_full;
+
+    int error;
+};
+
+/**
+ * Our decoding tables. These are far too large to put on our small stack, and
+ * we don't have a heap, so they're static; the stub only ever decompresses
+ * one thing at a time.
+ */
+static struct huffman literal_code, distance_code;
+static struct huffman fixed_literal_code, fixed_distance_code;
+static int fixed_codes_built;
+static struct inflate_state state;
+
+/**
+ * Base values and extra bits for each length and distance code.
+ */
+static const uint16_t length_base[] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t length_extra[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distance_base[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+static const uint8_t distance_extra[] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/**
+ * The order in which code length code lengths are stored in a dynamic block.
+ */
+static const uint8_t code_length_order[MAX_LENGTH_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+/**
+ * Tops up our bit buffer, so at least 57 bits are available. Past the end
+ * of the input, we add zeroes, and note that we've done so.
+ */
+static inline void refill(struct inflate_state *s)
+{
+    while(s->bit_count <= 56) {
+        if(s->in < s->in_end)
+            s->bits |= (uint64_t)*s->in++ << s->bit_count;
+        else
+            s->padding += 8;
+
+        s->bit_count += 8;
+    }
+}
+
+
+/**
+ * Discards the given number of bits from the bit buffer, noting if we've
+ * run past the end of the real input.
+ */
+static inline void consume(struct inflate_state *s, unsigned int count)
+{
+    s->bits >>= count;
+    s->bit_count -= count;
+
+    if(s->bit_count < s->padding)
+        s->error = -FDT_ERR_TRUNCATED;
+}
+
+
+/**
+ * Reads up to 32 bits from the input.
+ */
+static inline uint32_t get_bits(struct inflate_state *s, unsigned int count)
+{
+    uint32_t value;
+
+    refill(s);
+    value = s->bits & ((1ULL << count) - 1);
+    consume(s, count);
+
+    return value;
+}
+
+
+/**
+ * Reverses the order of the low count bits of the given code. DEFLATE
+ * packs Huffman codes most significant bit first, in an otherwise least
+ * significant bit first stream.
+ */
+static inline unsigned int reverse_bits(unsigned int code, unsigned int count)
+{
+    unsigned int reversed = 0;
+
+    while(count--) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+
+    return reversed;
+}
+
+
+/**
+ * Builds a Huffman code from the length of each symbol's code.
+ *
+ * @return SUCCESS, or -FDT_ERR_BADVALUE if the lengths over-subscribe the code.
+ */
+static int build_huffman(struct huffman *h, const uint8_t *lengths, int symbol_count)
+{
+    uint16_t offsets[MAX_CODE_BITS + 1], next_code[MAX_CODE_BITS + 1];
+    int symbol, length, left = 1;
+    unsigned int code = 0;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+
+    for(symbol = 0; symbol < symbol_count; ++symbol)
+        ++h->count[lengths[symbol]];
+
+    // Unused symbols don't take up any codes.
+    h->count[0] = 0;
+
+    // Make sure we haven't been given more codes than there are bit patterns.
+    // Incomplete codes are fine; DEFLATE uses them e.g. for a single distance.
+    for(length = 1; length <= MAX_CODE_BITS; ++length) {
+        left = (left << 1) - h->count[length];
+        if(left < 0)
+            return -FDT_ERR_BADVALUE;
+    }
+
+    // Sort the symbols into code order, and find the first code of each length...
+    offsets[1] = 0;
+    next_code[1] = 0;
+    for(length = 1; length < MAX_CODE_BITS; ++length) {
+        offsets[length + 1] = offsets[length] + h->count[length];
+        code = (code + h->count[length]) << 1;
+        next_code[length + 1] = code;
+    }
+
+    for(symbol = 0; symbol < symbol_count; ++symbol)
+        if(lengths[symbol])
+            h->symbol[offsets[lengths[symbol]]++] = symbol;
+
+    // ... and fill in the fast table for each short code. Each code covers
+    // every table index whose low bits match it.
+    for(symbol = 0; symbol < symbol_count; ++symbol) {
+        unsigned int index;
+
+        length = lengths[symbol];
+        if(!length)
+            continue;
+
+        code = next_code[length]++;
+        if(length > FAST_BITS)
+            continue;
+
+        for(index = reverse_bits(code, length); index < (1 << FAST_BITS); index += (1 << length))
+            h->fast[index] = (symbol << 4) | length;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Decodes a single symbol from the input.
+ *
+ * @return The decoded symbol, or a negative error code.
+ */
+static int decode_symbol(struct inflate_state *s, const struct huffman *h)
+{
+    int code = 0, first = 0, index = 0, length;
+    uint16_t entry;
+
+    refill(s);
+
+    // Most codes are short, and can be decoded at once...
+    entry = h->fast[s->bits & FAST_MASK];
+    if(entry) {
+        consume(s, entry & 0xf);
+        return entry >> 4;
+    }
+
+    // ... but longer codes have to be found a bit at a time.
+    for(length = 1; length <= MAX_CODE_BITS; ++length) {
+        int count = h->count[length];
+
+        code |= s->bits & 1;
+        consume(s, 1);
+
+        if(code - count < first)
+            return h->symbol[index + (code - first)];
+
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+
+    return -FDT_ERR_BADVALUE;
+}
+
+
+/**
+ * Handles a stored (uncompressed) block.
+ */
+static int inflate_stored(struct inflate_state *s)
+{
+    unsigned int length, complement, buffered;
+
+    // Stored blocks start on a byte boundary. Hand back any whole bytes we've
+    // buffered, so we can copy straight from the input.
+    consume(s, s->bit_count & 7);
+    if(s->error)
+        return s->error;
+
+    buffered = (s->bit_count - s->padding) / 8;
+    s->in -= buffered;
+    s->bits = 0;
+    s->bit_count = 0;
+    s->padding = 0;
+
+    if(s->in_end - s->in < 4)
+        return -FDT_ERR_TRUNCATED;
+
+    length = s->in[0] | (s->in[1] << 8);
+    complement = s->in[2] | (s->in[3] << 8);
+    s->in += 4;
+
+    if(length != (~complement & 0xffff))
+        return -FDT_ERR_BADVALUE;
+
+    if(s->in_end - s->in < length)
+        return -FDT_ERR_TRUNCATED;
+
+    if(s->out_end - s->out < length) {
+        if(!s->stop_when_full)
+            return -FDT_ERR_NOSPACE;
+
+        length = s->out_end - s->out;
+    }
+
+    memcpy(s->out, s->in, length);
+    s->out += length;
+    s->in += length;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Decodes the body of a compressed block, using the given codes.
+ */
+static int inflate_codes(struct inflate_state *s, const struct huffman *literals,
+    const struct huffman *distances)
+{
+    int symbol;
+
+    while(1) {
+        unsigned int length, distance;
+
+        symbol = decode_symbol(s, literals);
+        if(symbol < 0)
+            return symbol;
+        if(s->error)
+            return s->error;
+
+        // Literal byte.
+        if(symbol < 256) {
+            if(s->out == s->out_end)
+                return s->stop_when_full ? SUCCESS : -FDT_ERR_NOSPACE;
+
+            *s->out++ = symbol;
+            continue;
+        }
+
+        // End of block.
+        if(symbol == 256)
+            return SUCCESS;
+
+        // Otherwise, we have a length/distance pair: a copy of earlier output.
+        symbol -= 257;
+        if(symbol >= sizeof(length_base) / sizeof(*length_base))
+            return -FDT_ERR_BADVALUE;
+
+        length = length_base[symbol] + get_bits(s, length_extra[symbol]);
+
+        symbol = decode_symbol(s, distances);
+        if(symbol < 0)
+            return symbol;
+        if(symbol >= MAX_DISTANCE_CODES)
+            return -FDT_ERR_BADVALUE;
+
+        distance = distance_base[symbol] + get_bits(s, distance_extra[symbol]);
+        if(s->error)
+            return s->error;
+
+        if(distance > s->out - s->out_start)
+            return -FDT_ERR_BADVALUE;
+
+        if(s->out_end - s->out < length) {
+            if(!s->stop_when_full)
+                return -FDT_ERR_NOSPACE;
+
+            length = s->out_end - s->out;
+        }
+
+        // Copies can overlap their own output (e.g. a run of one byte),
+        // so they have to go a byte at a time.
+        while(length--) {
+            *s->out = *(s->out - distance);
+            ++s->out;
+        }
+
+        if(s->stop_when_full && s->out == s->out_end)
+            return SUCCESS;
+    }
+}
+
+
+/**
+ * Builds the fixed codes used by fixed-Huffman blocks, if we haven't already.
+ */
+static void build_fixed_codes(void)
+{
+    uint8_t lengths[MAX_LITERAL_CODES];
+    int symbol;
+
+    if(fixed_codes_built)
+        return;
+
+    for(symbol = 0; symbol < 144; ++symbol)
+        lengths[symbol] = 8;
+    for(; symbol < 256; ++symbol)
+        lengths[symbol] = 9;
+    for(; symbol < 280; ++symbol)
+        lengths[symbol] = 7;
+    for(; symbol < MAX_LITERAL_CODES; ++symbol)
+        lengths[symbol] = 8;
+    build_huffman(&fixed_literal_code, lengths, MAX_LITERAL_CODES);
+
+    for(symbol = 0; symbol < MAX_DISTANCE_CODES; ++symbol)
+        lengths[symbol] = 5;
+    build_huffman(&fixed_distance_code, lengths, MAX_DISTANCE_CODES);
+
+    fixed_codes_built = true;
+}
+
+
+/**
+ * Reads the codes for a dynamic-Huffman block, and then decodes the block.
+ */
+static int inflate_dynamic(struct inflate_state *s)
+{
+    uint8_t lengths[MAX_LITERAL_CODES + MAX_DISTANCE_CODES];
+    unsigned int literal_count, distance_count, length_count, index;
+    int rc;
+
+    literal_count = get_bits(s, 5) + 257;
+    distance_count = get_bits(s, 5) + 1;
+    length_count = get_bits(s, 4) + 4;
+
+    if(literal_count > MAX_LITERAL_CODES || distance_count > MAX_DISTANCE_CODES)
+        return -FDT_ERR_BADVALUE;
+
+    // First, read the code used to compress the other two codes' lengths...
+    for(index = 0; index < MAX_LENGTH_CODES; ++index)
+        lengths[code_length_order[index]] = (index < length_count) ? get_bits(s, 3) : 0;
+
+    rc = build_huffman(&literal_code, lengths, MAX_LENGTH_CODES);
+    if(rc)
+        return rc;
+
+    // ... and then use it to read the lengths of the literal/length and distance codes.
+    for(index = 0; index < literal_count + distance_count;) {
+        int symbol = decode_symbol(s, &literal_code);
+        unsigned int repeat;
+        uint8_t value = 0;
+
+        if(symbol < 0)
+            return symbol;
+        if(s->error)
+            return s->error;
+
+        if(symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+
+        // Repeat the previous length, or a run of zeroes.
+        if(symbol == 16) {
+            if(!index)
+                return -FDT_ERR_BADVALUE;
+
+            value = lengths[index - 1];
+            repeat = 3 + get_bits(s, 2);
+        } else if(symbol == 17) {
+            repeat = 3 + get_bits(s, 3);
+        } else {
+            repeat = 11 + get_bits(s, 7);
+        }
+
+        if(index + repeat > literal_count + distance_count)
+            return -FDT_ERR_BADVALUE;
+
+        while(repeat--)
+            lengths[index++] = value;
+    }
+
+    // A block with no end-of-block code could never end.
+    if(!lengths[256])
+        return -FDT_ERR_BADVALUE;
+
+    rc = build_huffman(&literal_code, lengths, literal_count);
+    if(!rc)
+        rc = build_huffman(&distance_code, lengths + literal_count, distance_count);
+    if(rc)
+        return rc;
+
+    return inflate_codes(s, &literal_code, &distance_code);
+}
+
+
+/**
+ * Decompresses a raw DEFLATE stream.
+ */
+static int inflate_blocks(struct inflate_state *s)
+{
+    int last, rc;
+
+    do {
+        last = get_bits(s, 1);
+
+        switch(get_bits(s, 2)) {
+            case 0:
+                rc = inflate_stored(s);
+                break;
+            case 1:
+                build_fixed_codes();
+                rc = inflate_codes(s, &fixed_literal_code, &fixed_distance_code);
+                break;
+            case 2:
+                rc = inflate_dynamic(s);
+                break;
+            default:
+                rc = -FDT_ERR_BADVALUE;
+                break;
+        }
+
+        if(!rc)
+            rc = s->error;
+        if(rc)
+            return rc;
+
+        if(s->stop_when_full && s->out == s->out_end)
+            return SUCCESS;
+
+    } while(!last);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Returns true iff the given buffer appears to hold a gzip stream.
+ */
+int gunzip_is_gzip(const void *src, size_t src_size)
+{
+    const uint8_t *in = src;
+
+    return (src_size >= GZIP_HEADER_BYTES + GZIP_TRAILER_BYTES) &&
+        (in[0] == GZIP_MAGIC_0) && (in[1] == GZIP_MAGIC_1) && (in[2] == GZIP_METHOD_DEFLATE);
+}
+
+
+/**
+ * Returns the size of a gzip stream's contents, as recorded in its trailer.
+ */
+size_t gunzip_uncompressed_size(const void *src, size_t src_size)
+{
+    const uint8_t *trailer = (const uint8_t *)src + src_size - 4;
+
+    if(src_size < GZIP_HEADER_BYTES + GZIP_TRAILER_BYTES)
+        return 0;
+
+    return trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+}
+
+
+/**
+ * Skips a gzip header.
+ *
+ * @return A pointer to the DEFLATE stream it precedes, or NULL if the header
+ *    is invalid.
+ */
+static const uint8_t *skip_gzip_header(const uint8_t *in, const uint8_t *end)
+{
+    uint8_t flags = in[3];
+
+    in += GZIP_HEADER_BYTES;
+
+    if(flags & GZIP_FLAG_EXTRA) {
+        size_t extra_length;
+
+        if(end - in < 2)
+            return NULL;
+
+        extra_length = in[0] | (in[1] << 8);
+        in += 2;
+
+        if(extra_length > (size_t)(end - in))
+            return NULL;
+        in += extra_length;
+    }
+
+    // The file name and comment are each NUL-terminated.
+    if(flags & GZIP_FLAG_NAME) {
+        in = memchr(in, '\0', end - in);
+        if(!in)
+            return NULL;
+        ++in;
+    }
+    if(flags & GZIP_FLAG_COMMENT) {
+        in = memchr(in, '\0', end - in);
+        if(!in)
+            return NULL;
+        ++in;
+    }
+
+    if(flags & GZIP_FLAG_HCRC) {
+        if(end - in < 2)
+            return NULL;
+        in += 2;
+    }
+
+    return (in < end) ? in : NULL;
+}
+
+
+/**
+ * Sets up our state, and decompresses the given gzip stream.
+ */
+static int gunzip_into(void *dest, size_t dest_size, const void *src, size_t src_size,
+    int stop_when_full, size_t *out_length)
+{
+    const uint8_t *in = src, *end = in + src_size;
+    int rc;
+
+    if(!gunzip_is_gzip(src, src_size))
+        return -FDT_ERR_BADMAGIC;
+
+    in = skip_gzip_header(in, end);
+    if(!in)
+        return -FDT_ERR_TRUNCATED;
+
+    memset(&state, 0, sizeof(state));
+    state.in = in;
+    state.in_end = end;
+    state.out_start = state.out = dest;
+    state.out_end = state.out + dest_size;
+    state.stop_when_full = stop_when_full;
+
+    rc = inflate_blocks(&state);
+
+    if(out_length)
+        *out_length = state.out - state.out_start;
+
+    return rc;
+}
+
+
+/**
+ * Decompresses a gzip stream into the given buffer.
+ */
+int gunzip(void *dest, size_t dest_size, const void *src, size_t src_size, size_t *out_length)
+{
+    size_t length;
+    int rc;
+
+    rc = gunzip_into(dest, dest_size, src, src_size, false, &length);
+    if(out_length)
+        *out_length = length;
+    if(rc)
+        return rc;
+
+    // The trailer records the size of the contents, which makes for a cheap
+    // sanity check. (It also has a CRC32, which we don't spend time on.)
+    if((uint32_t)length != (uint32_t)gunzip_uncompressed_size(src, src_size))
+        return -FDT_ERR_BADVALUE;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Decompresses only the start of a gzip stream.
+ */
+int gunzip_prefix(void *dest, size_t length, const void *src, size_t src_size)
+{
+    size_t produced;
+    int rc;
+
+    rc = gunzip_into(dest, length, src, src_size, true, &produced);
+    if(rc)
+        return rc;
+
+    return (produced == length) ? SUCCESS : -FDT_ERR_TRUNCATED;
+}
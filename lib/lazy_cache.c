@@ -0,0 +1,178 @@
+/**
+ * On-demand cache invalidation for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <arena.h>
+#include <cache.h>
+#include <lazy_cache.h>
+
+#define BITS_PER_WORD (64)
+
+
+/**
+ * Marks the given line as invalidated.
+ *
+ * @return True iff the line had not yet been invalidated.
+ */
+static inline int claim_line(struct lazy_cache *cache, size_t line)
+{
+    uint64_t mask = 1ULL << (line % BITS_PER_WORD);
+    uint64_t *word = &cache->bitmap[line / BITS_PER_WORD];
+
+    if(*word & mask)
+        return false;
+
+    *word |= mask;
+    return true;
+}
+
+
+/**
+ * Starts tracking a region, none of which has been invalidated yet.
+ *
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int lazy_cache_init(struct lazy_cache *cache, const void *base, size_t length)
+{
+    size_t lines, words;
+
+    cache->line_bytes = __dcache_line_bytes();
+
+    // Track whole lines, starting from the one that contains the region's start.
+    cache->base = (uintptr_t)base & ~(cache->line_bytes - 1);
+    cache->length = length + ((uintptr_t)base - cache->base);
+
+    lines = (cache->length + cache->line_bytes - 1) / cache->line_bytes;
+    words = (lines + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+    cache->bitmap = arena_alloc(words * sizeof(*cache->bitmap));
+    if(!cache->bitmap)
+        return -FDT_ERR_NOSPACE;
+
+    memset(cache->bitmap, 0, words * sizeof(*cache->bitmap));
+    return SUCCESS;
+}
+
+
+/**
+ * Invalidates any lines in the given range that haven't been invalidated
+ * yet. Should be called before the range is read. Does nothing if cache is
+ * NULL, so callers can use the same code whether or not they're being lazy.
+ */
+void lazy_cache_touch(struct lazy_cache *cache, const void *addr, size_t length)
+{
+    uintptr_t start = (uintptr_t)addr, end = start + length;
+    size_t line, last;
+
+    if(!cache || !cache->bitmap || !length)
+        return;
+
+    // Only lines inside the tracked region are our concern.
+    if(start < cache->base)
+        start = cache->base;
+    if(end > cache->base + cache->length)
+        end = cache->base + cache->length;
+    if(start >= end)
+        return;
+
+    last = (end - 1 - cache->base) / cache->line_bytes;
+    line = (start - cache->base) / cache->line_bytes;
+
+    // Invalidate each run of unclaimed lines with a single range operation,
+    // so we only wait on the cache once per run.
+    while(line <= last) {
+        size_t run_start;
+
+        if(!claim_line(cache, line)) {
+            ++line;
+            continue;
+        }
+
+        for(run_start = line++; line <= last && claim_line(cache, line); ++line);
+        __clean_invalidate_dcache_region((const void *)(cache->base + run_start * cache->line_bytes),
+            (line - run_start) * cache->line_bytes);
+    }
+}
+
+
+/**
+ * Invalidates lines starting at the given string, until the string's
+ * terminator has been made visible.
+ */
+void lazy_cache_touch_string(struct lazy_cache *cache, const char *string)
+{
+    uintptr_t end = cache ? cache->base + cache->length : 0;
+
+    if(!cache || !cache->bitmap)
+        return;
+
+    // Make each line visible before we scan it for the terminator.
+    while((uintptr_t)string < end) {
+        size_t remaining = cache->line_bytes - (((uintptr_t)string - cache->base) % cache->line_bytes);
+
+        lazy_cache_touch(cache, string, 1);
+        if(memchr(string, '\0', remaining))
+            return;
+
+        string += remaining;
+    }
+}
+
+
+/**
+ * Invalidates every line that hasn't been touched yet, in as few calls to
+ * the given operation as possible.
+ *
+ * @param op The operation used to invalidate each run of lines, or NULL to
+ *    use __clean_invalidate_dcache_region.
+ */
+void lazy_cache_finish(struct lazy_cache *cache, lazy_cache_region_op op)
+{
+    size_t line, lines, run_start;
+
+    if(!cache->bitmap)
+        return;
+
+    if(!op)
+        op = __clean_invalidate_dcache_region;
+
+    lines = (cache->length + cache->line_bytes - 1) / cache->line_bytes;
+
+    for(line = 0; line < lines;) {
+
+        // Skip over lines we've already invalidated.
+        if(!claim_line(cache, line)) {
+            ++line;
+            continue;
+        }
+
+        // Gather up the rest of this run of untouched lines, and invalidate them at once.
+        for(run_start = line++; line < lines && claim_line(cache, line); ++line);
+        op((const void *)(cache->base + run_start * cache->line_bytes), (line - run_start) * cache->line_bytes);
+    }
+}
@@ -0,0 +1,498 @@
+/**
+ * Freestanding LZ4 decompressor for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <lz4.h>
+
+/**
+ * LZ4 frame format constants.
+ */
+#define LZ4_FRAME_MAGIC         0x184D2204
+#define LZ4_LEGACY_MAGIC        0x184C2102
+#define LZ4_SKIPPABLE_MASK      0xFFFFFFF0
+#define LZ4_SKIPPABLE_MAGIC     0x184D2A50
+
+#define LZ4_FLG_VERSION_MASK    0xC0
+#define LZ4_FLG_VERSION         0x40
+#define LZ4_FLG_BLOCK_CHECKSUM  (1 << 4)
+#define LZ4_FLG_CONTENT_SIZE    (1 << 3)
+#define LZ4_FLG_CONTENT_CHECKSUM (1 << 2)
+#define LZ4_FLG_DICT_ID         (1 << 0)
+
+#define LZ4_BLOCK_UNCOMPRESSED  0x80000000
+#define LZ4_MIN_MATCH           4
+
+/**
+ * Our copies move a word at a time where they can. We run with the MMU off,
+ * so everything is Device memory, where unaligned accesses fault; so we only
+ * use word accesses when the source and destination can both be aligned.
+ */
+typedef uint64_t __attribute__((may_alias)) word_t;
+#define WORD_BYTES              (sizeof(word_t))
+
+/**
+ * The state of a single decompression.
+ */
+struct lz4_state {
+    const uint8_t *in;
+    const uint8_t *in_end;
+
+    uint8_t *out_start;
+    uint8_t *out;
+    uint8_t *out_end;
+
+    // If set, filling the output stops decompression, rather than failing it.
+    int stop_when_full;
+};
+
+
+/**
+ * Reads a little-endian 32-bit value, a byte at a time.
+ */
+static inline uint32_t read_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/**
+ * Copies bytes forward, from the start of the source to its end. Unlike
+ * memmove, this is safe for LZ4 matches that overlap their own output,
+ * where each byte copied may be the source of a later one.
+ */
+static inline void copy_forward(uint8_t *dest, const uint8_t *src, size_t length)
+{
+    uint8_t *end = dest + length;
+
+    // Words can only be used if both sides can be aligned at once, and if
+    // each word we read was completely written before we read it.
+    if(((((uintptr_t)dest ^ (uintptr_t)src) & (WORD_BYTES - 1)) == 0) &&
+       ((dest <= src) || (dest - src >= WORD_BYTES))) {
+
+        while(dest < end && ((uintptr_t)dest & (WORD_BYTES - 1)))
+            *dest++ = *src++;
+
+        // Move two words per iteration where we can, so the compiler can pair
+        // up the loads and stores (LDP/STP). Both words are read before either
+        // is written, so this needs a little more distance from the source.
+        if((dest <= src) || (dest - src >= 2 * WORD_BYTES)) {
+            while(end - dest >= 2 * WORD_BYTES) {
+                word_t first = ((const word_t *)src)[0];
+                word_t second = ((const word_t *)src)[1];
+
+                ((word_t *)dest)[0] = first;
+                ((word_t *)dest)[1] = second;
+                dest += 2 * WORD_BYTES;
+                src += 2 * WORD_BYTES;
+            }
+        }
+
+        while(end - dest >= WORD_BYTES) {
+            *(word_t *)dest = *(const word_t *)src;
+            dest += WORD_BYTES;
+            src += WORD_BYTES;
+        }
+    }
+
+    while(dest < end)
+        *dest++ = *src++;
+}
+
+
+/**
+ * Reads an LZ4 length extension: a run of 255s, ending with a smaller byte,
+ * all of which are added to the length.
+ */
+static inline int read_length(struct lz4_state *s, size_t *length)
+{
+    uint8_t byte;
+
+    do {
+        if(s->in >= s->in_end)
+            return -FDT_ERR_TRUNCATED;
+
+        byte = *s->in++;
+        *length += byte;
+    } while(byte == 255);
+
+    return SUCCESS;
+}
+
+
+/**
+ * Makes room for the given number of bytes of output.
+ *
+ * @param length In/out argument. The number of bytes we'd like to write; on
+ *    return, the number we can.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the output is full and we're not
+ *    allowed to stop early.
+ */
+static inline int reserve_output(struct lz4_state *s, size_t *length)
+{
+    size_t available = s->out_end - s->out;
+
+    if(*length <= available)
+        return SUCCESS;
+
+    if(!s->stop_when_full)
+        return -FDT_ERR_NOSPACE;
+
+    *length = available;
+    return SUCCESS;
+}
+
+
+/**
+ * Decompresses a single compressed block, which ends at block_end.
+ */
+static int lz4_decompress_block(struct lz4_state *s, const uint8_t *block_end)
+{
+    const uint8_t *in_end = s->in_end;
+    int rc = SUCCESS;
+
+    // Everything in this block has to come from the block.
+    s->in_end = block_end;
+
+    while(s->in < s->in_end) {
+        size_t literal_length, match_length, wanted, offset;
+        uint8_t token = *s->in++;
+
+        // Each sequence starts with a run of literals...
+        literal_length = token >> 4;
+        if(literal_length == 15) {
+            rc = read_length(s, &literal_length);
+            if(rc)
+                break;
+        }
+
+        if(s->in_end - s->in < literal_length) {
+            rc = -FDT_ERR_TRUNCATED;
+            break;
+        }
+
+        wanted = literal_length;
+        rc = reserve_output(s, &literal_length);
+        if(rc)
+            break;
+
+        copy_forward(s->out, s->in, literal_length);
+        s->out += literal_length;
+        s->in += wanted;
+
+        if(s->out == s->out_end && s->stop_when_full)
+            break;
+
+        // ... and the last sequence of a block is only literals.
+        if(s->in == s->in_end)
+            break;
+
+        // Otherwise, it continues with a match: a copy of earlier output.
+        if(s->in_end - s->in < 2) {
+            rc = -FDT_ERR_TRUNCATED;
+            break;
+        }
+
+        offset = s->in[0] | (s->in[1] << 8);
+        s->in += 2;
+
+        if(!offset || offset > s->out - s->out_start) {
+            rc = -FDT_ERR_BADVALUE;
+            break;
+        }
+
+        match_length = token & 0xf;
+        if(match_length == 15) {
+            rc = read_length(s, &match_length);
+            if(rc)
+                break;
+        }
+        match_length += LZ4_MIN_MATCH;
+
+        rc = reserve_output(s, &match_length);
+        if(rc)
+            break;
+
+        copy_forward(s->out, s->out - offset, match_length);
+        s->out += match_length;
+
+        if(s->out == s->out_end && s->stop_when_full)
+            break;
+    }
+
+    s->in_end = in_end;
+    s->in = block_end;
+    return rc;
+}
+
+
+/**
+ * Handles a single block of either kind.
+ *
+ * @param compressed False if the block is stored uncompressed.
+ */
+static int lz4_handle_block(struct lz4_state *s, size_t block_size, int compressed)
+{
+    size_t length = block_size;
+    int rc;
+
+    if(s->in_end - s->in < block_size)
+        return -FDT_ERR_TRUNCATED;
+
+    if(compressed)
+        return lz4_decompress_block(s, s->in + block_size);
+
+    rc = reserve_output(s, &length);
+    if(rc)
+        return rc;
+
+    copy_forward(s->out, s->in, length);
+    s->out += length;
+    s->in += block_size;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Decompresses the blocks of a legacy stream, which runs until the input ends.
+ */
+static int lz4_decompress_legacy(struct lz4_state *s)
+{
+    while(s->in_end - s->in >= 4) {
+        uint32_t block_size = read_le32(s->in);
+        int rc;
+
+        // Legacy streams can be concatenated; each repeats the magic.
+        s->in += 4;
+        if(block_size == LZ4_LEGACY_MAGIC)
+            continue;
+
+        // Kbuild appends the uncompressed size to its legacy streams; like
+        // Linux's unlz4, we treat a final word with no block after it as the
+        // end of the stream.
+        if(s->in == s->in_end)
+            break;
+
+        rc = lz4_handle_block(s, block_size, true);
+        if(rc)
+            return rc;
+
+        if(s->stop_when_full && s->out == s->out_end)
+            return SUCCESS;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Decompresses the blocks of an LZ4 frame, whose header we've just read.
+ */
+static int lz4_decompress_frame(struct lz4_state *s, uint8_t flags)
+{
+    size_t checksum_bytes = (flags & LZ4_FLG_BLOCK_CHECKSUM) ? 4 : 0;
+
+    while(1) {
+        uint32_t block_size;
+        int rc;
+
+        if(s->in_end - s->in < 4)
+            return -FDT_ERR_TRUNCATED;
+
+        block_size = read_le32(s->in);
+        s->in += 4;
+
+        // A zero-sized block marks the end of the frame. We don't spend
+        // time on the optional checksums.
+        if(!block_size)
+            return SUCCESS;
+
+        rc = lz4_handle_block(s, block_size & ~LZ4_BLOCK_UNCOMPRESSED,
+            !(block_size & LZ4_BLOCK_UNCOMPRESSED));
+        if(rc)
+            return rc;
+
+        if(s->stop_when_full && s->out == s->out_end)
+            return SUCCESS;
+
+        if(s->in_end - s->in < checksum_bytes)
+            return -FDT_ERR_TRUNCATED;
+        s->in += checksum_bytes;
+    }
+}
+
+
+/**
+ * Reads an LZ4 frame header.
+ *
+ * @param flags Out argument; receives the frame's FLG byte.
+ * @param content_size Out argument; receives the frame's content size, or 0 if
+ *    it isn't recorded.
+ * @return A pointer to the frame's first block, or NULL if the header is invalid.
+ */
+static const uint8_t *lz4_read_frame_header(const uint8_t *in, const uint8_t *end,
+    uint8_t *flags, uint64_t *content_size)
+{
+    size_t header_bytes = 4 + 2 + 1;
+
+    if(end - in < header_bytes)
+        return NULL;
+
+    *flags = in[4];
+    *content_size = 0;
+
+    if((*flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION)
+        return NULL;
+
+    if(*flags & LZ4_FLG_CONTENT_SIZE)
+        header_bytes += 8;
+    if(*flags & LZ4_FLG_DICT_ID)
+        header_bytes += 4;
+
+    if(end - in < header_bytes)
+        return NULL;
+
+    if(*flags & LZ4_FLG_CONTENT_SIZE)
+        *content_size = read_le32(in + 6) | ((uint64_t)read_le32(in + 10) << 32);
+
+    // We don't support dictionaries; there's nowhere for one to come from.
+    if(*flags & LZ4_FLG_DICT_ID)
+        return NULL;
+
+    return in + header_bytes;
+}
+
+
+/**
+ * Returns true iff the given buffer appears to hold an LZ4 stream.
+ */
+int lz4_is_lz4(const void *src, size_t src_size)
+{
+    uint32_t magic;
+
+    if(src_size < 4)
+        return false;
+
+    magic = read_le32(src);
+    return (magic == LZ4_FRAME_MAGIC) || (magic == LZ4_LEGACY_MAGIC);
+}
+
+
+/**
+ * Returns the size of an LZ4 stream's contents, if the stream records it.
+ */
+size_t lz4_content_size(const void *src, size_t src_size)
+{
+    const uint8_t *in = src;
+    uint64_t content_size;
+    uint8_t flags;
+
+    if(!lz4_is_lz4(src, src_size) || read_le32(in) != LZ4_FRAME_MAGIC)
+        return 0;
+
+    if(!lz4_read_frame_header(in, in + src_size, &flags, &content_size))
+        return 0;
+
+    return content_size;
+}
+
+
+/**
+ * Sets up our state, and decompresses the given LZ4 stream. Skippable frames
+ * are skipped, and consecutive frames are concatenated.
+ */
+static int lz4_decompress_into(void *dest, size_t dest_size, const void *src, size_t src_size,
+    int stop_when_full, size_t *out_length)
+{
+    struct lz4_state s;
+    int rc = SUCCESS;
+
+    if(!lz4_is_lz4(src, src_size))
+        return -FDT_ERR_BADMAGIC;
+
+    s.in = src;
+    s.in_end = s.in + src_size;
+    s.out_start = s.out = dest;
+    s.out_end = s.out + dest_size;
+    s.stop_when_full = stop_when_full;
+
+    while(!rc && (s.in_end - s.in >= 4) && !(stop_when_full && s.out == s.out_end)) {
+        uint32_t magic = read_le32(s.in);
+        uint64_t content_size;
+        uint8_t flags;
+
+        if(magic == LZ4_LEGACY_MAGIC) {
+            s.in += 4;
+            rc = lz4_decompress_legacy(&s);
+        } else if(magic == LZ4_FRAME_MAGIC) {
+            s.in = lz4_read_frame_header(s.in, s.in_end, &flags, &content_size);
+            if(!s.in)
+                return -FDT_ERR_BADVALUE;
+
+            rc = lz4_decompress_frame(&s, flags);
+
+            if(!rc && (flags & LZ4_FLG_CONTENT_CHECKSUM) && !stop_when_full)
+                s.in = min(s.in + 4, s.in_end);
+        } else if((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC && s.in_end - s.in >= 8) {
+            s.in += 8 + min((size_t)read_le32(s.in + 4), (size_t)(s.in_end - s.in - 8));
+        } else {
+            // Anything else is padding after the last frame (e.g. from a bootloader
+            // that rounds up module sizes); we're done.
+            break;
+        }
+    }
+
+    if(out_length)
+        *out_length = s.out - s.out_start;
+
+    return rc;
+}
+
+
+/**
+ * Decompresses an LZ4 stream into the given buffer.
+ */
+int lz4_decompress(void *dest, size_t dest_size, const void *src, size_t src_size, size_t *out_length)
+{
+    return lz4_decompress_into(dest, dest_size, src, src_size, false, out_length);
+}
+
+
+/**
+ * Decompresses only the start of an LZ4 stream.
+ */
+int lz4_decompress_prefix(void *dest, size_t length, const void *src, size_t src_size)
+{
+    size_t produced;
+    int rc;
+
+    rc = lz4_decompress_into(dest, length, src, src_size, true, &produced);
+    if(rc)
+        return rc;
+
+    return (produced == length) ? SUCCESS : -FDT_ERR_TRUNCATED;
+}
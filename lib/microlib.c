@@ -83,22 +83,68 @@ extern int puts(const char * s)
 }
 
 
+/*
+ * Word-at-a-time helpers. We run with the MMU off, so all of our accesses are
+ * to Device memory, where unaligned accesses fault; each of the routines
+ * below handles any unaligned head and tail a byte at a time, and only ever
+ * performs aligned word loads.
+ */
+typedef uint64_t __attribute__((may_alias)) word_t;
+
+#define WORD_BYTES      (sizeof(word_t))
+#define ONES            ((word_t)0x0101010101010101ULL)
+#define HIGHS           ((word_t)0x8080808080808080ULL)
+
+
+/**
+ * Returns true iff the given pointer is word-aligned.
+ */
+static inline int is_word_aligned(const void *p)
+{
+    return ((uintptr_t)p & (WORD_BYTES - 1)) == 0;
+}
+
+
+/**
+ * Returns non-zero iff any byte of the given word is zero.
+ */
+static inline word_t has_zero_byte(word_t word)
+{
+    return (word - ONES) & ~word & HIGHS;
+}
+
+
 /**
  * Determines the length of a string, scanning at most max characters.
  */
 size_t strnlen(const char *s, size_t max)
 {
-    size_t n = 0;
+    const char *p = s;
+    const char *end;
 
-    while(*s) {
-        ++n;
-        ++s;
+    // Callers (e.g. printf) pass SIZE_MAX for "no limit"; clamp it so the
+    // end of our scan can't wrap around the address space.
+    if(max > SIZE_MAX - (uintptr_t)s)
+        max = SIZE_MAX - (uintptr_t)s;
 
-        if(n == max)
-            return n;
-    }
+    end = s + max;
 
-    return n;
+    // Scan a byte at a time until we're word-aligned...
+    for(; p < end && !is_word_aligned(p); ++p)
+        if(!*p)
+            return p - s;
+
+    // ... then a word at a time, until a word contains the terminator...
+    for(; (size_t)(end - p) >= WORD_BYTES; p += WORD_BYTES)
+        if(has_zero_byte(*(const word_t *)p))
+            break;
+
+    // ... and then find exactly where the string ends.
+    for(; p < end; ++p)
+        if(!*p)
+            break;
+
+    return p - s;
 }
 
 
@@ -111,18 +157,28 @@ size_t strlen(const char *s)
 }
 
 /**
- * Determines if two memory regiohns are equal, and returns the difference if they are not.
+ * Determines if two memory regions are equal, and returns the difference if they are not.
  */
 int memcmp(const void *s1, const void *s2, size_t n)
 {
-    int i;
-
-    const char * c1 = s1;
-    const char * c2 = s2;
+    const unsigned char *c1 = s1;
+    const unsigned char *c2 = s2;
+
+    // We can only compare a word at a time if both regions can be word-aligned at once.
+    if((((uintptr_t)c1 ^ (uintptr_t)c2) & (WORD_BYTES - 1)) == 0) {
+        for(; n && !is_word_aligned(c1); --n, ++c1, ++c2)
+            if(*c1 != *c2)
+                return *c1 - *c2;
+
+        // Skip past matching words; the byte loop below finds the difference in the first that isn't.
+        for(; n >= WORD_BYTES; n -= WORD_BYTES, c1 += WORD_BYTES, c2 += WORD_BYTES)
+            if(*(const word_t *)c1 != *(const word_t *)c2)
+                break;
+    }
 
-    for(i = 0; i < n; ++i)
-        if(c1[i] != c2[i])
-            return c1[i] - c2[i];
+    for(; n; --n, ++c1, ++c2)
+        if(*c1 != *c2)
+            return *c1 - *c2;
 
     return 0;
 }
@@ -133,11 +189,21 @@ int memcmp(const void *s1, const void *s2, size_t n)
 void * memchr(const void *s, int c, size_t n)
 {
     const unsigned char *p = s;
-    int i;
+    unsigned char target = c;
+    word_t pattern = ONES * target;
 
-    for(i = 0; i < n; ++i)
-        if(p[i] == (unsigned char)c)
-            return (void *)&(p[i]);
+    for(; n && !is_word_aligned(p); --n, ++p)
+        if(*p == target)
+            return (void *)p;
+
+    // Bytes that match our target become zero when XOR'd with the pattern.
+    for(; n >= WORD_BYTES; n -= WORD_BYTES, p += WORD_BYTES)
+        if(has_zero_byte(*(const word_t *)p ^ pattern))
+            break;
+
+    for(; n; --n, ++p)
+        if(*p == target)
+            return (void *)p;
 
     return 0;
 }
@@ -160,16 +226,19 @@ void * memset(void *b, int c, size_t len)
 #ifndef __RUNNING_ON_OS__
 
 /**
- * Clear out the system's bss.
+ * Clear out the system's bss: both the boot-only bss, and the bss in our
+ * resident region.
  */
 void _clear_bss(void)
 {
     // These symbols don't actually have a meaningful type-- instead,
     // we care about the locations at which the linker /placed/ these
-    // symbols, which happen to be at the start and end of the BSS.
-    extern int lds_bss_start, lds_bss_end;
+    // symbols, which happen to be at the start and end of each BSS.
+    extern char lds_bss_start, lds_bss_end;
+    extern char lds_resident_bss_start, lds_resident_bss_end;
 
     memset(&lds_bss_start, 0, &lds_bss_end - &lds_bss_start);
+    memset(&lds_resident_bss_start, 0, &lds_resident_bss_end - &lds_resident_bss_start);
 }
 
 #endif
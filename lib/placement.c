@@ -0,0 +1,300 @@
+/**
+ * Payload placement planner for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <placement.h>
+
+/**
+ * @return True iff the two spans share any bytes.
+ */
+static inline int spans_overlap(uint64_t a, uint64_t a_size, uint64_t b, uint64_t b_size)
+{
+    return a_size && b_size && (a < b + b_size) && (b < a + a_size);
+}
+
+
+/**
+ * Creates an empty plan.
+ */
+void placement_init(struct placement_plan *plan)
+{
+    plan->count = 0;
+    plan->move_count = 0;
+}
+
+
+/**
+ * Adds a region to the plan.
+ *
+ * @return The index of the new region, or -FDT_ERR_NOSPACE if the plan is full.
+ */
+static int placement_add(struct placement_plan *plan, const char *name, enum placement_kind kind,
+    uint64_t start, uint64_t size, uint64_t destination, uint64_t footprint, int may_overlap)
+{
+    struct placement_region *region;
+
+    if(plan->count >= PLACEMENT_MAX_REGIONS)
+        return -FDT_ERR_NOSPACE;
+
+    region = &plan->regions[plan->count];
+    region->name = name;
+    region->kind = kind;
+    region->start = start;
+    region->size = size;
+    region->destination = destination;
+    region->footprint = footprint;
+    region->may_overlap = may_overlap;
+
+    return plan->count++;
+}
+
+
+/**
+ * Adds a region that must stay where it is.
+ */
+int placement_add_resident(struct placement_plan *plan, const char *name, uint64_t start, uint64_t size)
+{
+    return placement_add(plan, name, PLACEMENT_RESIDENT, start, size, start, size, true);
+}
+
+
+/**
+ * Adds a region that must be moved to a fixed destination.
+ */
+int placement_add_fixed(struct placement_plan *plan, const char *name, uint64_t start, uint64_t size,
+    uint64_t destination, uint64_t footprint, int may_overlap)
+{
+    return placement_add(plan, name, PLACEMENT_FIXED, start, size, destination, footprint, may_overlap);
+}
+
+
+/**
+ * Adds a region that can live anywhere in RAM. Until the plan is solved, its
+ * destination is its current location.
+ */
+int placement_add_floating(struct placement_plan *plan, const char *name, uint64_t start, uint64_t size)
+{
+    return placement_add(plan, name, PLACEMENT_FLOATING, start, size, start, size, true);
+}
+
+
+/**
+ * Checks a span against the final location of every region that's been
+ * placed: all resident and fixed regions, and any floating regions before
+ * the given one.
+ *
+ * @param floating_index The index of the floating region being placed.
+ * @return True iff the span is clear of each placed region.
+ */
+static int clear_of_destinations(const struct placement_plan *plan, uint64_t start, uint64_t size,
+    int floating_index)
+{
+    int i;
+
+    for(i = 0; i < plan->count; ++i) {
+        const struct placement_region *region = &plan->regions[i];
+
+        if((region->kind == PLACEMENT_FLOATING) && (i >= floating_index))
+            continue;
+
+        if(spans_overlap(start, size, region->destination, region->footprint))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Checks a span against the current location of every region but one. A
+ * region moved into such a span can be moved first, as it won't overwrite
+ * anything that's yet to be read.
+ *
+ * @return True iff the span is clear of each other region's contents.
+ */
+static int clear_of_sources(const struct placement_plan *plan, uint64_t start, uint64_t size, int ignore)
+{
+    int i;
+
+    for(i = 0; i < plan->count; ++i)
+        if((i != ignore) && spans_overlap(start, size, plan->regions[i].start, plan->regions[i].size))
+            return false;
+
+    return true;
+}
+
+
+/**
+ * @return True iff the span lies entirely within a single block of memory.
+ */
+static int within_memory(const struct region_set *memory, uint64_t start, uint64_t size)
+{
+    size_t i;
+
+    for(i = 0; i < memory->count; ++i)
+        if((start >= memory->regions[i].start) &&
+           (start + size <= memory->regions[i].start + memory->regions[i].size))
+            return true;
+
+    return false;
+}
+
+
+/**
+ * Finds a new home for a floating region that's in the way. The lowest free
+ * spot always starts at either the start of a block of memory or the end of
+ * another region, so those are the only spots we need to try.
+ *
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if there's nowhere for the region to go.
+ */
+static int place_floating_region(struct placement_plan *plan, int index, const struct region_set *memory,
+    uint64_t alignment)
+{
+    struct placement_region *region = &plan->regions[index];
+    size_t candidate_count = memory->count + plan->count * 2;
+    uint64_t candidate, best = 0;
+    int found = false;
+    size_t i;
+
+    for(i = 0; i < candidate_count; ++i) {
+        if(i < memory->count) {
+            candidate = memory->regions[i].start;
+        } else {
+            const struct placement_region *other = &plan->regions[(i - memory->count) / 2];
+            candidate = ((i - memory->count) % 2) ? other->destination + other->footprint : other->start + other->size;
+        }
+
+        candidate = (candidate + alignment - 1) & ~(alignment - 1);
+
+        if(found && (candidate >= best))
+            continue;
+
+        if(within_memory(memory, candidate, region->size) &&
+           clear_of_destinations(plan, candidate, region->size, index) &&
+           clear_of_sources(plan, candidate, region->size, index)) {
+            best = candidate;
+            found = true;
+        }
+    }
+
+    if(!found)
+        return -FDT_ERR_NOSPACE;
+
+    region->destination = best;
+    return SUCCESS;
+}
+
+
+/**
+ * Orders the plan's moves so that each region is moved out of the way
+ * before anything is moved over it.
+ *
+ * @return SUCCESS, or -FDT_ERR_BADLAYOUT if the moves depend on each other
+ *    in a cycle.
+ */
+static int order_moves(struct placement_plan *plan)
+{
+    int scheduled[PLACEMENT_MAX_REGIONS] = { 0 };
+    int i, j, ready, progress;
+
+    plan->move_count = 0;
+
+    // Plans are tiny, so we just keep picking out moves that are ready to go.
+    do {
+        progress = false;
+
+        for(i = 0; i < plan->count; ++i) {
+            const struct placement_region *region = &plan->regions[i];
+
+            if(scheduled[i] || !placement_region_moves(region))
+                continue;
+
+            ready = true;
+            for(j = 0; j < plan->count; ++j)
+                if((j != i) && !scheduled[j] && placement_region_moves(&plan->regions[j]) &&
+                   spans_overlap(region->destination, region->footprint, plan->regions[j].start, plan->regions[j].size))
+                    ready = false;
+
+            if(ready) {
+                scheduled[i] = true;
+                plan->moves[plan->move_count++] = i;
+                progress = true;
+            }
+        }
+    } while(progress);
+
+    for(i = 0; i < plan->count; ++i)
+        if(!scheduled[i] && placement_region_moves(&plan->regions[i]))
+            return -FDT_ERR_BADLAYOUT;
+
+    return SUCCESS;
+}
+
+
+/**
+ * Works out where each floating region should live, and the order in which
+ * regions should be moved.
+ */
+int placement_solve(struct placement_plan *plan, const struct region_set *memory, uint64_t alignment)
+{
+    int i, j, rc;
+
+    // Resident and fixed regions don't get a say in where they end up, so
+    // all we can do is make sure they fit together.
+    for(i = 0; i < plan->count; ++i) {
+        const struct placement_region *region = &plan->regions[i];
+
+        if(region->kind == PLACEMENT_FLOATING)
+            continue;
+
+        if(!region->may_overlap && spans_overlap(region->start, region->size, region->destination, region->footprint))
+            return -FDT_ERR_BADLAYOUT;
+
+        for(j = i + 1; j < plan->count; ++j)
+            if((plan->regions[j].kind != PLACEMENT_FLOATING) &&
+               spans_overlap(region->destination, region->footprint, plan->regions[j].destination, plan->regions[j].footprint))
+                return -FDT_ERR_BADLAYOUT;
+    }
+
+    // Floating regions stay where they are, unless they're in the way.
+    for(i = 0; i < plan->count; ++i) {
+        struct placement_region *region = &plan->regions[i];
+
+        if(region->kind != PLACEMENT_FLOATING)
+            continue;
+
+        region->destination = region->start;
+        if(clear_of_destinations(plan, region->start, region->size, i))
+            continue;
+
+        rc = place_floating_region(plan, i, memory, alignment);
+        if(rc)
+            return rc;
+    }
+
+    return order_moves(plan);
+}
@@ -0,0 +1,247 @@
+/**
+ * Physical memory region sets for Discharge
+ *
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+#include <libfdt.h>
+
+#include <arena.h>
+#include <regions.h>
+
+/**
+ * @return The address just past the end of the given region.
+ */
+static inline uint64_t region_end(const struct mem_region *region)
+{
+    return region->start + region->size;
+}
+
+
+/**
+ * Creates an empty region set.
+ *
+ * @param set The set to be initialized.
+ * @param capacity The number of regions to make room for up front; the set
+ *    will grow past this if needed.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int region_set_init(struct region_set *set, size_t capacity)
+{
+    if(!capacity)
+        capacity = 1;
+
+    set->regions = arena_alloc(capacity * sizeof(*set->regions));
+    if(!set->regions)
+        return -FDT_ERR_NOSPACE;
+
+    set->count = 0;
+    set->capacity = capacity;
+    return SUCCESS;
+}
+
+
+/**
+ * Ensures the given set has room for at least the given number of regions.
+ */
+static int region_set_reserve(struct region_set *set, size_t capacity)
+{
+    struct mem_region *regions;
+
+    if(capacity <= set->capacity)
+        return SUCCESS;
+
+    // Grow geometrically, so repeated insertions stay cheap. The arena can't
+    // free the old array, but region sets are small and short-lived.
+    capacity = max(capacity, set->capacity * 2);
+
+    regions = arena_alloc(capacity * sizeof(*regions));
+    if(!regions)
+        return -FDT_ERR_NOSPACE;
+
+    memcpy(regions, set->regions, set->count * sizeof(*regions));
+    set->regions = regions;
+    set->capacity = capacity;
+    return SUCCESS;
+}
+
+
+/**
+ * Adds a region to the set. Empty regions are ignored. The set is not
+ * normalized until region_set_normalize() is called.
+ *
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int region_set_insert(struct region_set *set, uint64_t start, uint64_t size)
+{
+    int rc;
+
+    if(!size)
+        return SUCCESS;
+
+    rc = region_set_reserve(set, set->count + 1);
+    if(rc)
+        return rc;
+
+    set->regions[set->count].start = start;
+    set->regions[set->count].size = size;
+    ++set->count;
+    return SUCCESS;
+}
+
+
+/**
+ * Restores the heap property for the subtree rooted at the given node.
+ */
+static void sift_down(struct mem_region *regions, size_t root, size_t count)
+{
+    while(root * 2 + 1 < count) {
+        size_t child = root * 2 + 1;
+        struct mem_region swap;
+
+        if(child + 1 < count && regions[child + 1].start > regions[child].start)
+            ++child;
+
+        if(regions[root].start >= regions[child].start)
+            return;
+
+        swap = regions[root];
+        regions[root] = regions[child];
+        regions[child] = swap;
+        root = child;
+    }
+}
+
+
+/**
+ * Sorts a region array by start address. We use a heapsort, as it's
+ * O(n log n) in the worst case, and doesn't need any extra memory.
+ */
+static void sort_regions(struct mem_region *regions, size_t count)
+{
+    size_t i;
+
+    if(count < 2)
+        return;
+
+    for(i = count / 2; i-- > 0;)
+        sift_down(regions, i, count);
+
+    for(i = count - 1; i > 0; --i) {
+        struct mem_region swap = regions[0];
+        regions[0] = regions[i];
+        regions[i] = swap;
+        sift_down(regions, 0, i);
+    }
+}
+
+
+/**
+ * Sorts the set by start address, and merges any regions that overlap or touch.
+ * Runs in O(n log n).
+ */
+void region_set_normalize(struct region_set *set)
+{
+    size_t i, merged = 0;
+
+    sort_regions(set->regions, set->count);
+
+    for(i = 0; i < set->count; ++i) {
+        struct mem_region *last = merged ? &set->regions[merged - 1] : NULL;
+
+        if(last && (set->regions[i].start <= region_end(last))) {
+            uint64_t end = max(region_end(last), region_end(&set->regions[i]));
+            last->size = end - last->start;
+        } else {
+            set->regions[merged++] = set->regions[i];
+        }
+    }
+
+    set->count = merged;
+}
+
+
+/**
+ * Removes every region in a set of exclusions from the given set, splitting
+ * regions as needed. Both sets are normalized first, after which this takes
+ * a single pass over each.
+ *
+ * @param set The set to be modified.
+ * @param exclusions The regions to be removed from the set.
+ * @return SUCCESS, or -FDT_ERR_NOSPACE if the arena is exhausted.
+ */
+int region_set_subtract(struct region_set *set, struct region_set *exclusions)
+{
+    struct mem_region *result;
+    size_t i, j = 0, count = 0, capacity;
+
+    region_set_normalize(set);
+    region_set_normalize(exclusions);
+
+    // Each exclusion can split at most one region in two, so this bounds our output.
+    capacity = set->count + exclusions->count;
+    result = arena_alloc(capacity * sizeof(*result));
+    if(!result)
+        return -FDT_ERR_NOSPACE;
+
+    for(i = 0; i < set->count; ++i) {
+        uint64_t start = set->regions[i].start;
+        uint64_t end = region_end(&set->regions[i]);
+
+        // Skip any exclusions that end before this region starts; as both sets
+        // are sorted, they can't affect any later region, either.
+        while(j < exclusions->count && region_end(&exclusions->regions[j]) <= start)
+            ++j;
+
+        // Carve out each exclusion that starts inside this region.
+        while(j < exclusions->count && exclusions->regions[j].start < end) {
+            const struct mem_region *hole = &exclusions->regions[j];
+
+            if(hole->start > start) {
+                result[count].start = start;
+                result[count].size = hole->start - start;
+                ++count;
+            }
+
+            start = max(start, region_end(hole));
+
+            // If the hole extends past this region, it may affect the next one, too.
+            if(region_end(hole) >= end)
+                break;
+
+            ++j;
+        }
+
+        if(start < end) {
+            result[count].start = start;
+            result[count].size = end - start;
+            ++count;
+        }
+    }
+
+    set->regions = result;
+    set->count = count;
+    set->capacity = capacity;
+    return SUCCESS;
+}
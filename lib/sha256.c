@@ -0,0 +1,303 @@
+/**
+ * SHA-256 for Discharge
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <microlib.h>
+
+#include <sha256.h>
+
+/**
+ * Processes whole blocks with the Crypto Extensions (see sha256_ce.S),
+ * optionally copying each block to dest as it's read.
+ */
+void sha256_ce_blocks(uint32_t state[8], void *dest, const void *src, size_t blocks);
+
+/**
+ * The SHA-256 initial hash value.
+ */
+static const uint32_t sha256_initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/**
+ * The SHA-256 round constants.
+ */
+static const uint32_t sha256_round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+
+/**
+ * @return True iff the ARMv8 Crypto Extensions' SHA-256 instructions are
+ *    available (and have been enabled for our use).
+ */
+int sha256_hardware_available(void)
+{
+#ifndef __RUNNING_ON_OS__
+    static int available = -1;
+    uint64_t isar0, current_el, cpacr;
+
+    if(available >= 0)
+        return available;
+
+    // ID_AA64ISAR0_EL1.SHA2 is non-zero if SHA256H and friends are implemented.
+    asm volatile("mrs %0, ID_AA64ISAR0_EL1" : "=r" (isar0));
+    available = ((isar0 >> 12) & 0xf) != 0;
+
+    // They use the SIMD registers, so make sure those don't trap. At EL2,
+    // main() has already cleared CPTR_EL2.TFP; at EL1, we need CPACR_EL1.FPEN.
+    asm volatile("mrs %0, CurrentEL" : "=r" (current_el));
+    if(available && ((current_el >> 2) == 1)) {
+        asm volatile("mrs %0, CPACR_EL1" : "=r" (cpacr));
+        asm volatile("msr CPACR_EL1, %0" :: "r" (cpacr | (3 << 20)));
+        asm volatile("isb");
+    }
+
+    return available;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * Reads a big-endian word from a buffer that may not be aligned.
+ */
+static inline uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+/**
+ * Processes whole blocks in C, optionally copying each block to dest as it's
+ * read. Words are only accessed whole when they're aligned, as unaligned
+ * accesses fault with the MMU off.
+ */
+static void sha256_c_blocks(uint32_t state[8], uint8_t *dest, const uint8_t *src, size_t blocks)
+{
+    int src_aligned = !((uintptr_t)src & 3);
+    int dest_aligned = !((uintptr_t)dest & 3);
+    uint32_t w[64];
+    int i;
+
+    while(blocks--) {
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for(i = 0; i < 16; ++i) {
+            if(src_aligned) {
+                uint32_t word = ((const uint32_t *)src)[i];
+
+                if(dest && dest_aligned)
+                    ((uint32_t *)dest)[i] = word;
+
+                w[i] = __builtin_bswap32(word);
+            } else {
+                w[i] = read_be32(src + 4 * i);
+            }
+        }
+
+        if(dest && !(src_aligned && dest_aligned))
+            memcpy(dest, src, SHA256_BLOCK_BYTES);
+
+        for(i = 16; i < 64; ++i) {
+            uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        for(i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) +
+                sha256_round_constants[i] + w[i];
+            uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        src += SHA256_BLOCK_BYTES;
+        if(dest)
+            dest += SHA256_BLOCK_BYTES;
+    }
+}
+
+
+/**
+ * Processes whole blocks, using the fastest implementation we have.
+ */
+static void sha256_blocks(uint32_t state[8], uint8_t *dest, const uint8_t *src, size_t blocks)
+{
+#ifndef __RUNNING_ON_OS__
+    if(sha256_hardware_available()) {
+        sha256_ce_blocks(state, dest, src, blocks);
+        return;
+    }
+#endif
+
+    sha256_c_blocks(state, dest, src, blocks);
+}
+
+
+/**
+ * Prepares to compute a new SHA-256 digest.
+ */
+void sha256_init(struct sha256_context *context)
+{
+    memcpy(context->state, sha256_initial_state, sizeof(context->state));
+    context->length = 0;
+    context->buffered = 0;
+}
+
+
+/**
+ * Adds data to the computation, copying it to dest (if non-NULL) as it goes.
+ */
+static void sha256_process(struct sha256_context *context, uint8_t *dest, const uint8_t *src, size_t length)
+{
+    size_t blocks;
+
+    context->length += length;
+
+    // Top up any partial block first...
+    if(context->buffered) {
+        size_t count = min(length, SHA256_BLOCK_BYTES - context->buffered);
+
+        memcpy(context->buffer + context->buffered, src, count);
+        if(dest) {
+            memcpy(dest, src, count);
+            dest += count;
+        }
+
+        context->buffered += count;
+        src += count;
+        length -= count;
+
+        if(context->buffered < SHA256_BLOCK_BYTES)
+            return;
+
+        sha256_blocks(context->state, NULL, context->buffer, 1);
+        context->buffered = 0;
+    }
+
+    // ... then process whole blocks straight from the source...
+    blocks = length / SHA256_BLOCK_BYTES;
+    sha256_blocks(context->state, dest, src, blocks);
+
+    src += blocks * SHA256_BLOCK_BYTES;
+    if(dest)
+        dest += blocks * SHA256_BLOCK_BYTES;
+    length -= blocks * SHA256_BLOCK_BYTES;
+
+    // ... and hold on to anything left over.
+    memcpy(context->buffer, src, length);
+    if(dest)
+        memcpy(dest, src, length);
+    context->buffered = length;
+}
+
+
+/**
+ * Adds data to a SHA-256 computation.
+ */
+void sha256_update(struct sha256_context *context, const void *data, size_t length)
+{
+    sha256_process(context, NULL, data, length);
+}
+
+
+/**
+ * Copies a block of memory, adding it to a SHA-256 computation as it goes.
+ */
+void *sha256_copy(struct sha256_context *context, void *dest, const void *src, size_t length)
+{
+    sha256_process(context, dest, src, length);
+    return dest;
+}
+
+
+/**
+ * Completes a SHA-256 computation.
+ */
+void sha256_final(struct sha256_context *context, uint8_t digest[SHA256_DIGEST_BYTES])
+{
+    uint64_t bit_length = context->length * 8;
+    int i;
+
+    // Pad with a single set bit, then zeroes, leaving room for the length.
+    context->buffer[context->buffered++] = 0x80;
+    if(context->buffered > SHA256_BLOCK_BYTES - sizeof(bit_length)) {
+        memset(context->buffer + context->buffered, 0, SHA256_BLOCK_BYTES - context->buffered);
+        sha256_blocks(context->state, NULL, context->buffer, 1);
+        context->buffered = 0;
+    }
+
+    memset(context->buffer + context->buffered, 0, SHA256_BLOCK_BYTES - context->buffered);
+    for(i = 0; i < sizeof(bit_length); ++i)
+        context->buffer[SHA256_BLOCK_BYTES - 1 - i] = bit_length >> (8 * i);
+
+    sha256_blocks(context->state, NULL, context->buffer, 1);
+
+    for(i = 0; i < SHA256_DIGEST_BYTES; ++i)
+        digest[i] = context->state[i / 4] >> (24 - 8 * (i % 4));
+}
+
+
+/**
+ * Computes the SHA-256 digest of a block of memory.
+ */
+void sha256(const void *data, size_t length, uint8_t digest[SHA256_DIGEST_BYTES])
+{
+    struct sha256_context context;
+
+    sha256_init(&context);
+    sha256_update(&context, data, length);
+    sha256_final(&context, digest);
+}
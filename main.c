@@ -13,9 +13,19 @@
 
 #include <libfdt.h>
 #include <cache.h>
+#include <cache_topology.h>
+#include <arena.h>
+#include <config.h>
+#include <lazy_cache.h>
+#include <inflate.h>
+#include <lz4.h>
+#include <sha256.h>
+#include <crc32c.h>
+#include <placement.h>
 
 #include "image.h"
 #include "regs.h"
+#include "smp.h"
 
 /**
  * Switches to EL1, and then calls main_el1.
@@ -28,12 +38,75 @@ void switch_to_el1(void * fdt);
  */
 void main_el1(void * fdt);
 
+/**
+ * Applies the stub's relocations to an image of the stub at the given address.
+ * Implemented in assembly in entry.S.
+ */
+void _apply_relocations(uintptr_t base);
+
+/**
+ * Continues execution in main_relocated, in the copy of the stub at the given
+ * address. Implemented in assembly in entry.S.
+ */
+void _switch_to_relocated(void *fdt, uintptr_t base) __attribute__((noreturn));
+
+/**
+ * C entry point once the stub is running from its final location.
+ */
+void main_relocated(void *fdt);
+
 /**
  * Reference to the EL2 vector table.
  * Note that the type here isn't reprsentative-- we just need the address of the label.
  */
 extern uint64_t el2_vector_table;
 
+/**
+ * Index of the bootloader-provided FDT. Its hash tables live in the arena.
+ */
+static struct fdt_index fdt_index;
+
+/**
+ * Tracks which of the FDT's cache lines we've invalidated, when we're only
+ * invalidating the parts of the FDT we actually read.
+ */
+static struct lazy_cache fdt_cache;
+
+/**
+ * The payloads (kernel, ramdisk, etc.) passed to us by the bootloader.
+ */
+static struct payload_table payloads;
+
+/**
+ * The edits we'll make to the bootloader-provided FDT before handing it to
+ * the next-stage kernel. These are all applied at once, just before launch.
+ */
+static struct fdt_journal fdt_journal;
+
+/**
+ * The buffer the final FDT is built in. This lives with the other boot-time
+ * memory after the EL1 stack; Linux reserves the FDT wherever it finds it, so
+ * we don't need to carve this out. Linux requires the FDT to be 8-byte aligned.
+ */
+static uint8_t final_fdt[CONFIG_FINAL_FDT_SIZE] __attribute__((section(".noinit"), aligned(8)));
+
+/**
+ * Where each payload will be when the kernel is launched, and the order
+ * they're moved in to get there.
+ */
+static struct placement_plan placement;
+
+/**
+ * The alignment we give any payload we have to move out of the way.
+ */
+#define PAYLOAD_ALIGN (4096ULL)
+
+/**
+ * The handle of the /chosen node we added through the journal, if the FDT
+ * didn't have one of its own.
+ */
+static int journal_chosen = -FDT_ERR_NOTFOUND;
+
 
 /**
  * Print our intro message
@@ -49,6 +122,7 @@ void intro(uint32_t el)
     printf("  current execution level:               EL%u\n", el);
     printf("  hypervisor applications supported:     %s\n", (el == 2) ? "YES" : "NO");
     printf("  mmu is:                                %s\n", (get_el2_mmu_status()) ? "ON" : "OFF");
+    cache_topology_print();
 
 }
 
@@ -71,14 +145,24 @@ void panic(const char * message)
 
 /**
  * Main task for loading the system's device tree.
+ *
+ * @param fdt The FDT passed in by the bootloader.
+ * @param index The index to be populated.
+ * @param cache The tracker for the FDT's cache lines, or NULL to make the
+ *    whole FDT accessible up front.
+ * @param journal The journal to be prepared for edits to the FDT.
  */
-void load_device_tree(void *fdt)
+void load_device_tree(void *fdt, struct fdt_index *index, struct lazy_cache *cache,
+    struct fdt_journal *journal)
 {
     int rc;
     char * fdt_raw = fdt;
 
     printf("\nFinding device tree...\n");
-    rc = ensure_image_is_accessible(fdt);
+    if(cache)
+        rc = ensure_fdt_is_accessible_lazily(fdt, cache);
+    else
+        rc = ensure_image_is_accessible(fdt);
 
     printf("  flattened device tree resident at:     0x%p\n", fdt);
     printf("  flattened device tree magic is:        %02x%02x%02x%02x\n", fdt_raw[0], fdt_raw[1], fdt_raw[2], fdt_raw[3]);
@@ -88,8 +172,73 @@ void load_device_tree(void *fdt)
         panic("Cannot continue without a valid device tree.");
 
     printf("  flattened device size:                 %d bytes \n", fdt_totalsize(fdt));
+
+    // Walk the tree once, noting where each of the nodes we care about lives.
+    rc = fdt_index_build_lazy(index, fdt, cache);
+    if(rc != SUCCESS)
+        panic("Could not index the device tree.");
+
+    printf("  flattened device tree nodes:           %d\n", index->node_count);
+
+    // We leave the bootloader's FDT as-is, and record our edits to apply later.
+    rc = fdt_journal_init(journal, fdt);
+    if(rc != SUCCESS)
+        panic("Could not prepare to edit the device tree.");
 }
 
+/**
+ * Checks a payload against the SHA-256 digest we expect of it, and refuses to
+ * continue if it doesn't match.
+ *
+ * @param description String description of the payload, for messages.
+ * @param digest The payload's actual digest.
+ * @param expected The digest the payload should have.
+ */
+void check_sha256(const char *description, const uint8_t *digest, const uint8_t *expected)
+{
+    int matches = !memcmp(digest, expected, SHA256_DIGEST_BYTES);
+
+    // Line the result up with the rest of our output.
+    printf("  %s SHA-256:%*s%s (%s)\n", description, (int)(30 - strlen(description)), "",
+        matches ? "OK" : "MISMATCH", sha256_hardware_available() ? "hardware" : "software");
+
+    if(!matches)
+        panic("A payload failed its integrity check!");
+}
+
+
+/**
+ * Checks a payload against the CRC-32C we expect of it, and refuses to
+ * continue if it doesn't match.
+ */
+void check_crc32c(const char *description, uint32_t crc, uint32_t expected)
+{
+    printf("  %s CRC-32C:%*s%s (%s)\n", description, (int)(30 - strlen(description)), "",
+        crc == expected ? "OK" : "MISMATCH", crc32c_hardware_available() ? "hardware" : "software");
+
+    if(crc != expected)
+        panic("A payload failed its integrity check!");
+}
+
+
+/**
+ * Checks a payload in place against each of the digests we expect of it.
+ */
+void verify_payload_digests(const char *description, const void *data, size_t size,
+    const struct payload_digests *digests)
+{
+    uint8_t digest[SHA256_DIGEST_BYTES];
+
+    if(digests->sha256) {
+        sha256(data, size, digest);
+        check_sha256(description, digest, digests->sha256);
+    }
+
+    if(digests->has_crc32c)
+        check_crc32c(description, crc32c(0, data, size), digests->crc32c);
+}
+
+
 /**
  * Relocate the Linux kernel to the start of RAM. This is necessary for the
  * Linux start-of-day code to work properly if we don't modify TEXT_OFFSET
@@ -97,23 +246,572 @@ void load_device_tree(void *fdt)
  *
  * @param kernel The kernel to be relocated.
  * @param size_t The size of the kernel.
+ * @param digests The digests the kernel should have. These are checked as
+ *    the kernel is copied, so it's only read once.
  */
-void * relocate_kernel(const void *kernel, size_t size, void *start_of_ram)
+void * relocate_kernel(const void *kernel, size_t size, void *start_of_ram,
+    const struct payload_digests *digests)
 {
-    const uint64_t *kernel_raw = kernel;
+    uint32_t crc;
+    uint64_t header[LINUX_IMAGE_HEADER_BYTES / sizeof(uint64_t)];
+    uintptr_t text_offset, load_addr;
+
+    // Kernels unpacked from a FIT are only 4-byte aligned, and we can't make
+    // unaligned accesses with the MMU off; so take a copy of the header.
+    memcpy(header, kernel, sizeof(header));
 
     // Read the requested TEXT_OFFSET from the kernel image header. This is how
     // many bytes after the START_OF_RAM Linux expects us to load it.
-    uintptr_t text_offset = (uintptr_t)kernel_raw[1];
+    text_offset = (uintptr_t)header[1];
 
     // Determine the load address for the Linux kernel.
-    uintptr_t load_addr = (uintptr_t)start_of_ram + text_offset;
+    load_addr = (uintptr_t)start_of_ram + text_offset;
 
     printf("\n\nRelocating hardware domain kernel to %p...\n", load_addr);
 
+    // We copy with our caches off, so any lines the bootloader left dirty
+    // for the destination could later be written back over the kernel.
+    // We're replacing their contents anyway, so just discard them.
+    smp_discard_cache_region((void *)load_addr, size);
+
+    // If we're checking the kernel, hash it as we copy it, so we only read it
+    // once. That's a serial job, so it's done by this core alone. The copy
+    // reads each block before writing it, so it's only safe moving downwards.
+    if(digests->sha256) {
+        struct sha256_context context;
+        uint8_t digest[SHA256_DIGEST_BYTES], expected[SHA256_DIGEST_BYTES];
+
+        // The expected digest may live in a FIT we're about to copy over.
+        memcpy(expected, digests->sha256, sizeof(expected));
+
+        sha256_init(&context);
+        if((load_addr <= (uintptr_t)kernel) || (load_addr >= (uintptr_t)kernel + size)) {
+            sha256_copy(&context, (void *)load_addr, kernel, size);
+        } else {
+            smp_memmove((void *)load_addr, kernel, size);
+            sha256_update(&context, (void *)load_addr, size);
+        }
+        sha256_final(&context, digest);
+
+        check_sha256("kernel", digest, expected);
+
+        if(digests->has_crc32c)
+            check_crc32c("kernel", crc32c(0, (void *)load_addr, size), digests->crc32c);
+
+        return (void *)load_addr;
+    }
+
+    // A CRC, on the other hand, can be computed in pieces and stitched back
+    // together, so each core checksums the chunks it copies.
+    if(digests->has_crc32c) {
+        smp_memmove_crc32c((void *)load_addr, kernel, size, &crc);
+        check_crc32c("kernel", crc, digests->crc32c);
+        return (void *)load_addr;
+    }
+
     // Trivial relocation, as the kernel handles its internal relocations:
-    // move it to the relevant memory address.
-    return memmove((void *)load_addr, kernel, size);
+    // move it to the relevant memory address. If we've woken any secondary
+    // cores, they'll share the work.
+    return smp_memmove((void *)load_addr, kernel, size);
+}
+
+
+/**
+ * The compressed kernel formats we can boot directly.
+ */
+struct kernel_decompressor {
+    const char *name;
+
+    int (*is_compressed)(const void *src, size_t src_size);
+
+    // Returns 0 if the size isn't recorded in the compressed stream.
+    size_t (*uncompressed_size)(const void *src, size_t src_size);
+
+    int (*decompress_prefix)(void *dest, size_t length, const void *src, size_t src_size);
+    int (*decompress)(void *dest, size_t dest_size, const void *src, size_t src_size, size_t *out_length);
+};
+
+static const struct kernel_decompressor kernel_decompressors[] = {
+    { "gzip", gunzip_is_gzip, gunzip_uncompressed_size, gunzip_prefix, gunzip },
+    { "lz4", lz4_is_lz4, lz4_content_size, lz4_decompress_prefix, lz4_decompress },
+};
+
+
+/**
+ * Finds the decompressor for a compressed kernel.
+ *
+ * @return The relevant decompressor, or NULL if the kernel isn't compressed
+ *    in a format we understand.
+ */
+const struct kernel_decompressor *find_kernel_decompressor(const void *kernel, size_t size)
+{
+    int i;
+
+    for(i = 0; i < sizeof(kernel_decompressors) / sizeof(*kernel_decompressors); ++i)
+        if(kernel_decompressors[i].is_compressed(kernel, size))
+            return &kernel_decompressors[i];
+
+    return NULL;
+}
+
+
+/**
+ * Decompresses a compressed Linux kernel (e.g. an Image.gz or Image.lz4)
+ * straight to the location it would have been relocated to, rather than
+ * staging an uncompressed copy first.
+ *
+ * @param decompressor The decompressor for the kernel's format.
+ * @param kernel The compressed kernel.
+ * @param size The size of the compressed kernel.
+ * @param start_of_ram The start of the RAM the kernel will be loaded into.
+ * @param digests The digests the compressed kernel should have.
+ * @return The address of the decompressed kernel.
+ */
+void * decompress_kernel(const struct kernel_decompressor *decompressor,
+    const void *kernel, size_t size, void *start_of_ram, const struct payload_digests *digests)
+{
+    uint64_t header[LINUX_IMAGE_HEADER_BYTES / sizeof(uint64_t)];
+    size_t uncompressed_size, produced;
+    uintptr_t load_addr;
+    int rc;
+
+    // Make sure we're not about to feed a damaged stream to the decompressor.
+    verify_payload_digests("kernel", kernel, size, digests);
+
+    // We need the kernel's header to know where it goes, so decompress just that first.
+    rc = decompressor->decompress_prefix(header, sizeof(header), kernel, size);
+    if(rc)
+        panic("Could not read the compressed kernel's header!");
+
+    load_addr = (uintptr_t)start_of_ram + header[1];
+
+    // Not every format records its uncompressed size (e.g. legacy LZ4 doesn't);
+    // if ours doesn't, fall back to the kernel's own idea of its image size.
+    uncompressed_size = decompressor->uncompressed_size(kernel, size);
+    if(!uncompressed_size)
+        uncompressed_size = header[2];
+    if(!uncompressed_size)
+        panic("Could not determine the size of the compressed kernel!");
+
+    printf("\n\nDecompressing %s hardware domain kernel to %p...\n", decompressor->name, load_addr);
+    printf("  compressed size:                       0x%p\n", size);
+    printf("  uncompressed size:                     0x%p\n", uncompressed_size);
+
+    // The compressed image is read as the kernel is written, so they can't overlap.
+    if((load_addr < (uintptr_t)kernel + size) && ((uintptr_t)kernel < load_addr + uncompressed_size))
+        panic("The compressed kernel overlaps its own load address!");
+
+    // As in relocate_kernel, discard any stale lines for the destination.
+    smp_discard_cache_region((void *)load_addr, uncompressed_size);
+
+    rc = decompressor->decompress((void *)load_addr, uncompressed_size, kernel, size, &produced);
+    printf("  decompression:                         %s (%d)\n", rc == SUCCESS ? "OK" : "FAILED", rc);
+    if(rc)
+        panic("Could not decompress the kernel!");
+
+    return (void *)load_addr;
+}
+
+
+/**
+ * Works out the memory the kernel will occupy once it's been relocated or
+ * decompressed, including the BSS it'll clear for itself.
+ *
+ * @param decompressor The decompressor for the kernel's format, or NULL if
+ *    the kernel isn't compressed.
+ * @param kernel The kernel, as passed from the bootloader.
+ * @param size The size of the kernel, as passed from the bootloader.
+ * @param start_of_ram The start of the RAM the kernel will be loaded into.
+ * @param out_start Out argument; receives the kernel's load address.
+ * @param out_size Out argument; receives the size of the kernel's footprint.
+ */
+void find_kernel_footprint(const struct kernel_decompressor *decompressor, const void *kernel,
+    size_t size, void *start_of_ram, uintptr_t *out_start, size_t *out_size)
+{
+    uint64_t header[LINUX_IMAGE_HEADER_BYTES / sizeof(uint64_t)];
+
+    if(!decompressor)
+        memcpy(header, kernel, sizeof(header));
+    else if(decompressor->decompress_prefix(header, sizeof(header), kernel, size))
+        panic("Could not read the compressed kernel's header!");
+
+    *out_start = (uintptr_t)start_of_ram + header[1];
+
+    // Older kernels leave image_size zero; for those, the image itself is all
+    // we can account for.
+    *out_size = header[2];
+    if(!*out_size)
+        *out_size = decompressor ? decompressor->uncompressed_size(kernel, size) : size;
+}
+
+
+/**
+ * Finds the /chosen node of the FDT we'll pass to the next-stage kernel,
+ * adding one through the journal if the FDT doesn't have its own.
+ *
+ * @return The node's offset or journal handle, or an FDT error code.
+ */
+int find_or_add_chosen(void)
+{
+    if(fdt_index.chosen >= 0)
+        return fdt_index.chosen;
+
+    if(journal_chosen < 0)
+        journal_chosen = fdt_journal_add_subnode(&fdt_journal, 0, "chosen");
+
+    return journal_chosen;
+}
+
+
+/**
+ * Prints a single region from a placement plan.
+ */
+static void print_placement_region(const struct placement_region *region)
+{
+    int padding = (int)(38 - strlen(region->name));
+
+    if(placement_region_moves(region))
+        printf("  %s:%*s0x%p -> 0x%p\n", region->name, padding, "", region->start, region->destination);
+    else
+        printf("  %s:%*s0x%p (%s)\n", region->name, padding, "", region->start,
+            region->kind == PLACEMENT_RESIDENT ? "resident" : "in place");
+}
+
+
+/**
+ * Plans where each payload will be when the kernel is launched, and the order
+ * to move them in, so that no move overwrites anything we still need. The FDT
+ * isn't part of the plan: its final copy is built inside the stub before
+ * anything is moved.
+ *
+ * @param plan The plan to be populated.
+ * @param decompressor The decompressor for the kernel's format, or NULL if
+ *    the kernel isn't compressed.
+ * @param kernel The kernel, as passed from the bootloader.
+ * @param kernel_size The size of the kernel, as passed from the bootloader.
+ * @param start_of_ram The start of the RAM the kernel will be loaded into.
+ * @param out_kernel_region Out argument; receives the index of the kernel's region.
+ * @param out_ramdisk_region Out argument; receives the index of the
+ *    ramdisk's region, or an error code if there's no ramdisk.
+ */
+void plan_payload_placement(struct placement_plan *plan, const struct kernel_decompressor *decompressor,
+    const void *kernel, size_t kernel_size, void *start_of_ram, int *out_kernel_region, int *out_ramdisk_region)
+{
+    extern int lds_bfstub_start, lds_bss_end, el1_stack_end, lds_bfstub_end;
+
+    const struct payload *ramdisk = find_payload(&payloads, PAYLOAD_RAMDISK);
+    arena_mark_t mark = arena_mark();
+    struct region_set memory, reserved;
+    uintptr_t kernel_start;
+    size_t kernel_footprint;
+    int i, rc;
+
+    find_kernel_footprint(decompressor, kernel, kernel_size, start_of_ram, &kernel_start, &kernel_footprint);
+
+    // The stub, its stacks, and the arena (which holds the final FDT) are all
+    // in use until the kernel is launched.
+    placement_init(plan);
+    placement_add_resident(plan, "stub", (uintptr_t)&lds_bfstub_start,
+        (uintptr_t)&lds_bss_end - (uintptr_t)&lds_bfstub_start);
+    placement_add_resident(plan, "EL1 stack", (uintptr_t)&lds_bss_end,
+        (uintptr_t)&el1_stack_end - (uintptr_t)&lds_bss_end);
+    placement_add_resident(plan, "boot-time arena", (uintptr_t)&el1_stack_end,
+        (uintptr_t)&lds_bfstub_end - (uintptr_t)&el1_stack_end);
+
+    // Decompression reads the kernel as it writes it, so can't be done in place.
+    *out_kernel_region = placement_add_fixed(plan, "kernel", (uintptr_t)kernel, kernel_size,
+        kernel_start, kernel_footprint, !decompressor);
+
+    *out_ramdisk_region = -FDT_ERR_NOTFOUND;
+    if(ramdisk)
+        *out_ramdisk_region = placement_add_floating(plan, "ramdisk", (uintptr_t)ramdisk->location, ramdisk->size);
+
+    // Anything we do move has to go somewhere the FDT doesn't already claim.
+    rc = region_set_init(&memory, fdt_index.memory_count);
+    if(!rc)
+        rc = region_set_init(&reserved, 1);
+    if(!rc)
+        rc = read_memory_regions(&fdt_index, &memory);
+    if(!rc)
+        rc = read_reserved_regions(&fdt_index, &reserved);
+    if(!rc)
+        rc = region_set_subtract(&memory, &reserved);
+    if(!rc)
+        rc = placement_solve(plan, &memory, PAYLOAD_ALIGN);
+
+    arena_release(mark);
+
+    if(rc) {
+        printf("ERROR: Could not plan where our payloads go! (%s)\n", fdt_strerror(rc));
+        panic("Our payloads can't all fit in memory without overwriting each other!");
+    }
+
+    // Print everything that stays put, and then each move in the order it'll happen.
+    printf("\nPlanning payload placement...\n");
+    for(i = 0; i < plan->count; ++i)
+        if(!placement_region_moves(&plan->regions[i]))
+            print_placement_region(&plan->regions[i]);
+    for(i = 0; i < plan->move_count; ++i)
+        print_placement_region(&plan->regions[plan->moves[i]]);
+}
+
+
+/**
+ * Passes the bootloader's ramdisk on to the next-stage kernel, by pointing
+ * /chosen's initrd properties at where it'll be once our payloads are in
+ * place. Ramdisks can be very large, so the planner only moves one if it's
+ * in the way.
+ *
+ * @param plan The solved placement plan.
+ * @param ramdisk_region The index of the ramdisk's region, or an error code
+ *    if there's no ramdisk.
+ */
+void pass_ramdisk_to_kernel(const struct placement_plan *plan, int ramdisk_region)
+{
+    fdt64_t start, end;
+    int chosen;
+
+    if(ramdisk_region < 0)
+        return;
+
+    start = cpu_to_fdt64(plan->regions[ramdisk_region].destination);
+    end = cpu_to_fdt64(plan->regions[ramdisk_region].destination + plan->regions[ramdisk_region].size);
+
+    chosen = find_or_add_chosen();
+    if((chosen < 0) ||
+       fdt_journal_setprop(&fdt_journal, chosen, INITRD_NODE, &start, sizeof(start)) ||
+       fdt_journal_setprop(&fdt_journal, chosen, INITRD_END_NODE, &end, sizeof(end)))
+        panic("Could not tell the kernel where to find its ramdisk!");
+}
+
+
+/**
+ * Moves the ramdisk to the location the planner picked for it, checking it
+ * as it goes.
+ *
+ * @param ramdisk The ramdisk payload to be moved.
+ * @param destination The ramdisk's new location.
+ */
+void move_ramdisk(const struct payload *ramdisk, uintptr_t destination)
+{
+    uint32_t crc;
+
+    printf("\nMoving ramdisk out of the kernel's way, to 0x%p...\n", destination);
+
+    // As with the kernel, make sure we're reading what the bootloader wrote,
+    // and that no stale lines are left over the new copy.
+    smp_invalidate_cache_region(ramdisk->location, ramdisk->size);
+    smp_discard_cache_region((void *)destination, ramdisk->size);
+
+    if(ramdisk->digests.sha256) {
+        smp_memmove((void *)destination, ramdisk->location, ramdisk->size);
+        verify_payload_digests("ramdisk", (void *)destination, ramdisk->size, &ramdisk->digests);
+    } else if(ramdisk->digests.has_crc32c) {
+        smp_memmove_crc32c((void *)destination, ramdisk->location, ramdisk->size, &crc);
+        check_crc32c("ramdisk", crc, ramdisk->digests.crc32c);
+    } else {
+        smp_memmove((void *)destination, ramdisk->location, ramdisk->size);
+    }
+}
+
+
+/**
+ * Carries out a placement plan, moving (or decompressing) each payload into
+ * place in the order the planner chose. Payloads that stay put are checked
+ * where they are.
+ *
+ * @param plan The solved placement plan.
+ * @param kernel_region The index of the kernel's region.
+ * @param ramdisk_region The index of the ramdisk's region, or an error code
+ *    if there's no ramdisk.
+ * @param decompressor The decompressor for the kernel's format, or NULL.
+ * @param kernel The kernel, as passed from the bootloader.
+ * @param kernel_size The size of the kernel, as passed from the bootloader.
+ * @param start_of_ram The start of the RAM the kernel will be loaded into.
+ * @param kernel_digests The digests the kernel should have.
+ * @return The address of the loaded kernel.
+ */
+void *move_payloads(const struct placement_plan *plan, int kernel_region, int ramdisk_region,
+    const struct kernel_decompressor *decompressor, const void *kernel, size_t kernel_size,
+    void *start_of_ram, const struct payload_digests *kernel_digests)
+{
+    const struct payload *ramdisk = find_payload(&payloads, PAYLOAD_RAMDISK);
+    void *kernel_address = (void *)kernel;
+    int i;
+
+    if(!placement_region_moves(&plan->regions[kernel_region]))
+        verify_payload_digests("kernel", kernel, kernel_size, kernel_digests);
+
+    if(ramdisk && !placement_region_moves(&plan->regions[ramdisk_region]) &&
+       (ramdisk->digests.sha256 || ramdisk->digests.has_crc32c)) {
+        smp_invalidate_cache_region(ramdisk->location, ramdisk->size);
+        verify_payload_digests("ramdisk", ramdisk->location, ramdisk->size, &ramdisk->digests);
+    }
+
+    for(i = 0; i < plan->move_count; ++i) {
+        if(plan->moves[i] == ramdisk_region)
+            move_ramdisk(ramdisk, plan->regions[ramdisk_region].destination);
+        else if((plan->moves[i] == kernel_region) && decompressor)
+            kernel_address = decompress_kernel(decompressor, kernel, kernel_size, start_of_ram, kernel_digests);
+        else if(plan->moves[i] == kernel_region)
+            kernel_address = relocate_kernel(kernel, kernel_size, start_of_ram, kernel_digests);
+    }
+
+    return kernel_address;
+}
+
+
+/**
+ * Switches the kernel's device tree to one provided by a FIT. The bootloader's
+ * kernel command line is carried across; the FIT's tree is used otherwise
+ * as-is, so it must describe the system's memory itself.
+ *
+ * @param fdt The FIT's device tree, which must be accessible.
+ * @param size The size of the buffer holding the device tree.
+ */
+void adopt_fit_device_tree(const void *fdt, size_t size)
+{
+    arena_mark_t mark = arena_mark();
+    struct fdt_index index;
+    const char *bootargs = NULL;
+    int rc, chosen, bootargs_length = 0;
+
+    if(fdt_check_header(fdt) || (fdt_totalsize(fdt) > size)) {
+        printf("  FIT device tree is invalid; keeping the bootloader's.\n");
+        return;
+    }
+
+    rc = fdt_index_build(&index, fdt);
+    if(rc || !index.memory_count) {
+        printf("  FIT device tree has no memory nodes; keeping the bootloader's.\n");
+        arena_release(mark);
+        return;
+    }
+
+    if(fdt_index.chosen >= 0)
+        bootargs = fdt_index_getprop(&fdt_index, fdt_index.chosen, "bootargs", &bootargs_length);
+
+    // Nothing has been edited yet, so we can just start over with the new tree.
+    rc = fdt_journal_init(&fdt_journal, fdt);
+    if(rc != SUCCESS)
+        panic("Could not prepare to edit the FIT's device tree.");
+
+    fdt_index = index;
+    journal_chosen = -FDT_ERR_NOTFOUND;
+
+    if(bootargs) {
+        chosen = find_or_add_chosen();
+        if((chosen < 0) || fdt_journal_setprop(&fdt_journal, chosen, "bootargs", bootargs, bootargs_length))
+            panic("Could not carry the kernel command line over to the FIT's device tree.");
+    }
+
+    printf("  using FIT device tree at:              0x%p\n", fdt);
+    printf("  flattened device tree nodes:           %d\n", fdt_index.node_count);
+}
+
+
+/**
+ * If the kernel we were passed is really a FIT image, selects the FIT's
+ * configuration for this board, and swaps its subimages in for the payloads
+ * the bootloader passed. Subimages are used where they sit in the FIT.
+ *
+ * Any digests the bootloader gave for the kernel payload cover the FIT as a
+ * whole, and are checked before it's unpacked. Subimages with SHA-256 hash
+ * nodes are checked too: the ramdisk and device tree here, and the kernel as
+ * it's relocated.
+ *
+ * @param kernel_location In/out argument; the location of the kernel payload.
+ * @param kernel_size In/out argument; the size of the kernel payload.
+ * @param kernel_digests In/out argument; the digests the kernel payload
+ *    should have.
+ */
+void unpack_fit_image(void **kernel_location, size_t *kernel_size, struct payload_digests *kernel_digests)
+{
+    struct fit_configuration config;
+    struct payload_digests fdt_digests;
+    const char *board_compatible;
+    const void *kernel, *ramdisk, *fdt;
+    size_t ramdisk_size, fdt_size;
+    int rc, board_compatible_length;
+
+    if(!fit_is_fit(*kernel_location))
+        return;
+
+    printf("\nUnpacking FIT image...\n");
+    verify_payload_digests("FIT image", *kernel_location, *kernel_size, kernel_digests);
+
+    // Select the configuration that best matches the board we're running on.
+    board_compatible = fdt_index_getprop(&fdt_index, 0, "compatible", &board_compatible_length);
+    if(!board_compatible)
+        board_compatible_length = 0;
+
+    rc = fit_select_configuration(*kernel_location, *kernel_size, board_compatible,
+        board_compatible_length, &config);
+    if(rc)
+        panic("Could not find a usable configuration in the FIT image!");
+
+    printf("  configuration:                         %s\n", config.name);
+
+    rc = find_fit_subimage(&config, FIT_KERNEL, &kernel, kernel_size);
+    if(rc)
+        panic("Could not find the kernel in the FIT image's configuration!");
+
+    *kernel_location = (void *)kernel;
+    printf("  kernel resident at:                    0x%p\n", *kernel_location);
+    printf("  kernel size:                           0x%p\n", *kernel_size);
+    kernel_digests->sha256 = config.subimages[FIT_KERNEL].sha256;
+    kernel_digests->has_crc32c = false;
+
+    // We can only unpack the compression formats we'd accept as a bare kernel.
+    if(config.subimages[FIT_KERNEL].compression && !find_kernel_decompressor(*kernel_location, *kernel_size))
+        panic("The FIT image's kernel uses an unsupported compression format!");
+
+    // The FIT's ramdisk takes the place of any the bootloader passed.
+    // Any subimage we can't use would leave the configuration half-applied,
+    // so anything other than an absent subimage is fatal.
+    rc = find_fit_subimage(&config, FIT_RAMDISK, &ramdisk, &ramdisk_size);
+    if(rc && (rc != -FDT_ERR_NOTFOUND))
+        panic("Could not load the FIT image's ramdisk!");
+
+    if(!rc) {
+        struct payload *payload = (struct payload *)find_payload(&payloads, PAYLOAD_RAMDISK);
+
+        if(!payload && payloads.count < MAX_PAYLOADS)
+            payload = &payloads.entries[payloads.count++];
+
+        if(payload) {
+            payload->type = PAYLOAD_RAMDISK;
+            payload->location = (void *)ramdisk;
+            payload->size = ramdisk_size;
+            payload->node = config.subimages[FIT_RAMDISK].node;
+
+            printf("  ramdisk resident at:                   0x%p\n", payload->location);
+            printf("  ramdisk size:                          0x%p\n", payload->size);
+
+            // Check the ramdisk while the FIT is still fresh in our minds;
+            // there's no need to check it again when it's passed on.
+            payload->digests.sha256 = config.subimages[FIT_RAMDISK].sha256;
+            payload->digests.has_crc32c = false;
+            verify_payload_digests("ramdisk", ramdisk, ramdisk_size, &payload->digests);
+            payload->digests.sha256 = NULL;
+        }
+    }
+
+    // If the FIT carries a device tree for this board, use it instead.
+    rc = find_fit_subimage(&config, FIT_FDT, &fdt, &fdt_size);
+    if(rc == -FDT_ERR_NOTFOUND)
+        return;
+    if(rc)
+        panic("Could not load the FIT image's device tree!");
+
+    fdt_digests.sha256 = config.subimages[FIT_FDT].sha256;
+    fdt_digests.has_crc32c = false;
+    verify_payload_digests("device tree", fdt, fdt_size, &fdt_digests);
+
+    if(config.subimages[FIT_FDT].compression)
+        printf("  FIT device tree is compressed; keeping the bootloader's.\n");
+    else
+        adopt_fit_device_tree(fdt, fdt_size);
 }
 
 
@@ -142,53 +840,50 @@ void launch_kernel(const void *kernel, const void *fdt)
     }
 
     printf("Launching hardware domain kernel...\n");
+
+    // Linux expects nothing of ours to be left in the cache when it starts.
+    // Our secondaries are parked, so this is the one place a whole-cache
+    // sweep is safe-- and cheaper than cleaning everything we wrote by address.
+    __clean_invalidate_dcache_all();
+
     target_kernel(fdt);
 }
 
 /**
  * Locates an image already loaded by the previous-stage bootloader from the
- * FDT provided by that bootloader.
+ * table of payloads it provided.
  *
- * @param fdt The FDT passed from the previous-stage bootloader.
- * @param path The path to look for the given image.
- *    TODO: replace this with a compatible string, and search for it
+ * @param payloads The payloads passed from the previous-stage bootloader.
+ * @param type The type of image to look for.
  * @param description String description of the image, for error messages.
  * @param out_location Out argument; if non-null, will be populated with the
  *    starting location of the relevant image.
  * @param out_size Out argument; if non-null, will be populated with the
  */
-int find_image_verbosely(void *fdt, const char *path, const char *description,
-        void ** out_kernel_location, size_t *out_kernel_size)
+int find_image_verbosely(const struct payload_table *payloads, enum payload_type type,
+        const char *description, void ** out_kernel_location, size_t *out_kernel_size)
 {
-    int kernel_node, rc;
+    const struct payload *image;
 
     printf("\nFinding %s image...\n", description);
 
-    // FIXME: Currently, for this early code, we assume the module paths
-    // as passed by Discharge-- but for later code, we'll want to filter
-    // through all of the nodes in the FDT and search for the appropriate
-    // compatible strings. See Xen's early boot for an example of how to do this.
-    kernel_node = find_node(fdt, path);
-    if (kernel_node < 0) {
-        printf("ERROR: Could not locate the %s image! (%d)\n", description, -kernel_node);
+    image = find_payload(payloads, type);
+    if (!image) {
+        printf("ERROR: Could not locate the %s image! (%d)\n", description, FDT_ERR_NOTFOUND);
         printf("Did the previous stage bootloader not provide it?\n");
-        return -kernel_node;
+        return FDT_ERR_NOTFOUND;
     }
 
     // Print where we found the image description in the FDT.
-    printf("  image information found at offset:     %d\n", kernel_node);
-
-    // Read the size of the location and size of the kernel.
-    rc = get_image_extents(fdt, kernel_node, "kernel", out_kernel_location, out_kernel_size);
-    if(rc != SUCCESS) {
-        printf("ERROR: Could not locate the %s image! (%d)", description, rc);
-    }
+    printf("  image information found at offset:     %d\n", image->node);
 
     // Printt the arguments we're fetching.
     if(out_kernel_location) {
+        *out_kernel_location = image->location;
         printf("  image resident at:                     0x%p\n", *out_kernel_location);
     }
     if(out_kernel_size) {
+        *out_kernel_size = image->size;
         printf("  image size:                            0x%p\n", *out_kernel_size);
     }
 
@@ -196,6 +891,120 @@ int find_image_verbosely(void *fdt, const char *path, const char *description,
 }
 
 
+/**
+ * Finds the highest aligned address at which the whole stub fits in free RAM.
+ *
+ * @param memory A normalized set of the RAM we're free to use.
+ * @param busy The regions the stub must stay clear of.
+ * @param busy_count The number of busy regions.
+ * @param size The size of the stub, including its stacks and arena.
+ * @return The address for the stub, or 0 if it doesn't fit anywhere.
+ */
+uintptr_t find_top_of_ram_for_stub(const struct region_set *memory, const struct mem_region *busy,
+    int busy_count, size_t size)
+{
+    uint64_t top, candidate;
+    int i, j, clear;
+
+    // Work down from the top of each block of memory, skipping below anything
+    // that's in the way.
+    for(i = memory->count - 1; i >= 0; --i) {
+        top = memory->regions[i].start + memory->regions[i].size;
+
+        while(top >= memory->regions[i].start + size) {
+            candidate = (top - size) & ~(STUB_RELOCATION_ALIGN - 1);
+            if(candidate < memory->regions[i].start)
+                break;
+
+            clear = true;
+            for(j = 0; j < busy_count; ++j) {
+                if((candidate < busy[j].start + busy[j].size) && (busy[j].start < candidate + size)) {
+                    top = min(top, busy[j].start);
+                    clear = false;
+                }
+            }
+
+            if(clear)
+                return candidate;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Moves the stub to the top of RAM, so the memory we keep for ourselves
+ * doesn't split the kernel's memory map in two. If there's room, this
+ * continues in main_relocated in the moved copy, and doesn't return.
+ *
+ * We're linked position-independently, so moving ourselves only takes a copy
+ * and another pass over our relocations. Only the image up through our bss
+ * needs copying; our EL1 stack and arena don't hold anything yet.
+ *
+ * @param fdt The FDT passed in by the bootloader.
+ */
+void relocate_to_top_of_ram(void *fdt)
+{
+    extern int lds_bfstub_start, lds_bss_end, lds_bfstub_end;
+
+    uintptr_t start = (uintptr_t)&lds_bfstub_start;
+    size_t image_size = (uintptr_t)&lds_bss_end - start;
+    size_t size = (uintptr_t)&lds_bfstub_end - start;
+
+    arena_mark_t mark = arena_mark();
+    struct mem_region busy[MAX_PAYLOADS + 2];
+    struct payload_table table;
+    struct region_set memory, reserved;
+    struct fdt_index index;
+    uintptr_t destination = 0;
+    int i, rc, busy_count = 0;
+
+    printf("\nMoving stub to the top of RAM...\n");
+
+    // We don't have our EL1 machinery yet, so take a quick look at the FDT
+    // on our own. The arena is released before we move, so nothing we
+    // allocate here is left pointing into our old image.
+    if(!ensure_image_is_accessible(fdt) && !fdt_index_build(&index, fdt) &&
+       !region_set_init(&memory, index.memory_count) && !region_set_init(&reserved, 1) &&
+       !read_memory_regions(&index, &memory) && !read_reserved_regions(&index, &reserved) &&
+       !region_set_subtract(&memory, &reserved)) {
+
+        // Stay clear of ourselves, the FDT, and anything the bootloader passed us.
+        busy[busy_count++] = (struct mem_region){ start, size };
+        busy[busy_count++] = (struct mem_region){ (uintptr_t)fdt, fdt_totalsize(fdt) };
+
+        // If we can't account for every payload, we can't safely move at all.
+        rc = find_payloads(&index, &table);
+        if(rc == SUCCESS || rc == -FDT_ERR_NOTFOUND) {
+            for(i = 0; i < table.count; ++i)
+                busy[busy_count++] = (struct mem_region){ (uintptr_t)table.entries[i].location, table.entries[i].size };
+
+            destination = find_top_of_ram_for_stub(&memory, busy, busy_count, size);
+        }
+    }
+
+    arena_release(mark);
+
+    if(!destination) {
+        printf("  couldn't find room; staying at:        0x%p\n", start);
+        return;
+    }
+
+    printf("  stub moving from:                      0x%p\n", start);
+    printf("  stub moving to:                        0x%p\n", destination);
+
+    // Our caches are off, so make sure no stale lines can be written back
+    // over the copy, and that we fetch the new code rather than anything cached.
+    __invalidate_dcache_region((void *)destination, image_size);
+    memcpy((void *)destination, (void *)start, image_size);
+    _apply_relocations(destination);
+    __sync_icache_region((void *)destination, image_size);
+
+    _switch_to_relocated(fdt, destination);
+}
+
+
 /**
  * Core section of the Bareflank stub-- sets up the hypervisor from up in EL2.
  */
@@ -212,10 +1021,28 @@ void main(void *fdt)
         panic("The bareflank stub must be launched from EL2!");
     }
 
+    // If we've been asked to, get out of the way of the kernel's memory map
+    // before we set anything up that points into our image.
+    if(CONFIG_RELOCATE_TO_TOP_OF_RAM)
+        relocate_to_top_of_ram(fdt);
+
+    main_relocated(fdt);
+}
+
+
+/**
+ * Remainder of our EL2 setup, once the stub is running from where it'll stay.
+ */
+void main_relocated(void *fdt)
+{
     // Set up the vector table for EL2, so that the HVC instruction can be used
     // from EL1. This allows us to return to EL2 after starting the EL1 guest.
     set_vbar_el2(&el2_vector_table);
 
+    // Let EL1 use the FP/SIMD registers. Linux requires this of us, and our
+    // SHA-256 engine needs them to verify the kernel.
+    enable_fp_access_below_el2();
+
     // TODO:
     // Insert any setup you want done in EL2, here. For now, EL2 is set up
     // to do almost nothing-- it doesn't take control of any hardware,
@@ -236,6 +1063,10 @@ void main(void *fdt)
     // request a service from this EL2 stub by using the 'hvc' instruction, at
     // which point the EL2 handler in exceptions.c will be invoked.
     printf("\nSwitching to EL1...\n");
+
+    // Leave nothing EL2 wrote sitting in the cache as EL1 takes over.
+    __clean_invalidate_dcache_all();
+
     switch_to_el1(fdt);
 }
 
@@ -243,23 +1074,36 @@ void main(void *fdt)
  * Excludes the memory used by EL2 from the 'available memory' list to be passed
  * to the EL1 kernel. This asks it nicely not to trounce our physical memory. :)
  *
- * @param fdt The FDT to be patched.
+ * @param journal The journal to record our edits to the FDT in.
+ * @param index An index of the FDT to be patched.
  * @param out_start_of_ram Out argument. Retrieves the start of RAM.
  */
-int exclude_el2_memory_from_fdt(void *fdt, void **out_start_of_ram)
+int exclude_el2_memory_from_fdt(struct fdt_journal *journal, const struct fdt_index *index, void **out_start_of_ram)
 {
     // These symbols don't actually have a meaningful type-- instead,
     // we care about the locations at which the linker /placed/ these
     // symbols, which happen to be at the start and end of our memory allocation.
-    extern int lds_bfstub_start, lds_el2_bfstub_end;
+    extern int lds_resident_start, lds_el2_bfstub_end;
 
-    // Figure out the span of the stub's memory, including text/data/bss/el2 stack,
-    // but _not_ the EL1 stack, which we expect the target kernel to reclaim.
-    uintptr_t start_addr = (uintptr_t)&lds_bfstub_start;
+    // Figure out the span of the stub's resident region: the code and data EL2
+    // still needs at runtime, and the EL2 stack. Our boot-only code and data,
+    // and the EL1 stack, are all reclaimed by the target kernel.
+    uintptr_t start_addr = (uintptr_t)&lds_resident_start;
     uintptr_t end_addr = (uintptr_t)&lds_el2_bfstub_end;
 
-    // Patch our FDT to exclude the relevant memory address.
-    return update_fdt_to_exclude_memory(fdt, start_addr, end_addr, out_start_of_ram);
+    struct region_set exclusions;
+    int rc;
+
+    // Build the set of regions to be carved out. For now, this is just the stub
+    // itself, but any other memory we want to keep from Linux belongs here, too.
+    rc = region_set_init(&exclusions, 1);
+    if(!rc)
+        rc = region_set_insert(&exclusions, start_addr, end_addr - start_addr);
+    if(rc)
+        return rc;
+
+    // Patch our FDT to exclude the relevant memory addresses.
+    return update_fdt_to_exclude_memory(journal, index, &exclusions, out_start_of_ram);
 }
 
 
@@ -271,7 +1115,10 @@ void main_el1(void * fdt)
 {
     int rc;
     size_t kernel_size;
+    int kernel_region, ramdisk_region;
     void *kernel_location, *start_of_ram;
+    const struct kernel_decompressor *decompressor;
+    struct payload_digests kernel_digests;
 
     // Read the currrent execution level...
     uint32_t el = get_current_el();
@@ -283,31 +1130,73 @@ void main_el1(void * fdt)
     }
 
     // Load the device tree.
-    load_device_tree(fdt);
+    load_device_tree(fdt, &fdt_index, CONFIG_LAZY_FDT_INVALIDATION ? &fdt_cache : NULL, &fdt_journal);
+
+    // If we're allowed to, wake the secondary cores to help with the heavy lifting.
+    smp_init(&fdt_index);
 
     // Find the kernel / ramdisk / etc. in the FDT we were passed.
-    rc = find_image_verbosely(fdt, "/module@0", "kernel", &kernel_location, &kernel_size);
+    rc = find_payloads(&fdt_index, &payloads);
+    if (rc == -FDT_ERR_NOSPACE) {
+        panic("The bootloader passed us more payloads than we can handle!");
+    } else if (rc) {
+        panic("The bootloader didn't pass us any payloads!");
+    }
+
+    rc = find_image_verbosely(&payloads, PAYLOAD_KERNEL, "kernel", &kernel_location, &kernel_size);
     if (rc) {
         panic("Could not find a kernel to launch!");
     }
+    kernel_digests = find_payload(&payloads, PAYLOAD_KERNEL)->digests;
+
+    // The bootloader may have left the kernel in the cache; make sure we can
+    // see it before we look inside it.
+    smp_invalidate_cache_region(kernel_location, kernel_size);
+
+    // If we were passed a FIT image, pull our payloads out of it.
+    unpack_fit_image(&kernel_location, &kernel_size, &kernel_digests);
 
     // Patch the FDT's memory nodes and remove the memory we're using.
     //  (This is necessary if we're not isolating ourself from EL1, and _not_
     //   necessary if we set up second-level page translation. If we set up
     //   second-level page translation, we'd need to synthesize a new FDT
     //   memory descripton that matches the guest-physical address space.)
-    rc = exclude_el2_memory_from_fdt(fdt, &start_of_ram);
+    rc = exclude_el2_memory_from_fdt(&fdt_journal, &fdt_index, &start_of_ram);
     if (rc) {
         panic("Could not exclude our stub's memory from the FDT!");
     }
 
+    // Work out where everything will go, and tell the kernel where its
+    // ramdisk will be once it's there.
+    decompressor = find_kernel_decompressor(kernel_location, kernel_size);
+    plan_payload_placement(&placement, decompressor, kernel_location, kernel_size, start_of_ram,
+        &kernel_region, &ramdisk_region);
+    pass_ramdisk_to_kernel(&placement, ramdisk_region);
+
     // TODO:
-    // - Patch the FDT to remove the nodes we're consuming (e.g. kernel location)
-    //   and to pass in e.g. the ramdisk in the place where it should be.
+    // - Patch the FDT to remove the nodes we're consuming (e.g. kernel location).
+
+    // Building the final copy reads the whole of the original FDT, so any
+    // parts of it we never needed must be made visible first.
+    lazy_cache_finish(&fdt_cache, smp_invalidate_cache_region);
+
+    // We're done editing the FDT; build the final copy for the kernel in a
+    // single pass. This lives in the stub, so our payloads are then free to
+    // move over the bootloader's copy.
+    rc = fdt_journal_serialize(&fdt_journal, final_fdt, sizeof(final_fdt));
+    if (rc) {
+        panic("Could not build the final device tree!");
+    }
+    fdt = final_fdt;
+
+    printf("\nFinal device tree at 0x%p (%d bytes).\n", fdt, fdt_totalsize(fdt));
+
+    // Move our next-stage (e.g. Linux) kernel and its ramdisk into place.
+    kernel_location = move_payloads(&placement, kernel_region, ramdisk_region, decompressor,
+        kernel_location, kernel_size, start_of_ram, &kernel_digests);
 
-    // Launch our next-stage (e.g. Linux) kernel.
-    __invalidate_cache_region(kernel_location, kernel_size);
-    kernel_location = relocate_kernel(kernel_location, kernel_size, start_of_ram);
+    // Hand back any secondary cores we borrowed, so Linux can bring them up.
+    smp_park_secondaries();
 
     launch_kernel(kernel_location, fdt);
 
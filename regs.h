@@ -37,6 +37,15 @@ inline static uint32_t get_current_el(void) {
     return val >> 2;
 }
 
+/**
+ * Returns the affinity information for the current core.
+ */
+inline static uint64_t get_mpidr(void) {
+    uint64_t val;
+    READ_SYSREG_64(mpidr_el1, val);
+    return val;
+}
+
 /**
  * Sets the base address of the EL2 exception table.
  */
@@ -53,6 +62,18 @@ inline static void set_elr_el2(void * address) {
 }
 
 
+/**
+ * Stops EL2 from trapping FP/SIMD accesses from lower ELs (CPTR_EL2.TFP).
+ */
+inline static void enable_fp_access_below_el2(void) {
+    uint64_t val;
+
+    READ_SYSREG_64(cptr_el2, val);
+    WRITE_SYSREG_64(cptr_el2, val & ~(1 << 10));
+    asm volatile("isb");
+}
+
+
 /**
  * Returns the MMU status bit from the SCTLR register.
  */
@@ -0,0 +1,692 @@
+/**
+ * Bareflank EL2 boot stub: secondary core support
+ * Allows the stub to borrow the system's secondary cores to speed up large
+ * boot-time jobs, and then hand them back before Linux starts.
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: Kate J. Temkin <k@ktemkin.com>
+ *
+ * <insert license here>
+ */
+
+#include <stdint.h>
+#include <microlib.h>
+
+#include <libfdt.h>
+#include <cache.h>
+#include <cache_topology.h>
+#include <crc32c.h>
+#include <config.h>
+
+#include "smp.h"
+#include "regs.h"
+
+/**
+ * PSCI 0.2+ function IDs; used when the FDT doesn't provide its own.
+ */
+#define PSCI_0_2_FN64_CPU_ON   0xC4000003
+#define PSCI_0_2_FN_CPU_OFF    0x84000002
+
+/**
+ * The MPIDR affinity fields; used to match cores to their FDT descriptions.
+ */
+#define MPIDR_HWID_MASK        0xff00ffffffULL
+
+/**
+ * Work queue tuning. Each worker gets a few chunks of each job, so a core
+ * that's late to the party doesn't leave everyone else waiting for long.
+ * Chunks are also sized in whole cache lines (and DC ZVA blocks); see
+ * smp_chunk_alignment.
+ */
+#define SMP_CHUNKS_PER_WORKER  4
+#define SMP_MIN_CHUNK_BYTES    (64 * 1024)
+#define SMP_MAX_JOBS           (CONFIG_MAX_CPUS * SMP_CHUNKS_PER_WORKER)
+
+/**
+ * The stack size given to each secondary core, and how long we're willing to
+ * wait for a core to come online before we give up on it.
+ */
+#define SMP_STACK_BYTES        4096
+#define SMP_ONLINE_TIMEOUT     10000000
+
+/**
+ * Special values for smp_cpu.worker.
+ */
+#define SMP_WORKER_PENDING     (-2)
+#define SMP_WORKER_NONE        (-1)
+
+/**
+ * The mechanisms by which a secondary core can be woken.
+ */
+enum smp_enable_method {
+    SMP_METHOD_NONE,
+    SMP_METHOD_PSCI,
+    SMP_METHOD_SPIN_TABLE,
+};
+
+/**
+ * Our bookkeeping for each secondary core.
+ */
+struct smp_cpu {
+    uint64_t mpidr;
+    enum smp_enable_method method;
+
+    // For spin-table cores: the address the core polls for its entry point.
+    volatile uint64_t *release_addr;
+
+    // The worker number the core uses to pick jobs off of the queue,
+    // or one of the SMP_WORKER_ special values.
+    volatile int worker;
+
+    // Set once we've asked the core to start; it may show up at any point after.
+    int started;
+
+    volatile int online;
+    volatile int parked;
+};
+
+/**
+ * Entry points for secondary cores; implemented in assembly in entry.S.
+ */
+extern uint64_t _secondary_entry;
+void _secondary_park(volatile uint64_t *release_addr, uintptr_t el2_stack_top,
+        volatile int *parked) __attribute__((noreturn));
+void _secondary_off(uint64_t cpu_off_function, volatile int *parked) __attribute__((noreturn));
+
+/**
+ * Information shared with the secondary entry point in entry.S, which uses
+ * it to find each core's stack.
+ */
+int smp_secondary_count;
+uint64_t smp_secondary_mpidrs[CONFIG_MAX_CPUS];
+uintptr_t smp_secondary_stack_tops[CONFIG_MAX_CPUS];
+
+/**
+ * Per-core stacks. The EL2 stacks are only used by spin-table cores, which
+ * we drop to EL1 ourselves before handing them to Linux. Those cores can take
+ * exceptions to EL2 long after boot, so their stacks stay resident.
+ */
+static uint8_t secondary_stacks[CONFIG_MAX_CPUS][SMP_STACK_BYTES] __attribute__((aligned(16)));
+static uint8_t secondary_el2_stacks[CONFIG_MAX_CPUS][SMP_STACK_BYTES]
+    __attribute__((section(".bss.resident"), aligned(16)));
+
+static struct smp_cpu secondaries[CONFIG_MAX_CPUS];
+
+/**
+ * PSCI function IDs, as determined from the FDT.
+ */
+static uint32_t psci_cpu_on, psci_cpu_off;
+
+/**
+ * The work queue itself. Jobs are handed out round-robin: worker N handles
+ * every job whose index is N modulo the number of workers. This means no core
+ * ever has to perform an atomic read-modify-write-- which matters, as we're
+ * running with the MMU off, where exclusive accesses aren't guaranteed to work.
+ */
+static struct smp_job job_queue[SMP_MAX_JOBS];
+static volatile size_t job_count;
+static volatile uint64_t batch_generation;
+static volatile uint64_t completed_generation[CONFIG_MAX_CPUS];
+static volatile int worker_count = 1;
+static volatile int park_requested;
+
+
+static inline void dsb(void)
+{
+    asm volatile("dsb sy" ::: "memory");
+}
+
+static inline void sev(void)
+{
+    asm volatile("sev" ::: "memory");
+}
+
+static inline void wfe(void)
+{
+    asm volatile("wfe" ::: "memory");
+}
+
+
+/**
+ * Ensures that data we've written is visible to cores that may be running
+ * with their caches off, and then wakes any cores waiting on it.
+ */
+static void smp_publish(const volatile void *addr, size_t length)
+{
+    dsb();
+    __invalidate_cache_region((const void *)addr, length);
+    dsb();
+    sev();
+}
+
+
+/**
+ * Ensures we'll see the latest copy of a value written by another core.
+ */
+static void smp_refresh(const volatile void *addr)
+{
+    __invalidate_cache_line((const void *)addr);
+    dsb();
+}
+
+
+/**
+ * Issues a PSCI call via the SMC conduit.
+ */
+static int64_t psci_call(uint64_t function, uint64_t arg0, uint64_t arg1, uint64_t arg2)
+{
+    int64_t result;
+
+    asm volatile(
+          "mov x0, %1\n\t"
+          "mov x1, %2\n\t"
+          "mov x2, %3\n\t"
+          "mov x3, %4\n\t"
+          "smc #0\n\t"
+          "mov %0, x0\n\t"
+          : "=r" (result)
+          : "r" (function), "r" (arg0), "r" (arg1), "r" (arg2)
+          : "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9",
+            "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17", "memory"
+    );
+
+    return result;
+}
+
+
+/**
+ * Reads a big-endian value made up of one or two FDT cells.
+ */
+static uint64_t read_cells(const fdt32_t *cells, int count)
+{
+    uint64_t value = 0;
+
+    while(count--) {
+        value = (value << 32ULL) | fdt32_to_cpu(*cells);
+        ++cells;
+    }
+
+    return value;
+}
+
+
+/**
+ * Figures out how we're allowed to call PSCI, if the platform supports it.
+ */
+static void smp_find_psci(const struct fdt_index *index)
+{
+    const void *fdt = index->fdt;
+    const char *method;
+    const fdt32_t *function_id;
+    int node = index->psci, length;
+
+    if(node < 0)
+        return;
+
+    // We own EL2, so we can only reach firmware that lives in EL3.
+    method = fdt_index_getprop(index, node, "method", &length);
+    if(!method || !fdt_stringlist_contains(method, length, "smc")) {
+        printf("  PSCI conduit is not 'smc'; not using PSCI.\n");
+        return;
+    }
+
+    // PSCI 0.2 and later use fixed function IDs...
+    if(!fdt_node_check_compatible(fdt, node, "arm,psci-0.2") ||
+       !fdt_node_check_compatible(fdt, node, "arm,psci-1.0")) {
+        psci_cpu_on  = PSCI_0_2_FN64_CPU_ON;
+        psci_cpu_off = PSCI_0_2_FN_CPU_OFF;
+        return;
+    }
+
+    // ... while PSCI 0.1 tells us its IDs in the FDT.
+    function_id = fdt_index_getprop(index, node, "cpu_on", NULL);
+    if(function_id)
+        psci_cpu_on = fdt32_to_cpu(*function_id);
+
+    function_id = fdt_index_getprop(index, node, "cpu_off", NULL);
+    if(function_id)
+        psci_cpu_off = fdt32_to_cpu(*function_id);
+}
+
+
+/**
+ * Populates our secondary core table from the FDT's /cpus node.
+ */
+static int smp_discover_cpus(const struct fdt_index *index)
+{
+    const void *fdt = index->fdt;
+    int cpus_node = index->cpus, node, address_cells, length;
+    uint64_t boot_mpidr = get_mpidr() & MPIDR_HWID_MASK;
+
+    if(cpus_node < 0)
+        return cpus_node;
+
+    address_cells = fdt_address_cells(fdt, cpus_node);
+    if(address_cells < 1 || address_cells > 2)
+        return -FDT_ERR_BADNCELLS;
+
+    for(node = fdt_first_subnode(fdt, cpus_node); node >= 0; node = fdt_next_subnode(fdt, node)) {
+        struct smp_cpu *cpu = &secondaries[smp_secondary_count];
+        const char *device_type, *enable_method;
+        const fdt32_t *reg, *release_addr;
+
+        // Skip anything that isn't a core, like the cpu-map.
+        device_type = fdt_index_getprop(index, node, "device_type", &length);
+        if(!device_type || !fdt_stringlist_contains(device_type, length, "cpu"))
+            continue;
+
+        reg = fdt_index_getprop(index, node, "reg", &length);
+        if(!reg || length < address_cells * sizeof(*reg))
+            continue;
+
+        // The boot core is already busy.
+        cpu->mpidr = read_cells(reg, address_cells) & MPIDR_HWID_MASK;
+        if(cpu->mpidr == boot_mpidr)
+            continue;
+
+        if(smp_secondary_count + 1 >= CONFIG_MAX_CPUS) {
+            printf("  more cores than CONFIG_MAX_CPUS; leaving the rest asleep.\n");
+            break;
+        }
+
+        // Figure out how the core wants to be woken.
+        cpu->method = SMP_METHOD_NONE;
+        enable_method = fdt_index_getprop(index, node, "enable-method", &length);
+        if(enable_method && fdt_stringlist_contains(enable_method, length, "psci")) {
+            if(psci_cpu_on)
+                cpu->method = SMP_METHOD_PSCI;
+        } else if(enable_method && fdt_stringlist_contains(enable_method, length, "spin-table")) {
+            release_addr = fdt_index_getprop(index, node, "cpu-release-addr", &length);
+            if(release_addr && length == sizeof(uint64_t)) {
+                cpu->release_addr = (volatile uint64_t *)read_cells(release_addr, 2);
+                cpu->method = SMP_METHOD_SPIN_TABLE;
+            }
+        }
+
+        if(cpu->method == SMP_METHOD_NONE)
+            continue;
+
+        smp_secondary_mpidrs[smp_secondary_count] = cpu->mpidr;
+        ++smp_secondary_count;
+    }
+
+    return SUCCESS;
+}
+
+
+/**
+ * Wakes a single secondary core, and waits for it to check in.
+ */
+static void smp_wake_cpu(int slot)
+{
+    struct smp_cpu *cpu = &secondaries[slot];
+    uintptr_t entry = (uintptr_t)&_secondary_entry;
+    int64_t rc;
+    int i;
+
+    // Give the core a stack, and then tell it to start.
+    cpu->worker = SMP_WORKER_PENDING;
+    smp_secondary_stack_tops[slot] = (uintptr_t)secondary_stacks[slot] + SMP_STACK_BYTES;
+    smp_publish(cpu, sizeof(*cpu));
+    smp_publish(&smp_secondary_stack_tops[slot], sizeof(smp_secondary_stack_tops[slot]));
+
+    switch(cpu->method) {
+
+        case SMP_METHOD_PSCI:
+            rc = psci_call(psci_cpu_on, cpu->mpidr, entry, slot);
+            if(rc) {
+                printf("  core 0x%x refused to start (PSCI error %d)\n", cpu->mpidr, rc);
+                cpu->worker = SMP_WORKER_NONE;
+                return;
+            }
+            break;
+
+        case SMP_METHOD_SPIN_TABLE:
+            *cpu->release_addr = entry;
+            smp_publish(cpu->release_addr, sizeof(*cpu->release_addr));
+            break;
+
+        default:
+            cpu->worker = SMP_WORKER_NONE;
+            return;
+    }
+
+    cpu->started = 1;
+
+    // Wait for the core to check in. If it doesn't, we'll carry on without it;
+    // it'll park itself if it shows up late.
+    for(i = 0; i < SMP_ONLINE_TIMEOUT; ++i) {
+        smp_refresh(&cpu->online);
+        if(cpu->online)
+            break;
+    }
+
+    if(cpu->online) {
+        cpu->worker = worker_count;
+        ++worker_count;
+    } else {
+        printf("  core 0x%x never came online; continuing without it\n", cpu->mpidr);
+        cpu->worker = SMP_WORKER_NONE;
+    }
+
+    smp_publish(&cpu->worker, sizeof(cpu->worker));
+}
+
+
+/**
+ * Discovers the system's secondary cores from the FDT, and wakes any that
+ * can be used to help with boot-time work. Does nothing unless the stub was
+ * built with CONFIG_PARALLEL_BOOT.
+ *
+ * @param index An index of the FDT passed from the previous-stage bootloader.
+ * @return The number of cores available for work, including the boot core.
+ */
+int smp_init(const struct fdt_index *index)
+{
+    int rc, slot;
+
+    if(!CONFIG_PARALLEL_BOOT)
+        return worker_count;
+
+    printf("\nWaking secondary cores...\n");
+
+    smp_find_psci(index);
+    rc = smp_discover_cpus(index);
+    if(rc) {
+        printf("  could not read the system's cores (%s); continuing on one core.\n", fdt_strerror(rc));
+        return worker_count;
+    }
+
+    smp_publish(&smp_secondary_count, sizeof(smp_secondary_count));
+    smp_publish(smp_secondary_mpidrs, sizeof(smp_secondary_mpidrs));
+
+    for(slot = 0; slot < smp_secondary_count; ++slot)
+        smp_wake_cpu(slot);
+
+    printf("  cores available for boot work:         %d\n", worker_count);
+    return worker_count;
+}
+
+
+/**
+ * Performs a single job from the work queue.
+ */
+static void smp_run_job(struct smp_job *job)
+{
+    switch(job->type) {
+        case SMP_JOB_COPY:
+            memmove(job->dest, job->src, job->length);
+            break;
+        case SMP_JOB_INVALIDATE:
+            __invalidate_cache_region(job->dest, job->length);
+            break;
+        case SMP_JOB_DISCARD:
+            __invalidate_dcache_region(job->dest, job->length);
+            break;
+        case SMP_JOB_COPY_CRC32C:
+            job->crc = crc32c_copy(0, job->dest, job->src, job->length);
+            smp_publish(&job->crc, sizeof(job->crc));
+            break;
+    }
+}
+
+
+/**
+ * Performs each of the jobs in the current batch that belong to the given worker.
+ */
+static void smp_run_jobs(int worker)
+{
+    size_t i;
+
+    for(i = worker; i < job_count; i += worker_count)
+        smp_run_job(&job_queue[i]);
+}
+
+
+/**
+ * Main loop for each secondary core; called from _secondary_entry.
+ *
+ * @param slot The core's index in our secondary core table.
+ */
+void smp_secondary_main(int slot)
+{
+    struct smp_cpu *cpu = &secondaries[slot];
+    uint64_t seen = 0;
+
+    // Check in with the boot core, and wait for it to decide if we're helping.
+    cpu->online = 1;
+    smp_publish(&cpu->online, sizeof(cpu->online));
+
+    do {
+        wfe();
+        smp_refresh(&cpu->worker);
+    } while(cpu->worker == SMP_WORKER_PENDING);
+
+    // Work through each batch as it's posted, until we're asked to park.
+    while(cpu->worker != SMP_WORKER_NONE) {
+        smp_refresh(&batch_generation);
+        smp_refresh(&park_requested);
+
+        if(park_requested)
+            break;
+
+        if(batch_generation == seen) {
+            wfe();
+            continue;
+        }
+
+        seen = batch_generation;
+        smp_refresh(&job_count);
+        smp_run_jobs(cpu->worker);
+
+        completed_generation[cpu->worker] = seen;
+        smp_publish(&completed_generation[cpu->worker], sizeof(completed_generation[0]));
+    }
+
+    // Return to our parking state. For PSCI, that's off; for a spin table,
+    // we provide our own pen, as the firmware's is gone.
+    //
+    // The kernel may reclaim our boot-time code and data as soon as we report
+    // that we're parked, so everything we need is passed in registers, and the
+    // resident code makes that report as the last thing it does. A PSCI 0.1
+    // node without a cpu_off ID leaves us no way to turn off; _secondary_off
+    // then sleeps somewhere the kernel won't reclaim.
+    if(cpu->method == SMP_METHOD_PSCI)
+        _secondary_off(psci_cpu_off, &cpu->parked);
+
+    *cpu->release_addr = 0;
+    smp_publish(cpu->release_addr, sizeof(*cpu->release_addr));
+    _secondary_park(cpu->release_addr, (uintptr_t)secondary_el2_stacks[slot] + SMP_STACK_BYTES,
+        &cpu->parked);
+}
+
+
+/**
+ * Returns the granule each chunk's size should be a multiple of. Splitting
+ * jobs on cache line boundaries keeps two cores from maintaining the same
+ * line.
+ */
+static size_t smp_chunk_alignment(void)
+{
+    return cache_topology()->dcache_max_line_bytes;
+}
+
+
+/**
+ * Splits a job into chunks, and has all available cores work through them.
+ * Returns once every chunk is complete.
+ */
+static void smp_run_batch(enum smp_job_type type, void *dest, const void *src, size_t length)
+{
+    size_t chunk, offset, count = 0, alignment = smp_chunk_alignment();
+    size_t target_jobs = worker_count * SMP_CHUNKS_PER_WORKER;
+    uint64_t generation;
+    int worker;
+
+    // Pick a chunk size that gives each worker a few chunks. Rounding up
+    // (rather than down) guarantees we never need more than target_jobs
+    // chunks, so the whole region always fits in the job queue.
+    chunk = (length + target_jobs - 1) / target_jobs;
+    chunk = (chunk + alignment - 1) & ~(alignment - 1);
+    chunk = max(chunk, (size_t)SMP_MIN_CHUNK_BYTES);
+
+    for(offset = 0; offset < length && count < SMP_MAX_JOBS; offset += chunk, ++count) {
+        struct smp_job *job = &job_queue[count];
+
+        job->type   = type;
+        job->dest   = (char *)dest + offset;
+        job->src    = src ? (const char *)src + offset : NULL;
+        job->length = min(chunk, length - offset);
+    }
+
+    // Dropping the tail of a copy would silently corrupt whatever we're moving.
+    if(offset < length)
+        panic("SMP batch did not cover its whole region!");
+
+    // Post the batch...
+    job_count = count;
+    generation = batch_generation + 1;
+    smp_publish(job_queue, sizeof(job_queue));
+    smp_publish(&job_count, sizeof(job_count));
+
+    batch_generation = generation;
+    smp_publish(&batch_generation, sizeof(batch_generation));
+
+    // ... do our share of it...
+    smp_run_jobs(0);
+
+    // ... and wait for everyone else to finish theirs.
+    for(worker = 1; worker < worker_count; ++worker) {
+        while(1) {
+            smp_refresh(&completed_generation[worker]);
+            if(completed_generation[worker] == generation)
+                break;
+            wfe();
+        }
+    }
+}
+
+
+/**
+ * Moves a block of memory, splitting the work across all available cores
+ * when the source and destination don't overlap.
+ */
+void *smp_memmove(void *dest, const void *src, size_t length)
+{
+    const char *dest_byte = dest;
+    const char *src_byte = src;
+
+    // Overlapping moves have to happen in order, so we can't split them up.
+    int overlaps = (dest_byte < src_byte + length) && (src_byte < dest_byte + length);
+
+    if((worker_count == 1) || overlaps || (length < 2 * SMP_MIN_CHUNK_BYTES))
+        return memmove(dest, src, length);
+
+    smp_run_batch(SMP_JOB_COPY, dest, src, length);
+    return dest;
+}
+
+
+/**
+ * Moves a block of memory, computing the CRC-32C of the data as it's copied.
+ */
+void *smp_memmove_crc32c(void *dest, const void *src, size_t length, uint32_t *out_crc)
+{
+    const char *dest_byte = dest;
+    const char *src_byte = src;
+    uint32_t crc = 0;
+    size_t i;
+
+    int overlaps = (dest_byte < src_byte + length) && (src_byte < dest_byte + length);
+
+    // The fused copy reads ahead of its writes, so it can only handle overlap
+    // when moving downwards; otherwise, copy first and checksum the result.
+    if(overlaps && (dest_byte > src_byte)) {
+        memmove(dest, src, length);
+        *out_crc = crc32c(0, dest, length);
+        return dest;
+    }
+
+    if((worker_count == 1) || overlaps || (length < 2 * SMP_MIN_CHUNK_BYTES)) {
+        *out_crc = crc32c_copy(0, dest, src, length);
+        return dest;
+    }
+
+    smp_run_batch(SMP_JOB_COPY_CRC32C, dest, src, length);
+
+    // Stitch the chunks' CRCs back together, in order.
+    for(i = 0; i < job_count; ++i) {
+        smp_refresh(&job_queue[i].crc);
+        crc = crc32c_combine(crc, job_queue[i].crc, job_queue[i].length);
+    }
+
+    *out_crc = crc;
+    return dest;
+}
+
+
+/**
+ * Invalidates the cache lines for a given region, splitting the work across
+ * all available cores.
+ */
+void smp_invalidate_cache_region(const void *addr, size_t length)
+{
+    if((worker_count == 1) || (length < 2 * SMP_MIN_CHUNK_BYTES)) {
+        __invalidate_cache_region(addr, length);
+        return;
+    }
+
+    smp_run_batch(SMP_JOB_INVALIDATE, (void *)addr, NULL, length);
+}
+
+
+/**
+ * Discards any cache lines for a given region without writing them back,
+ * splitting the work across all available cores.
+ */
+void smp_discard_cache_region(const void *addr, size_t length)
+{
+    if((worker_count == 1) || (length < 2 * SMP_MIN_CHUNK_BYTES)) {
+        __invalidate_dcache_region(addr, length);
+        return;
+    }
+
+    smp_run_batch(SMP_JOB_DISCARD, (void *)addr, NULL, length);
+}
+
+
+/**
+ * Returns each secondary core to its parking state, so it can later be
+ * brought up by the next-stage kernel. Must be called before Linux is
+ * launched if smp_init() was called.
+ */
+void smp_park_secondaries(void)
+{
+    int slot;
+
+    if(!smp_secondary_count)
+        return;
+
+    park_requested = 1;
+    smp_publish(&park_requested, sizeof(park_requested));
+
+    // Wait for every core we started to leave our boot-time code, so it's
+    // done with any memory Linux might reclaim. That includes cores that came
+    // online too late to help: they may still be on their way to parking.
+    for(slot = 0; slot < smp_secondary_count; ++slot) {
+        struct smp_cpu *cpu = &secondaries[slot];
+        int i;
+
+        if(!cpu->started)
+            continue;
+
+        for(i = 0; ; ++i) {
+            smp_refresh(&cpu->parked);
+            if(cpu->parked)
+                break;
+
+            if(i == SMP_ONLINE_TIMEOUT)
+                printf("  still waiting for core 0x%x to park...\n", cpu->mpidr);
+        }
+    }
+}
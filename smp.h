@@ -0,0 +1,85 @@
+/**
+ * Bareflank EL2 boot stub: secondary core support
+ * Allows the stub to borrow the system's secondary cores to speed up large
+ * boot-time jobs, and then hand them back before Linux starts.
+ *
+ * Copyright (C) Assured Information Security, Inc.
+ *      Author: Kate J. Temkin <k@ktemkin.com>
+ *
+ * <insert license here>
+ */
+
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#include <microlib.h>
+#include <fdt_index.h>
+
+/**
+ * The types of work that can be placed on the boot-time work queue.
+ */
+enum smp_job_type {
+    SMP_JOB_COPY,
+    SMP_JOB_INVALIDATE,
+    SMP_JOB_DISCARD,
+    SMP_JOB_COPY_CRC32C,
+};
+
+/**
+ * A single chunk of work for the boot-time work queue.
+ */
+struct smp_job {
+    enum smp_job_type type;
+    void *dest;
+    const void *src;
+    size_t length;
+
+    // Filled in by SMP_JOB_COPY_CRC32C jobs: the CRC-32C of the chunk.
+    uint32_t crc;
+};
+
+/**
+ * Discovers the system's secondary cores from the FDT, and wakes any that
+ * can be used to help with boot-time work. Does nothing unless the stub was
+ * built with CONFIG_PARALLEL_BOOT.
+ *
+ * @param index An index of the FDT passed from the previous-stage bootloader.
+ * @return The number of cores available for work, including the boot core.
+ */
+int smp_init(const struct fdt_index *index);
+
+/**
+ * Moves a block of memory, splitting the work across all available cores
+ * when the source and destination don't overlap.
+ */
+void *smp_memmove(void *dest, const void *src, size_t length);
+
+/**
+ * Moves a block of memory, computing the CRC-32C of the data as it's copied.
+ * Each core checksums its own chunks, and the results are combined.
+ *
+ * @param out_crc Out argument; receives the CRC-32C of the data.
+ */
+void *smp_memmove_crc32c(void *dest, const void *src, size_t length, uint32_t *out_crc);
+
+/**
+ * Invalidates the cache lines for a given region, splitting the work across
+ * all available cores.
+ */
+void smp_invalidate_cache_region(const void *addr, size_t length);
+
+/**
+ * Discards any cache lines for a given region without writing them back,
+ * splitting the work across all available cores. Cheaper than
+ * smp_invalidate_cache_region for regions we're about to overwrite.
+ */
+void smp_discard_cache_region(const void *addr, size_t length);
+
+/**
+ * Returns each secondary core to its parking state, so it can later be
+ * brought up by the next-stage kernel. Must be called before Linux is
+ * launched if smp_init() was called.
+ */
+void smp_park_secondaries(void);
+
+#endif
@@ -0,0 +1,198 @@
+/**
+ * Throughput benchmarks for the Discharge microlib "standard library" subsection.
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+
+/**
+ * The microlib routines under test. The benchmark build renames microlib's
+ * symbols (see the bench target in the Makefile), so they can live alongside
+ * the host libc's versions, which we compare against.
+ */
+extern "C" {
+    void *microlib_memcpy(void *dest, const void *src, size_t n);
+    void *microlib_memmove(void *dest, const void *src, size_t n);
+    void *microlib_memset(void *b, int c, size_t len);
+    int microlib_memcmp(const void *s1, const void *s2, size_t n);
+    void *microlib_memchr(const void *s, int c, size_t n);
+    size_t microlib_strnlen(const char *s, size_t max);
+}
+
+// The sizes we benchmark, from a handful of bytes up to a kernel-sized copy.
+static const size_t sizes[] = {
+    8, 64, 512, 4 * 1024, 32 * 1024, 256 * 1024,
+    2 * 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024,
+};
+
+// Offsets of the source and destination from a page boundary.
+static const size_t alignments[] = { 0, 1, 7 };
+
+// Each measurement repeats its operation until it's processed at least this
+// many bytes, so small sizes aren't lost in timer noise.
+static const size_t bytes_per_measurement = 16 * 1024 * 1024;
+
+// Keeps the compiler from discarding results we never otherwise look at.
+static volatile uintptr_t sink;
+
+/**
+ * A single benchmarked operation; given a buffer length, operates on the
+ * source and destination buffers.
+ */
+typedef std::function<void(uint8_t *dest, uint8_t *src, size_t length)> operation;
+
+/**
+ * A routine to be benchmarked, in both its microlib and libc forms.
+ */
+struct routine {
+    const char *name;
+    operation microlib;
+    operation libc;
+
+    // Prepares the buffers before each size is measured; e.g. so memchr
+    // has to scan the whole buffer.
+    std::function<void(uint8_t *dest, uint8_t *src, size_t length)> prepare;
+};
+
+
+/**
+ * Fills both buffers with identical, non-zero data.
+ */
+static void fill_identical(uint8_t *dest, uint8_t *src, size_t length)
+{
+    memset(src, 0x5a, length);
+    memset(dest, 0x5a, length);
+}
+
+
+/**
+ * Times a single operation, and writes the result as a line of CSV.
+ */
+static void measure(FILE *csv, const char *name, const char *implementation,
+    const operation &op, uint8_t *dest, uint8_t *src, size_t length, size_t alignment)
+{
+    size_t iterations = std::max((size_t)1, bytes_per_measurement / length);
+    size_t i;
+
+    // Warm up, so we're not measuring page faults.
+    op(dest, src, length);
+
+    auto start = std::chrono::steady_clock::now();
+    for(i = 0; i < iterations; ++i)
+        op(dest, src, length);
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double gbps = (double)length * iterations / seconds / 1e9;
+
+    fprintf(csv, "%s,%s,%zu,%zu,%zu,%.9f,%.3f\n", name, implementation, length,
+        alignment, iterations, seconds, gbps);
+    fflush(csv);
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t largest = sizes[sizeof(sizes) / sizeof(*sizes) - 1];
+    size_t page = 4096;
+    uint8_t *source_buffer, *dest_buffer;
+    FILE *csv = stdout;
+
+    const routine routines[] = {
+        { "memcpy",
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)microlib_memcpy(d, s, n); },
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)memcpy(d, s, n); },
+          fill_identical },
+        { "memmove",
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)microlib_memmove(d, s, n); },
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)memmove(d, s, n); },
+          fill_identical },
+        { "memset",
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)microlib_memset(d, 0, n); },
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)memset(d, 0, n); },
+          fill_identical },
+
+        // Compare identical buffers, so the whole length is compared.
+        { "memcmp",
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += microlib_memcmp(d, s, n); },
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += memcmp(d, s, n); },
+          fill_identical },
+
+        // Search for a byte that isn't there, so the whole buffer is searched.
+        { "memchr",
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)microlib_memchr(s, 0, n); },
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += (uintptr_t)memchr(s, 0, n); },
+          fill_identical },
+        { "strnlen",
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += microlib_strnlen((const char *)s, n); },
+          [](uint8_t *d, uint8_t *s, size_t n) { sink += strnlen((const char *)s, n); },
+          fill_identical },
+    };
+
+    if(argc > 1) {
+        csv = fopen(argv[1], "w");
+        if(!csv) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    // Leave room to misalign each buffer from its page.
+    if(posix_memalign((void **)&source_buffer, page, largest + page) ||
+       posix_memalign((void **)&dest_buffer, page, largest + page)) {
+        fprintf(stderr, "Could not allocate benchmark buffers.\n");
+        return 1;
+    }
+
+    fprintf(csv, "function,implementation,size,alignment,iterations,seconds,gbps\n");
+
+    for(const routine &r : routines) {
+        fprintf(stderr, "Benchmarking %s...\n", r.name);
+
+        for(size_t length : sizes) {
+            for(size_t alignment : alignments) {
+                uint8_t *src = source_buffer + alignment;
+                uint8_t *dest = dest_buffer + alignment;
+
+                r.prepare(dest, src, length);
+                measure(csv, r.name, "microlib", r.microlib, dest, src, length, alignment);
+
+                r.prepare(dest, src, length);
+                measure(csv, r.name, "libc", r.libc, dest, src, length, alignment);
+            }
+        }
+    }
+
+    if(csv != stdout)
+        fclose(csv);
+
+    free(source_buffer);
+    free(dest_buffer);
+    return 0;
+}
@@ -32,6 +32,46 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+
+/**
+ * Returns the number of bytes per data cache line.
+ */
+size_t __dcache_line_bytes(void)
+{
+    // Report a typical line size, so callers that track lines still work.
+    return 64;
+}
+
+
+/**
+ * Returns the number of bytes per instruction cache line.
+ */
+size_t __icache_line_bytes(void)
+{
+    return 64;
+}
+
+
+/*
+ * The range operations do nothing during testing, for the same reason as below.
+ */
+void __clean_dcache_all(void) {}
+void __clean_invalidate_dcache_all(void) {}
+void __clean_dcache_region(const void *addr, size_t length) {}
+void __invalidate_dcache_region(const void *addr, size_t length) {}
+void __clean_invalidate_dcache_region(const void *addr, size_t length) {}
+void __sync_icache_region(const void *addr, size_t length) {}
+
+
+/**
+ * Zeroes a region of memory.
+ */
+void *__zero_region(void *dest, size_t length)
+{
+    return memset(dest, 0, length);
+}
 
 
 /**
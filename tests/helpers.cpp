@@ -180,3 +180,19 @@ uint64_t FlattenedTree::read_property_u64(const char *node, const char *property
 
   return fdt64_to_cpu(*location);
 }
+
+
+/**
+ * Generates the pattern the compression tests' streams were made from.
+ *
+ * @param length The number of bytes to generate.
+ */
+std::vector<unsigned char> test_pattern(size_t length) {
+
+  std::vector<unsigned char> pattern(length);
+
+  for(size_t i = 0; i < length; ++i)
+    pattern[i] = ((i / 64) % 2) ? (((i * 7) ^ (i >> 3)) & 0xff) : ('a' + (i % 13));
+
+  return pattern;
+}
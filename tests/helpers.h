@@ -27,6 +27,34 @@
 #include <cstdlib>
 #include <fstream>
 
+extern "C" {
+  #include <arena.h>
+}
+
+/**
+ * Releases everything a test allocates from the boot-time arena once the
+ * test is done, so each test has the whole arena to itself.
+ */
+class ArenaScope {
+
+  public:
+
+      ArenaScope() : mark(arena_mark()) {}
+      ~ArenaScope() { arena_release(mark); }
+
+  private:
+      arena_mark_t mark;
+};
+
+/**
+ * Generates the pattern the compression tests' streams were made from:
+ * alternating 64-byte runs of repetitive text and of noisier bytes, so the
+ * compressors use both literals and back-references.
+ *
+ * @param length The number of bytes to generate.
+ */
+std::vector<unsigned char> test_pattern(size_t length);
+
 /**
  * Simple class that provides scoped-duration access to a binary file
  * in a C-friendly way. Mostly syntactic sugar.
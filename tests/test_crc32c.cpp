@@ -0,0 +1,96 @@
+/**
+ * Tests for CRC-32C
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include <crc32c.h>
+}
+
+/**
+ * Computes the CRC-32C of a string.
+ */
+static uint32_t crc32c_of(const std::string &data)
+{
+    return crc32c(0, data.data(), data.size());
+}
+
+
+SCENARIO("computing CRC-32C checksums", "[crc32c]") {
+    std::string data(5000, 'x');
+
+    for(size_t i = 0; i < data.size(); ++i)
+        data[i] = (i * 37) ^ (i >> 3);
+
+    WHEN("the standard check value is computed") {
+        THEN("the published CRC is produced") {
+            REQUIRE(crc32c_of("") == 0);
+            REQUIRE(crc32c_of("123456789") == 0xe3069283);
+            REQUIRE(crc32c_of(std::string(32, '\0')) == 0x8a9136aa);
+        }
+    }
+
+    WHEN("data is checksummed in pieces") {
+        THEN("chaining the CRCs matches checksumming it all at once") {
+            uint32_t crc = 0;
+
+            for(size_t offset = 0, piece = 1; offset < data.size(); offset += piece, piece = piece * 2 + 1)
+                crc = crc32c(crc, data.data() + offset, std::min(piece, data.size() - offset));
+
+            REQUIRE(crc == crc32c_of(data));
+        }
+
+        THEN("combining the CRCs of separate pieces matches checksumming it all at once") {
+            for(size_t split = 0; split <= data.size(); split += 777) {
+                uint32_t first = crc32c(0, data.data(), split);
+                uint32_t second = crc32c(0, data.data() + split, data.size() - split);
+
+                REQUIRE(crc32c_combine(first, second, data.size() - split) == crc32c_of(data));
+            }
+        }
+    }
+
+    WHEN("data is copied and checksummed at the same time") {
+        THEN("the copy is exact and the CRC is correct, whatever the alignment") {
+            std::vector<char> dest(data.size() + 16);
+
+            for(size_t src_offset = 0; src_offset < 8; src_offset += 3) {
+                for(size_t dest_offset = 0; dest_offset < 8; ++dest_offset) {
+                    size_t length = data.size() - src_offset;
+
+                    std::fill(dest.begin(), dest.end(), 0);
+
+                    REQUIRE(crc32c_copy(0, dest.data() + dest_offset, data.data() + src_offset, length) ==
+                        crc32c_of(data.substr(src_offset)));
+                    REQUIRE(std::equal(data.begin() + src_offset, data.end(), dest.begin() + dest_offset));
+                }
+            }
+        }
+    }
+}
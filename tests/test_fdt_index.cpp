@@ -0,0 +1,319 @@
+/**
+ * Tests for the FDT index
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+#include "helpers.h"
+
+#include <cstdio>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <fdt_index.h>
+}
+
+// The location of the test FDT to be indexed.
+static const char * indexed_fdt = "assets/test_fdt.dtb";
+
+
+/**
+ * Fills the given buffer with the full path of the given node.
+ */
+static void get_path(const void *fdt, int node, char *path, int length)
+{
+    REQUIRE(fdt_get_path(fdt, node, path, length) == 0);
+}
+
+
+SCENARIO("using the FDT index to look up nodes by path", "[fdt_index]") {
+    BinaryFile fdt_file(indexed_fdt);
+    ArenaScope arena;
+    void *fdt = fdt_file.raw_bytes();
+    struct fdt_index index;
+
+    REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+
+    WHEN("every node in the tree is looked up by its full path") {
+        THEN("each lookup matches fdt_path_offset") {
+            int node, depth = 0;
+            char path[512];
+
+            for(node = 0; (node >= 0) && (depth >= 0); node = fdt_next_node(fdt, node, &depth)) {
+                get_path(fdt, node, path, sizeof(path));
+                REQUIRE(fdt_index_path_offset(&index, path) == fdt_path_offset(fdt, path));
+            }
+        }
+    }
+
+    WHEN("a node is looked up without its unit address") {
+        THEN("the lookup matches fdt_path_offset") {
+            REQUIRE(fdt_index_path_offset(&index, "/memory") == fdt_path_offset(fdt, "/memory"));
+            REQUIRE(fdt_index_path_offset(&index, "/module") == fdt_path_offset(fdt, "/module"));
+        }
+    }
+
+    WHEN("a path that doesn't exist is looked up") {
+        THEN("the lookup fails with FDT_ERR_NOTFOUND") {
+            REQUIRE(fdt_index_path_offset(&index, "/not-a-node") == -FDT_ERR_NOTFOUND);
+        }
+    }
+
+    WHEN("the tree is indexed") {
+        THEN("the commonly-used nodes are recorded") {
+            REQUIRE(index.chosen == fdt_path_offset(fdt, "/chosen"));
+            REQUIRE(index.memory_count == 1);
+            REQUIRE(index.memory[0] == fdt_path_offset(fdt, "/memory"));
+        }
+
+        THEN("every possible payload node is recorded: /module, and each child of /chosen") {
+            int child, expected = 1;
+
+            for(child = fdt_first_subnode(fdt, index.chosen); child >= 0; child = fdt_next_subnode(fdt, child))
+                ++expected;
+
+            REQUIRE(index.payload_node_count == expected);
+            for(int i = 0; i < index.payload_node_count; ++i) {
+                int parent = fdt_parent_offset(fdt, index.payload_nodes[i]);
+
+                REQUIRE(index.payload_parents[i] == parent);
+                REQUIRE(((parent == 0) || (parent == index.chosen)));
+            }
+        }
+    }
+}
+
+
+SCENARIO("looking up nodes whose paths share a hash", "[fdt_index]") {
+    std::vector<char> buffer(4096);
+    void *fdt = buffer.data();
+    ArenaScope arena;
+    struct fdt_index index;
+
+    // "/jrnw" and "/2pba" have the same FNV-1a hash; so, then, do any paths
+    // that extend them in the same way.
+    REQUIRE(fdt_create(fdt, buffer.size()) == 0);
+    REQUIRE(fdt_finish_reservemap(fdt) == 0);
+    REQUIRE(fdt_begin_node(fdt, "") == 0);
+    REQUIRE(fdt_begin_node(fdt, "jrnw") == 0);
+    REQUIRE(fdt_begin_node(fdt, "serial@0") == 0);
+    REQUIRE(fdt_end_node(fdt) == 0);
+    REQUIRE(fdt_end_node(fdt) == 0);
+    REQUIRE(fdt_begin_node(fdt, "2pba") == 0);
+    REQUIRE(fdt_begin_node(fdt, "serial@0") == 0);
+    REQUIRE(fdt_end_node(fdt) == 0);
+    REQUIRE(fdt_end_node(fdt) == 0);
+    REQUIRE(fdt_end_node(fdt) == 0);
+    REQUIRE(fdt_finish(fdt) == 0);
+
+    REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+
+    WHEN("nodes with the same name are looked up under each colliding parent") {
+        THEN("each lookup finds the node at that path") {
+            REQUIRE(fdt_index_path_offset(&index, "/jrnw/serial@0") == fdt_path_offset(fdt, "/jrnw/serial@0"));
+            REQUIRE(fdt_index_path_offset(&index, "/2pba/serial@0") == fdt_path_offset(fdt, "/2pba/serial@0"));
+            REQUIRE(fdt_index_path_offset(&index, "/2pba/serial") == fdt_path_offset(fdt, "/2pba/serial"));
+            REQUIRE(fdt_index_path_offset(&index, "/2pba/serial@0") != fdt_path_offset(fdt, "/jrnw/serial@0"));
+        }
+    }
+
+}
+
+
+SCENARIO("using the FDT index to look up nodes by phandle", "[fdt_index]") {
+    BinaryFile fdt_file(indexed_fdt);
+    ArenaScope arena;
+    void *fdt = fdt_file.raw_bytes();
+    struct fdt_index index;
+
+    REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+
+    WHEN("every node with a phandle is looked up by that phandle") {
+        THEN("each lookup finds the original node") {
+            int node, depth = 0, found = 0;
+
+            for(node = 0; (node >= 0) && (depth >= 0); node = fdt_next_node(fdt, node, &depth)) {
+                uint32_t phandle = fdt_get_phandle(fdt, node);
+
+                if(!phandle)
+                    continue;
+
+                REQUIRE(fdt_index_node_offset_by_phandle(&index, phandle) == node);
+                ++found;
+            }
+
+            REQUIRE(found > 0);
+        }
+    }
+
+    WHEN("an invalid phandle is looked up") {
+        THEN("the lookup fails") {
+            REQUIRE(fdt_index_node_offset_by_phandle(&index, 0) == -FDT_ERR_BADPHANDLE);
+        }
+    }
+}
+
+
+SCENARIO("invalidating the FDT index", "[fdt_index]") {
+    BinaryFile fdt_file(indexed_fdt);
+    ArenaScope arena;
+    std::vector<char> buffer(fdt_file.size() + 4096);
+    void *fdt = buffer.data();
+    struct fdt_index index;
+
+    REQUIRE(fdt_open_into(fdt_file.raw_bytes(), fdt, buffer.size()) == 0);
+    REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+
+    WHEN("the index is freshly built") {
+        THEN("it's considered current") {
+            REQUIRE(fdt_index_is_current(&index));
+        }
+    }
+
+    WHEN("the index is explicitly invalidated") {
+        fdt_index_invalidate(&index);
+
+        THEN("it's no longer considered current") {
+            REQUIRE(!fdt_index_is_current(&index));
+        }
+    }
+
+    WHEN("a node is added to the tree") {
+        REQUIRE(fdt_add_subnode(fdt, 0, "aaa-new-node") >= 0);
+
+        THEN("the index notices, and lookups still match libfdt") {
+            REQUIRE(!fdt_index_is_current(&index));
+            REQUIRE(fdt_index_path_offset(&index, "/chosen") == fdt_path_offset(fdt, "/chosen"));
+        }
+    }
+}
+
+
+/**
+ * Counts the lines a lazy cache tracker has marked as invalidated.
+ */
+static size_t count_invalidated_lines(const struct lazy_cache *cache)
+{
+    size_t line, count = 0;
+    size_t lines = (cache->length + cache->line_bytes - 1) / cache->line_bytes;
+
+    for(line = 0; line < lines; ++line)
+        if(cache->bitmap[line / 64] & (1ULL << (line % 64)))
+            ++count;
+
+    return count;
+}
+
+
+SCENARIO("building the FDT index while invalidating lazily", "[fdt_index]") {
+    BinaryFile fdt_file(indexed_fdt);
+    ArenaScope arena;
+    void *fdt = fdt_file.raw_bytes();
+    struct fdt_index eager, lazy;
+    struct lazy_cache cache;
+
+    REQUIRE(fdt_index_build(&eager, fdt) == SUCCESS);
+    REQUIRE(lazy_cache_init(&cache, fdt, fdt_totalsize(fdt)) == SUCCESS);
+    REQUIRE(fdt_index_build_lazy(&lazy, fdt, &cache) == SUCCESS);
+
+    WHEN("the tree is indexed lazily") {
+        THEN("the index matches one built eagerly") {
+            REQUIRE(lazy.node_count == eager.node_count);
+            REQUIRE(lazy.chosen == eager.chosen);
+            REQUIRE(lazy.memory_count == eager.memory_count);
+            REQUIRE(lazy.memory[0] == eager.memory[0]);
+            REQUIRE(lazy.payload_node_count == eager.payload_node_count);
+            REQUIRE(lazy.stdout == eager.stdout);
+        }
+
+        THEN("the properties the walk read are visible") {
+            int length;
+            const void *reg = fdt_getprop(fdt, lazy.memory[0], "reg", &length);
+            size_t line = ((uintptr_t)reg - cache.base) / cache.line_bytes;
+
+            REQUIRE(fdt_index_getprop(&lazy, lazy.memory[0], "reg", &length) == reg);
+            REQUIRE((cache.bitmap[line / 64] & (1ULL << (line % 64))) != 0);
+        }
+    }
+
+    WHEN("the rest of the tree is invalidated") {
+        lazy_cache_finish(&cache, NULL);
+
+        THEN("every line has been invalidated") {
+            size_t lines = (cache.length + cache.line_bytes - 1) / cache.line_bytes;
+            REQUIRE(count_invalidated_lines(&cache) == lines);
+        }
+    }
+}
+
+
+
+SCENARIO("indexing a tree with many memory banks and modules", "[fdt_index]") {
+    std::vector<char> buffer(65536);
+    void *fdt = buffer.data();
+    ArenaScope arena;
+    struct fdt_index index;
+    const int banks = 200, modules = 40;
+    char name[32];
+
+    // Build a root with a few hundred memory banks and a few dozen modules.
+    REQUIRE(fdt_create(fdt, buffer.size()) == 0);
+    REQUIRE(fdt_finish_reservemap(fdt) == 0);
+    REQUIRE(fdt_begin_node(fdt, "") == 0);
+
+    for(int i = 0; i < banks; ++i) {
+        snprintf(name, sizeof(name), "memory@%x", i);
+        REQUIRE(fdt_begin_node(fdt, name) == 0);
+        REQUIRE(fdt_property_string(fdt, "device_type", "memory") == 0);
+        REQUIRE(fdt_end_node(fdt) == 0);
+    }
+
+    for(int i = 0; i < modules; ++i) {
+        snprintf(name, sizeof(name), "module@%x", i);
+        REQUIRE(fdt_begin_node(fdt, name) == 0);
+        REQUIRE(fdt_end_node(fdt) == 0);
+    }
+
+    REQUIRE(fdt_end_node(fdt) == 0);
+    REQUIRE(fdt_finish(fdt) == 0);
+
+    REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+
+    WHEN("the tree is indexed") {
+        THEN("every memory bank and module is recorded, in tree order") {
+            REQUIRE(index.memory_count == banks);
+            for(int i = 0; i < banks; ++i) {
+                snprintf(name, sizeof(name), "/memory@%x", i);
+                REQUIRE(index.memory[i] == fdt_path_offset(fdt, name));
+            }
+
+            REQUIRE(index.payload_node_count == modules);
+            for(int i = 0; i < modules; ++i) {
+                snprintf(name, sizeof(name), "/module@%x", i);
+                REQUIRE(index.payload_nodes[i] == fdt_path_offset(fdt, name));
+            }
+        }
+    }
+
+}
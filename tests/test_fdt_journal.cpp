@@ -0,0 +1,289 @@
+/**
+ * Tests for the FDT edit journal
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "catch.hpp"
+#include "helpers.h"
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <fdt_journal.h>
+}
+
+// The FDT the journal's edits are applied to.
+static const char * source_fdt = "assets/test_fdt.dtb";
+
+
+/**
+ * @return The number of nodes in the given tree.
+ */
+static int count_nodes(const void *fdt)
+{
+    int node, depth = 0, count = 0;
+
+    for(node = 0; (node >= 0) && (depth >= 0); node = fdt_next_node(fdt, node, &depth))
+        ++count;
+
+    return count;
+}
+
+
+/**
+ * Requires that two trees have the same nodes, properties and reservations,
+ * regardless of how each is laid out.
+ */
+static void require_same_tree(const void *expected, const void *actual)
+{
+    int expected_offset = 0, actual_offset = 0, expected_next, actual_next;
+    uint32_t expected_tag, actual_tag;
+
+    REQUIRE(fdt_num_mem_rsv(actual) == fdt_num_mem_rsv(expected));
+    for(int i = 0; i < fdt_num_mem_rsv(expected); ++i) {
+        uint64_t expected_address, expected_size, actual_address, actual_size;
+
+        REQUIRE(fdt_get_mem_rsv(expected, i, &expected_address, &expected_size) == 0);
+        REQUIRE(fdt_get_mem_rsv(actual, i, &actual_address, &actual_size) == 0);
+        REQUIRE(actual_address == expected_address);
+        REQUIRE(actual_size == expected_size);
+    }
+
+    REQUIRE(fdt_boot_cpuid_phys(actual) == fdt_boot_cpuid_phys(expected));
+
+    do {
+        do {
+            expected_tag = fdt_next_tag(expected, expected_offset, &expected_next);
+            if(expected_tag == FDT_NOP)
+                expected_offset = expected_next;
+        } while(expected_tag == FDT_NOP);
+
+        do {
+            actual_tag = fdt_next_tag(actual, actual_offset, &actual_next);
+            if(actual_tag == FDT_NOP)
+                actual_offset = actual_next;
+        } while(actual_tag == FDT_NOP);
+
+        REQUIRE(actual_tag == expected_tag);
+        REQUIRE(actual_next >= 0);
+
+        if(expected_tag == FDT_BEGIN_NODE) {
+            REQUIRE(std::string(fdt_get_name(actual, actual_offset, NULL)) ==
+                    std::string(fdt_get_name(expected, expected_offset, NULL)));
+        } else if(expected_tag == FDT_PROP) {
+            const struct fdt_property *expected_prop, *actual_prop;
+            int expected_length, actual_length;
+
+            expected_prop = fdt_get_property_by_offset(expected, expected_offset, &expected_length);
+            actual_prop = fdt_get_property_by_offset(actual, actual_offset, &actual_length);
+            REQUIRE(actual_prop);
+
+            REQUIRE(std::string(fdt_string(actual, fdt32_to_cpu(actual_prop->nameoff))) ==
+                    std::string(fdt_string(expected, fdt32_to_cpu(expected_prop->nameoff))));
+            REQUIRE(actual_length == expected_length);
+            REQUIRE(!memcmp(actual_prop->data, expected_prop->data, expected_length));
+        }
+
+        expected_offset = expected_next;
+        actual_offset = actual_next;
+    } while(expected_tag != FDT_END);
+}
+
+
+SCENARIO("serializing a journal of FDT edits", "[fdt_journal]") {
+    BinaryFile fdt_file(source_fdt);
+    void *fdt = fdt_file.raw_bytes();
+    std::vector<char> output(fdt_totalsize(fdt) + 4096);
+    ArenaScope arena;
+    struct fdt_journal journal;
+
+    REQUIRE(fdt_journal_init(&journal, fdt) == SUCCESS);
+
+    WHEN("the journal has no edits") {
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("the output describes the same tree as the input") {
+            REQUIRE(fdt_check_header(output.data()) == 0);
+            require_same_tree(fdt, output.data());
+        }
+    }
+
+    WHEN("an existing property is set") {
+        int root = fdt_path_offset(fdt, "/");
+        const char *model;
+        int length;
+
+        REQUIRE(fdt_journal_setprop(&journal, root, "model", "bfstub", 7) == SUCCESS);
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("its value is replaced, and the rest of the tree is untouched") {
+            model = (const char *)fdt_getprop(output.data(), 0, "model", &length);
+            REQUIRE(model);
+            REQUIRE(length == 7);
+            REQUIRE(std::string(model) == "bfstub");
+
+            REQUIRE(count_nodes(output.data()) == count_nodes(fdt));
+            REQUIRE(std::string((const char *)fdt_getprop(output.data(), 0, "compatible", NULL)) ==
+                    std::string((const char *)fdt_getprop(fdt, 0, "compatible", NULL)));
+        }
+    }
+
+    WHEN("a property is set more than once") {
+        int root = fdt_path_offset(fdt, "/");
+
+        REQUIRE(fdt_journal_setprop(&journal, root, "model", "first", 6) == SUCCESS);
+        REQUIRE(fdt_journal_setprop_u32(&journal, root, "bfstub,new", 1) == SUCCESS);
+        REQUIRE(fdt_journal_setprop(&journal, root, "model", "second", 7) == SUCCESS);
+        REQUIRE(fdt_journal_setprop_u32(&journal, root, "bfstub,new", 2) == SUCCESS);
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("only the last value is kept") {
+            const fdt32_t *cell;
+            int length;
+
+            REQUIRE(std::string((const char *)fdt_getprop(output.data(), 0, "model", NULL)) == "second");
+
+            cell = (const fdt32_t *)fdt_getprop(output.data(), 0, "bfstub,new", &length);
+            REQUIRE(cell);
+            REQUIRE(length == 4);
+            REQUIRE(fdt32_to_cpu(*cell) == 2);
+        }
+    }
+
+    WHEN("a property is deleted") {
+        int root = fdt_path_offset(fdt, "/");
+        int length;
+
+        REQUIRE(fdt_journal_delprop(&journal, root, "model") == SUCCESS);
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("it's gone, and its neighbours remain") {
+            REQUIRE(!fdt_getprop(output.data(), 0, "model", &length));
+            REQUIRE(length == -FDT_ERR_NOTFOUND);
+            REQUIRE(fdt_getprop(output.data(), 0, "compatible", NULL));
+            REQUIRE(count_nodes(output.data()) == count_nodes(fdt));
+        }
+    }
+
+    WHEN("a node is added") {
+        int chosen = fdt_path_offset(fdt, "/chosen");
+        int node, child;
+
+        node = fdt_journal_add_subnode(&journal, chosen, "bfstub");
+        REQUIRE(node >= FDT_JOURNAL_NEW_NODE_BASE);
+        REQUIRE(fdt_journal_setprop_u32(&journal, node, "value", 0x1234) == SUCCESS);
+
+        child = fdt_journal_add_subnode(&journal, node, "child");
+        REQUIRE(child >= FDT_JOURNAL_NEW_NODE_BASE);
+        REQUIRE(fdt_journal_setprop(&journal, child, "empty", NULL, 0) == SUCCESS);
+
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("it appears under its parent, with its properties and subnodes") {
+            const fdt32_t *cell;
+            int length;
+
+            node = fdt_path_offset(output.data(), "/chosen/bfstub");
+            REQUIRE(node >= 0);
+
+            cell = (const fdt32_t *)fdt_getprop(output.data(), node, "value", &length);
+            REQUIRE(cell);
+            REQUIRE(length == 4);
+            REQUIRE(fdt32_to_cpu(*cell) == 0x1234);
+
+            child = fdt_path_offset(output.data(), "/chosen/bfstub/child");
+            REQUIRE(child >= 0);
+            REQUIRE(fdt_getprop(output.data(), child, "empty", &length));
+            REQUIRE(length == 0);
+
+            REQUIRE(count_nodes(output.data()) == count_nodes(fdt) + 2);
+        }
+    }
+
+    WHEN("a node is deleted") {
+        int cpus = fdt_path_offset(fdt, "/cpus");
+        int subtree_size = 0, node, depth = 0;
+
+        for(node = cpus; (node >= 0) && (depth >= 0); node = fdt_next_node(fdt, node, &depth))
+            ++subtree_size;
+
+        REQUIRE(cpus >= 0);
+        REQUIRE(fdt_journal_del_node(&journal, cpus) == SUCCESS);
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("it's removed along with its subnodes") {
+            REQUIRE(fdt_path_offset(output.data(), "/cpus") == -FDT_ERR_NOTFOUND);
+            REQUIRE(count_nodes(output.data()) == count_nodes(fdt) - subtree_size);
+            REQUIRE(fdt_path_offset(output.data(), "/psci") >= 0);
+            REQUIRE(fdt_path_offset(output.data(), "/chosen") >= 0);
+        }
+    }
+
+    WHEN("a memory reservation is added") {
+        uint64_t address, size;
+
+        REQUIRE(fdt_journal_add_mem_rsv(&journal, 0x90000000, 0x200000) == SUCCESS);
+        REQUIRE(fdt_journal_serialize(&journal, output.data(), output.size()) == SUCCESS);
+
+        THEN("it follows the existing reservations") {
+            REQUIRE(fdt_num_mem_rsv(output.data()) == fdt_num_mem_rsv(fdt) + 1);
+
+            for(int i = 0; i < fdt_num_mem_rsv(fdt); ++i) {
+                uint64_t original_address, original_size;
+
+                REQUIRE(fdt_get_mem_rsv(fdt, i, &original_address, &original_size) == 0);
+                REQUIRE(fdt_get_mem_rsv(output.data(), i, &address, &size) == 0);
+                REQUIRE(address == original_address);
+                REQUIRE(size == original_size);
+            }
+
+            REQUIRE(fdt_get_mem_rsv(output.data(), fdt_num_mem_rsv(fdt), &address, &size) == 0);
+            REQUIRE(address == 0x90000000);
+            REQUIRE(size == 0x200000);
+        }
+    }
+
+    WHEN("the output buffer is too small") {
+        THEN("serialization fails cleanly") {
+            REQUIRE(fdt_journal_serialize(&journal, output.data(), fdt_totalsize(fdt) / 2) == -FDT_ERR_NOSPACE);
+        }
+    }
+
+    WHEN("the source's structure block is truncated") {
+        std::vector<char> truncated((char *)fdt, (char *)fdt + fdt_totalsize(fdt));
+
+        fdt_set_size_dt_struct(truncated.data(), fdt_size_dt_struct(fdt) / 2);
+        REQUIRE(fdt_journal_init(&journal, truncated.data()) == SUCCESS);
+
+        THEN("the damage is reported, rather than serialized as a complete tree") {
+            // Depending on where the cut lands, libfdt calls this truncated or malformed.
+            int rc = fdt_journal_serialize(&journal, output.data(), output.size());
+            REQUIRE((rc == -FDT_ERR_TRUNCATED || rc == -FDT_ERR_BADSTRUCTURE));
+        }
+    }
+
+}
@@ -0,0 +1,252 @@
+/**
+ * Tests for the FIT parser
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <fit.h>
+}
+
+/**
+ * Builds a minimal board FDT, with the given root compatible string.
+ */
+static std::vector<char> build_board_fdt(const char *compatible)
+{
+    std::vector<char> fdt(1024);
+
+    REQUIRE(fdt_create(fdt.data(), fdt.size()) == 0);
+    REQUIRE(fdt_finish_reservemap(fdt.data()) == 0);
+    REQUIRE(fdt_begin_node(fdt.data(), "") == 0);
+    REQUIRE(fdt_property_string(fdt.data(), "compatible", compatible) == 0);
+    REQUIRE(fdt_end_node(fdt.data()) == 0);
+    REQUIRE(fdt_finish(fdt.data()) == 0);
+
+    fdt.resize(fdt_totalsize(fdt.data()));
+    return fdt;
+}
+
+
+/**
+ * A stand-in SHA-256 digest for the test ramdisk; the parser doesn't check it.
+ */
+static const uint8_t ramdisk_sha256[FIT_SHA256_BYTES] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+    0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+};
+
+
+/**
+ * Adds an image node holding the given data to the FIT being built, along
+ * with a SHA-256 hash node if a digest is provided.
+ */
+static void add_image(void *fit, const char *name, const void *data, int length, const uint8_t *sha256 = NULL)
+{
+    REQUIRE(fdt_begin_node(fit, name) == 0);
+    REQUIRE(fdt_property(fit, "data", data, length) == 0);
+    REQUIRE(fdt_property_string(fit, "compression", "none") == 0);
+
+    if(sha256) {
+        REQUIRE(fdt_begin_node(fit, "hash-1") == 0);
+        REQUIRE(fdt_property_string(fit, "algo", "sha256") == 0);
+        REQUIRE(fdt_property(fit, "value", sha256, FIT_SHA256_BYTES) == 0);
+        REQUIRE(fdt_end_node(fit) == 0);
+    }
+
+    REQUIRE(fdt_end_node(fit) == 0);
+}
+
+
+/**
+ * Adds a configuration node to the FIT being built. Any of the subimage names
+ * can be NULL, to leave them out.
+ */
+static void add_configuration(void *fit, const char *name, const char *compatible,
+    const char *kernel, const char *fdt, const char *ramdisk)
+{
+    REQUIRE(fdt_begin_node(fit, name) == 0);
+    if(compatible)
+        REQUIRE(fdt_property_string(fit, "compatible", compatible) == 0);
+    if(kernel)
+        REQUIRE(fdt_property_string(fit, "kernel", kernel) == 0);
+    if(fdt)
+        REQUIRE(fdt_property_string(fit, "fdt", fdt) == 0);
+    if(ramdisk)
+        REQUIRE(fdt_property_string(fit, "ramdisk", ramdisk) == 0);
+    REQUIRE(fdt_end_node(fit) == 0);
+}
+
+
+/**
+ * Builds a test FIT with three configurations. The first (and default) uses
+ * board A's FDT and a ramdisk; the second uses board B's FDT; and the third
+ * names board C in its own compatible, and uses a kernel stored after the
+ * FIT's structure, as by 'mkimage -E'.
+ */
+static std::vector<char> build_fit(const char *default_configuration, const char *missing_kernel = NULL)
+{
+    std::vector<char> board_a = build_board_fdt("vendor,board-a");
+    std::vector<char> board_b = build_board_fdt("vendor,board-b");
+    std::vector<char> fit(8192);
+    const char external[] = "EXTERNAL KERNEL";
+    size_t structure_size;
+
+    REQUIRE(fdt_create(fit.data(), fit.size()) == 0);
+    REQUIRE(fdt_finish_reservemap(fit.data()) == 0);
+    REQUIRE(fdt_begin_node(fit.data(), "") == 0);
+    REQUIRE(fdt_property_string(fit.data(), "description", "test FIT") == 0);
+
+    REQUIRE(fdt_begin_node(fit.data(), "images") == 0);
+    add_image(fit.data(), "kernel-1", "KERNEL", 6);
+    add_image(fit.data(), "fdt-a", board_a.data(), board_a.size());
+    add_image(fit.data(), "fdt-b", board_b.data(), board_b.size());
+    add_image(fit.data(), "ramdisk-1", "RAMDISK", 7, ramdisk_sha256);
+    REQUIRE(fdt_begin_node(fit.data(), "kernel-2") == 0);
+    REQUIRE(fdt_property_u32(fit.data(), "data-size", sizeof(external)) == 0);
+    REQUIRE(fdt_property_u32(fit.data(), "data-offset", 0) == 0);
+    REQUIRE(fdt_end_node(fit.data()) == 0);
+    REQUIRE(fdt_end_node(fit.data()) == 0);
+
+    REQUIRE(fdt_begin_node(fit.data(), "configurations") == 0);
+    REQUIRE(fdt_property_string(fit.data(), "default", default_configuration) == 0);
+    add_configuration(fit.data(), "conf-a", NULL, "kernel-1", "fdt-a", "ramdisk-1");
+    add_configuration(fit.data(), "conf-b", NULL, "kernel-1", "fdt-b", NULL);
+    add_configuration(fit.data(), "conf-c", "vendor,board-c", "kernel-2", NULL, NULL);
+    if(missing_kernel)
+        add_configuration(fit.data(), "conf-d", "vendor,board-d", missing_kernel, NULL, NULL);
+    REQUIRE(fdt_end_node(fit.data()) == 0);
+
+    REQUIRE(fdt_end_node(fit.data()) == 0);
+    REQUIRE(fdt_finish(fit.data()) == 0);
+
+    // Place the external data after the (4-byte aligned) end of the structure.
+    structure_size = (fdt_totalsize(fit.data()) + 3) & ~3;
+    fit.resize(structure_size + sizeof(external));
+    memcpy(fit.data() + structure_size, external, sizeof(external));
+
+    return fit;
+}
+
+
+/**
+ * Shorthand for selecting a configuration using a board compatible list.
+ */
+static int select(const std::vector<char> &fit, const std::string &board, struct fit_configuration *config)
+{
+    return fit_select_configuration(fit.data(), fit.size(), board.empty() ? NULL : board.data(),
+        board.size() + 1, config);
+}
+
+
+SCENARIO("selecting configurations from a FIT", "[fit]") {
+    std::vector<char> fit = build_fit("conf-a");
+    struct fit_configuration config;
+
+    WHEN("a FIT is checked") {
+        THEN("it's recognized, but a plain FDT isn't") {
+            std::vector<char> board = build_board_fdt("vendor,board-a");
+
+            REQUIRE(fit_is_fit(fit.data()));
+            REQUIRE(!fit_is_fit(board.data()));
+        }
+    }
+
+    WHEN("no board compatible is given") {
+        THEN("the default configuration is used, and its subimages point into the FIT") {
+            REQUIRE(select(fit, "", &config) == SUCCESS);
+            REQUIRE(std::string(config.name) == "conf-a");
+
+            REQUIRE(config.subimages[FIT_KERNEL].size == 6);
+            REQUIRE(!memcmp(config.subimages[FIT_KERNEL].data, "KERNEL", 6));
+            REQUIRE((const char *)config.subimages[FIT_KERNEL].data > fit.data());
+            REQUIRE((const char *)config.subimages[FIT_KERNEL].data < fit.data() + fit.size());
+            REQUIRE(config.subimages[FIT_KERNEL].compression == NULL);
+
+            REQUIRE(config.subimages[FIT_RAMDISK].size == 7);
+            REQUIRE(!memcmp(config.subimages[FIT_RAMDISK].data, "RAMDISK", 7));
+
+            REQUIRE(fdt_check_header(config.subimages[FIT_FDT].data) == 0);
+        }
+
+        THEN("subimages with hash nodes carry their expected digests") {
+            REQUIRE(select(fit, "", &config) == SUCCESS);
+            REQUIRE(config.subimages[FIT_KERNEL].sha256 == NULL);
+            REQUIRE(config.subimages[FIT_RAMDISK].sha256 != NULL);
+            REQUIRE(!memcmp(config.subimages[FIT_RAMDISK].sha256, ramdisk_sha256, FIT_SHA256_BYTES));
+        }
+    }
+
+    WHEN("the board matches a configuration's FDT") {
+        THEN("that configuration is used") {
+            REQUIRE(select(fit, std::string("vendor,board-b\0vendor,soc", 25), &config) == SUCCESS);
+            REQUIRE(std::string(config.name) == "conf-b");
+            REQUIRE(config.subimages[FIT_RAMDISK].node < 0);
+            REQUIRE(config.subimages[FIT_RAMDISK].data == NULL);
+        }
+    }
+
+    WHEN("the board matches more than one configuration") {
+        THEN("the configuration matching the most specific string is used") {
+            REQUIRE(select(fit, std::string("vendor,board-b\0vendor,board-a", 29), &config) == SUCCESS);
+            REQUIRE(std::string(config.name) == "conf-b");
+        }
+    }
+
+    WHEN("the board matches a configuration's own compatible") {
+        THEN("that configuration is used, with its externally-stored kernel") {
+            REQUIRE(select(fit, std::string("vendor,board-x\0vendor,board-c", 29), &config) == SUCCESS);
+            REQUIRE(std::string(config.name) == "conf-c");
+            REQUIRE(std::string((const char *)config.subimages[FIT_KERNEL].data) == "EXTERNAL KERNEL");
+            REQUIRE(config.subimages[FIT_FDT].node < 0);
+        }
+    }
+
+    WHEN("the board matches nothing") {
+        THEN("the default configuration is used") {
+            REQUIRE(select(fit, "vendor,board-x", &config) == SUCCESS);
+            REQUIRE(std::string(config.name) == "conf-a");
+        }
+    }
+
+    WHEN("the FIT's external data runs past the end of the buffer") {
+        THEN("the FIT is reported as truncated") {
+            REQUIRE(fit_select_configuration(fit.data(), fit.size() - 1, "vendor,board-c",
+                sizeof("vendor,board-c"), &config) == -FDT_ERR_TRUNCATED);
+        }
+    }
+
+    WHEN("a configuration refers to an image that doesn't exist") {
+        std::vector<char> broken = build_fit("conf-d", "kernel-3");
+
+        THEN("selecting it fails") {
+            REQUIRE(select(broken, "", &config) == -FDT_ERR_NOTFOUND);
+            REQUIRE(select(broken, "vendor,board-a", &config) == SUCCESS);
+        }
+    }
+}
@@ -0,0 +1,239 @@
+/**
+ * Tests for the gzip decompressor
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+#include "helpers.h"
+
+#include <vector>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <inflate.h>
+}
+
+// test_pattern(4096), compressed by gzip -9; uses dynamic Huffman blocks.
+static const unsigned char dynamic_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xa5, 0x95,
+    0x61, 0x30, 0x24, 0x74, 0x18, 0x87, 0x25, 0x29, 0x49, 0x24, 0x29, 0x49,
+    0x24, 0x29, 0x49, 0x24, 0x29, 0x49, 0x24, 0x29, 0x49, 0x24, 0xa7, 0x93,
+    0x84, 0xb5, 0xd6, 0xed, 0xad, 0x8d, 0x24, 0x25, 0x27, 0x92, 0x94, 0x24,
+    0x92, 0x94, 0x24, 0x92, 0x94, 0xe4, 0x38, 0x49, 0x49, 0x22, 0x49, 0x49,
+    0x22, 0x49, 0x49, 0x22, 0x49, 0x49, 0x22, 0xe7, 0x74, 0xce, 0x39, 0xf7,
+    0x4c, 0xd3, 0xdc, 0xf4, 0x35, 0xef, 0xc7, 0xff, 0xcc, 0x33, 0xb3, 0xb3,
+    0xfb, 0x7b, 0xf6, 0x7d, 0x62, 0x15, 0x71, 0xca, 0x78, 0x55, 0xc2, 0x2e,
+    0xf5, 0x6e, 0x4d, 0xa2, 0x36, 0xf6, 0xff, 0x3f, 0x3e, 0x1b, 0xea, 0x9b,
+    0x1c, 0x5d, 0x98, 0x59, 0xff, 0x6b, 0xcd, 0x58, 0xcf, 0xca, 0xd4, 0xd1,
+    0xe6, 0x6a, 0x2f, 0xb7, 0x60, 0xff, 0x88, 0x10, 0x4d, 0x9c, 0x32, 0x33,
+    0xad, 0x28, 0xbb, 0xbc, 0xe4, 0xad, 0x86, 0x9a, 0xf6, 0x66, 0x98, 0x6f,
+    0x46, 0x16, 0xa6, 0xd7, 0x61, 0xce, 0xb5, 0x30, 0x71, 0xb4, 0x85, 0xb9,
+    0xd1, 0x27, 0x22, 0x54, 0x03, 0xb3, 0xad, 0x0f, 0xfd, 0xcf, 0x63, 0x67,
+    0x74, 0x78, 0x90, 0x5f, 0x46, 0x8a, 0x3a, 0x56, 0x55, 0x55, 0x5a, 0x98,
+    0xd3, 0xd1, 0xfc, 0x66, 0x63, 0xed, 0xd4, 0x58, 0x7f, 0xf7, 0xc6, 0xfe,
+    0xd5, 0xc5, 0x39, 0x6b, 0x13, 0x03, 0xdd, 0x6b, 0x3c, 0x5d, 0x1d, 0x6c,
+    0x60, 0x6e, 0xf0, 0xcd, 0x48, 0x56, 0xc3, 0x3c, 0x9d, 0x9f, 0xdd, 0xd1,
+    0x02, 0xf3, 0xed, 0x70, 0x7f, 0xcf, 0x06, 0xcc, 0x36, 0xbf, 0xf6, 0xb1,
+    0xc7, 0x6f, 0x4b, 0x73, 0x9b, 0xab, 0x03, 0x3d, 0xe3, 0x5f, 0x8d, 0x39,
+    0xdb, 0x79, 0xb9, 0x1a, 0xea, 0x9c, 0x6d, 0x65, 0x96, 0xa4, 0x4a, 0x4f,
+    0x0e, 0xbc, 0xde, 0x2f, 0x2a, 0xbc, 0xa9, 0xba, 0xbd, 0xe5, 0xa9, 0x82,
+    0x9c, 0xf2, 0x62, 0x98, 0x03, 0x2b, 0x03, 0xdd, 0xe3, 0x30, 0xd7, 0x7a,
+    0xb8, 0x18, 0xea, 0xc2, 0x24, 0xc4, 0xa4, 0xa7, 0x04, 0xc2, 0x6c, 0xfb,
+    0x87, 0xff, 0xf7, 0xf1, 0x60, 0x56, 0x9a, 0x56, 0x19, 0x19, 0x1a, 0x70,
+    0x9d, 0x7f, 0x57, 0x6b, 0x63, 0x4d, 0x45, 0xf1, 0x93, 0x85, 0xb9, 0x5b,
+    0x6b, 0xf3, 0xd3, 0x13, 0x5f, 0x8f, 0x0e, 0xf6, 0x79, 0xbb, 0x38, 0xd8,
+    0x9e, 0x63, 0x69, 0x6a, 0xa0, 0x03, 0x13, 0xaf, 0x88, 0x0c, 0x09, 0x80,
+    0xd9, 0x5b, 0x5f, 0x5d, 0x51, 0x02, 0xf3, 0xf7, 0xf2, 0xfc, 0xcc, 0x04,
+    0x8c, 0x60, 0xfa, 0x7f, 0x1e, 0x4f, 0x14, 0xe5, 0x55, 0x96, 0xb2, 0xf1,
+    0xbe, 0xb6, 0x60, 0xbf, 0xa8, 0x50, 0x4d, 0xcc, 0x43, 0x99, 0xa9, 0xc6,
+    0xfa, 0x6c, 0x7c, 0xbe, 0x9d, 0x97, 0xfb, 0x50, 0xf7, 0xf8, 0xc8, 0x1f,
+    0xb8, 0xb1, 0x0c, 0xf3, 0x5c, 0x49, 0x43, 0x75, 0x3b, 0xcc, 0xdd, 0xb8,
+    0xa1, 0x80, 0x39, 0x51, 0xc7, 0xc2, 0xd4, 0x11, 0x46, 0x24, 0x1f, 0x8f,
+    0xb3, 0xac, 0xcd, 0x8d, 0xf4, 0xd8, 0xf8, 0x3c, 0xfb, 0xa9, 0xd1, 0xc1,
+    0x9e, 0x8d, 0xe5, 0xdf, 0x17, 0x67, 0xab, 0xca, 0xd8, 0xf8, 0xed, 0xd6,
+    0xc6, 0xba, 0xe8, 0x90, 0x00, 0xdf, 0x3d, 0xb8, 0x11, 0x03, 0x73, 0x82,
+    0xae, 0xa7, 0x8b, 0x03, 0xcc, 0x97, 0xb8, 0xb1, 0x02, 0xf3, 0x7c, 0x71,
+    0x7e, 0x4e, 0x07, 0x8c, 0x50, 0x7f, 0xed, 0x1b, 0x4d, 0x75, 0x9d, 0xad,
+    0x6c, 0xfc, 0x4c, 0x59, 0x92, 0x32, 0x33, 0x25, 0xd0, 0xe7, 0xce, 0xa8,
+    0x30, 0x67, 0x7b, 0x36, 0x3e, 0x5e, 0xcf, 0xca, 0x7c, 0x69, 0x7a, 0x7d,
+    0xe5, 0x0b, 0xdc, 0x18, 0x86, 0x79, 0xa7, 0xa5, 0x20, 0xbb, 0x1c, 0xe6,
+    0x61, 0xdc, 0xf0, 0x85, 0xb9, 0xd0, 0xc6, 0xc3, 0xd5, 0x10, 0x46, 0xa8,
+    0xbf, 0xe6, 0x2a, 0x6f, 0x77, 0x27, 0x3b, 0x36, 0x3e, 0x4e, 0x7f, 0x6b,
+    0x75, 0x71, 0x66, 0x62, 0xf8, 0xf3, 0xc1, 0xde, 0xae, 0x36, 0x36, 0x7e,
+    0xb6, 0xb4, 0x30, 0x2f, 0x2b, 0x59, 0xad, 0xb8, 0x0b, 0x37, 0x7c, 0x60,
+    0x2e, 0xb0, 0xb5, 0x34, 0x31, 0x80, 0xf9, 0x13, 0x37, 0x46, 0x60, 0xde,
+    0x6d, 0xae, 0xaf, 0xa9, 0x80, 0x11, 0xea, 0xaf, 0xbe, 0x29, 0xd8, 0x3f,
+    0x2a, 0x4c, 0xa3, 0x48, 0xbf, 0x37, 0xad, 0x28, 0xb7, 0x92, 0x8d, 0xdf,
+    0xef, 0x6c, 0x1d, 0xea, 0x1b, 0x1f, 0x5e, 0xf8, 0x79, 0x76, 0x73, 0xcd,
+    0x98, 0x8d, 0x2f, 0x71, 0xb4, 0xf5, 0x70, 0x81, 0xd9, 0x81, 0x1b, 0xe9,
+    0x30, 0x2f, 0x97, 0x17, 0x37, 0xd4, 0xc0, 0x7c, 0x8a, 0x1b, 0x0b, 0x30,
+    0x42, 0xfd, 0x13, 0xbe, 0x9b, 0x1a, 0x1b, 0xec, 0xdd, 0x58, 0x99, 0xff,
+    0x69, 0xce, 0xda, 0xcc, 0x88, 0x8d, 0x2f, 0x76, 0xb2, 0x8b, 0x0e, 0x0f,
+    0xf0, 0xc9, 0xb8, 0x2f, 0x55, 0xab, 0xaa, 0x62, 0xe3, 0x0f, 0x3a, 0x5a,
+    0xea, 0xab, 0x61, 0x3e, 0xc1, 0x8d, 0x79, 0x98, 0x53, 0x0d, 0x74, 0x3c,
+    0x5d, 0x61, 0xee, 0xc0, 0x8d, 0x0c, 0x18, 0xa1, 0xfe, 0xf1, 0xbb, 0x92,
+    0x54, 0x99, 0xa9, 0x81, 0xbe, 0x11, 0xb7, 0x85, 0x37, 0xd5, 0x76, 0xb2,
+    0xf1, 0x8b, 0x95, 0xa5, 0x4b, 0x73, 0xeb, 0xcb, 0x03, 0x1f, 0xf7, 0x4e,
+    0x8e, 0x39, 0xb3, 0xf1, 0x29, 0x86, 0xba, 0x16, 0x26, 0x30, 0xf7, 0xe3,
+    0x46, 0x04, 0xcc, 0x87, 0xed, 0xcd, 0x05, 0x39, 0x30, 0xbf, 0xe2, 0xc6,
+    0x00, 0x8c, 0x50, 0xff, 0xb8, 0x83, 0x5b, 0x6b, 0x8b, 0xb3, 0x13, 0x23,
+    0xfd, 0x1f, 0xf5, 0x79, 0xbb, 0x39, 0xb1, 0xf1, 0xc9, 0x46, 0x7a, 0x59,
+    0x69, 0xea, 0x98, 0xc8, 0xdb, 0xc3, 0x82, 0xfc, 0xbb, 0xd8, 0xf8, 0xa5,
+    0x8a, 0x92, 0xfc, 0x6c, 0x98, 0x5f, 0x70, 0xa3, 0x1f, 0xe6, 0x52, 0x07,
+    0x1b, 0x4b, 0x53, 0x98, 0x07, 0x70, 0x23, 0x12, 0x46, 0xa8, 0x7f, 0xec,
+    0x49, 0xc6, 0xfa, 0x56, 0x66, 0x6c, 0x7c, 0x99, 0xfb, 0x50, 0xef, 0x24,
+    0x37, 0xfe, 0xd0, 0xe6, 0x6a, 0x51, 0x1e, 0x1b, 0xbf, 0x5a, 0xdb, 0xd9,
+    0x16, 0xcc, 0x8d, 0x4f, 0xc4, 0x8d, 0x64, 0x98, 0x33, 0x68, 0x83, 0x07,
+    0xcc, 0x8f, 0xb8, 0x31, 0x03, 0xf3, 0x38, 0x6d, 0x68, 0x80, 0x11, 0xea,
+    0x9f, 0xf8, 0x42, 0x55, 0x59, 0x61, 0x2e, 0x1b, 0xbf, 0x52, 0x17, 0x1d,
+    0x16, 0xc4, 0x8d, 0xdf, 0xad, 0x55, 0x5a, 0x9b, 0xb3, 0xf1, 0xe5, 0x6e,
+    0x4e, 0xf6, 0x53, 0xdc, 0xf8, 0xc3, 0xb8, 0x31, 0x0d, 0xf3, 0x18, 0x6d,
+    0xa8, 0x87, 0xb9, 0x15, 0x37, 0x52, 0x60, 0xce, 0xa4, 0x0d, 0x9e, 0x30,
+    0xd2, 0xfe, 0x5c, 0xe4, 0x6c, 0xef, 0xe5, 0xc6, 0xc6, 0xa7, 0x99, 0x2f,
+    0xcd, 0x6e, 0x72, 0xe3, 0xbf, 0x9f, 0x1c, 0x6d, 0xaa, 0x63, 0xe3, 0x47,
+    0x73, 0x2b, 0xcb, 0x92, 0xb8, 0xf1, 0xb7, 0xe0, 0x46, 0x08, 0xcc, 0x15,
+    0xb4, 0xc1, 0x02, 0xe6, 0x08, 0x6e, 0xf4, 0xc0, 0xbc, 0x4e, 0x1b, 0x0a,
+    0x60, 0xa4, 0xfd, 0x79, 0xaf, 0xab, 0xad, 0xb1, 0x96, 0x8d, 0x1f, 0xc9,
+    0xcb, 0x4a, 0xd5, 0x72, 0xe3, 0x6f, 0x0e, 0xf2, 0xf3, 0x76, 0x67, 0xe3,
+    0xd3, 0xcd, 0x8c, 0xf4, 0xb7, 0xb8, 0xf1, 0x3f, 0xe0, 0x46, 0x37, 0xcc,
+    0x6b, 0xb4, 0x21, 0x1f, 0xe6, 0x1e, 0xdc, 0x08, 0x85, 0xb9, 0x92, 0x36,
+    0x58, 0xc2, 0x48, 0xfb, 0x23, 0xed, 0xbf, 0xf4, 0x0f, 0x28, 0xed, 0xbf,
+    0xb4, 0x3f, 0xd2, 0xfe, 0x4b, 0xfb, 0x23, 0xed, 0xbf, 0xb4, 0x3f, 0xd2,
+    0xfe, 0x4b, 0xfb, 0x23, 0xed, 0xbf, 0xb4, 0x3f, 0xd2, 0xfe, 0x4b, 0xfb,
+    0x23, 0xed, 0xbf, 0xb4, 0x3f, 0xd2, 0xfe, 0x4b, 0xfb, 0x23, 0xed, 0xbf,
+    0xb4, 0x3f, 0xd2, 0xfe, 0x4b, 0xfb, 0x23, 0xed, 0xbf, 0xb4, 0x3f, 0xd2,
+    0xfe, 0x4b, 0xfb, 0x23, 0xed, 0xbf, 0xb4, 0x3f, 0xd2, 0xfe, 0x4b, 0xfb,
+    0x23, 0xed, 0xff, 0x51, 0x77, 0xb0, 0xc9, 0x43, 0x00, 0x10, 0x00, 0x00,
+};
+
+// test_pattern(200), stored by gzip without compression.
+static const unsigned char stored_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x03, 0x01, 0xc8,
+    0x00, 0x37, 0xff, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66,
+    0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65,
+    0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0xc8, 0xcf, 0xc6, 0xdd, 0xd4,
+    0xeb, 0xe2, 0xf9, 0xf1, 0xf6, 0x0f, 0x04, 0x1d, 0x12, 0x2b, 0x20, 0x3a,
+    0x3d, 0x34, 0x4f, 0x46, 0x59, 0x50, 0x6b, 0x63, 0x64, 0x7d, 0x76, 0x8f,
+    0x80, 0x99, 0x92, 0xac, 0xab, 0xa2, 0xb9, 0xb0, 0xcf, 0xc6, 0xdd, 0xd5,
+    0xd2, 0xeb, 0xe0, 0xf9, 0xf6, 0x0f, 0x04, 0x1e, 0x19, 0x10, 0x2b, 0x22,
+    0x3d, 0x34, 0x4f, 0x47, 0x40, 0x59, 0x52, 0x6b, 0x64, 0x7d, 0x76, 0x6c,
+    0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b,
+    0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6a, 0x58, 0x5f, 0x56, 0x4d, 0x44, 0x7b, 0x72, 0x69, 0x26,
+    0x26, 0x79, 0xd5, 0xc8, 0x00, 0x00, 0x00,
+};
+
+// "hello hello hello!", compressed by gzip -9; uses a fixed Huffman block.
+static const unsigned char fixed_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xcb, 0x48,
+    0xcd, 0xc9, 0xc9, 0x57, 0xc8, 0x40, 0x90, 0x8a, 0x00, 0x7b, 0x85, 0x36,
+    0x73, 0x12, 0x00, 0x00, 0x00,
+};
+
+
+SCENARIO("decompressing gzip streams", "[inflate]") {
+    std::vector<unsigned char> output(8192);
+    size_t length;
+
+    WHEN("a stream using dynamic Huffman codes is decompressed") {
+        std::vector<unsigned char> expected = test_pattern(4096);
+
+        THEN("the original data is recovered") {
+            REQUIRE(gunzip_is_gzip(dynamic_gz, sizeof(dynamic_gz)));
+            REQUIRE(gunzip_uncompressed_size(dynamic_gz, sizeof(dynamic_gz)) == 4096);
+            REQUIRE(gunzip(output.data(), output.size(), dynamic_gz, sizeof(dynamic_gz), &length) == SUCCESS);
+            REQUIRE(length == 4096);
+            REQUIRE(std::equal(expected.begin(), expected.end(), output.begin()));
+        }
+    }
+
+    WHEN("a stream made of stored blocks is decompressed") {
+        std::vector<unsigned char> expected = test_pattern(200);
+
+        THEN("the original data is recovered") {
+            REQUIRE(gunzip(output.data(), output.size(), stored_gz, sizeof(stored_gz), &length) == SUCCESS);
+            REQUIRE(length == 200);
+            REQUIRE(std::equal(expected.begin(), expected.end(), output.begin()));
+        }
+    }
+
+    WHEN("a stream using the fixed Huffman codes is decompressed") {
+        THEN("the original data is recovered") {
+            REQUIRE(gunzip(output.data(), output.size(), fixed_gz, sizeof(fixed_gz), &length) == SUCCESS);
+            REQUIRE(length == 18);
+            REQUIRE(!memcmp(output.data(), "hello hello hello!", 18));
+        }
+    }
+
+    WHEN("only the start of a stream is decompressed") {
+        std::vector<unsigned char> expected = test_pattern(4096);
+
+        THEN("exactly the requested prefix is produced") {
+            output[64] = 0xEE;
+            REQUIRE(gunzip_prefix(output.data(), 64, dynamic_gz, sizeof(dynamic_gz)) == SUCCESS);
+            REQUIRE(std::equal(expected.begin(), expected.begin() + 64, output.begin()));
+            REQUIRE(output[64] == 0xEE);
+        }
+    }
+
+    WHEN("the output buffer is too small") {
+        THEN("decompression fails without overrunning it") {
+            output[100] = 0xEE;
+            REQUIRE(gunzip(output.data(), 100, dynamic_gz, sizeof(dynamic_gz), &length) == -FDT_ERR_NOSPACE);
+            REQUIRE(output[100] == 0xEE);
+        }
+    }
+
+    WHEN("the stream is truncated") {
+        THEN("decompression fails") {
+            REQUIRE(gunzip(output.data(), output.size(), dynamic_gz, sizeof(dynamic_gz) / 2, &length) != SUCCESS);
+        }
+    }
+
+    WHEN("the header's extra field runs past the end of the stream") {
+        // FEXTRA | FNAME, with an extra field far longer than the stream.
+        std::vector<unsigned char> damaged(fixed_gz, fixed_gz + sizeof(fixed_gz));
+        const unsigned char extra[] = { 0xff, 0x7f };
+
+        damaged[3] = 0x0c;
+        damaged.insert(damaged.begin() + 10, extra, extra + sizeof(extra));
+
+        THEN("the header is rejected as truncated") {
+            REQUIRE(gunzip(output.data(), output.size(), damaged.data(), damaged.size(), &length) == -FDT_ERR_TRUNCATED);
+        }
+    }
+
+    WHEN("the data isn't a gzip stream") {
+        THEN("it's rejected") {
+            REQUIRE(!gunzip_is_gzip(output.data(), output.size()));
+            REQUIRE(gunzip(output.data(), 16, output.data() + 16, 64, &length) == -FDT_ERR_BADMAGIC);
+        }
+    }
+}
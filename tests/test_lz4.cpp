@@ -0,0 +1,422 @@
+/**
+ * Tests for the LZ4 decompressor
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+#include "helpers.h"
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <lz4.h>
+}
+
+// test_pattern(4096) as an LZ4 frame of 1 KiB blocks, recording its content
+// size and (zeroed, unchecked) block checksums.
+static const unsigned char frame_lz4[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x78, 0x40, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x49, 0x02, 0x00, 0x00, 0xdf, 0x61, 0x62, 0x63, 0x64,
+    0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x0d, 0x00, 0x20,
+    0xff, 0x31, 0xc8, 0xcf, 0xc6, 0xdd, 0xd4, 0xeb, 0xe2, 0xf9, 0xf1, 0xf6,
+    0x0f, 0x04, 0x1d, 0x12, 0x2b, 0x20, 0x3a, 0x3d, 0x34, 0x4f, 0x46, 0x59,
+    0x50, 0x6b, 0x63, 0x64, 0x7d, 0x76, 0x8f, 0x80, 0x99, 0x92, 0xac, 0xab,
+    0xa2, 0xb9, 0xb0, 0xcf, 0xc6, 0xdd, 0xd5, 0xd2, 0xeb, 0xe0, 0xf9, 0xf6,
+    0x0f, 0x04, 0x1e, 0x19, 0x10, 0x2b, 0x22, 0x3d, 0x34, 0x4f, 0x47, 0x40,
+    0x59, 0x52, 0x6b, 0x64, 0x7d, 0x76, 0x75, 0x00, 0x22, 0x07, 0xa9, 0x00,
+    0xff, 0x31, 0x58, 0x5f, 0x56, 0x4d, 0x44, 0x7b, 0x72, 0x69, 0x61, 0x66,
+    0x9f, 0x94, 0x8d, 0x82, 0xbb, 0xb0, 0xaa, 0xad, 0xa4, 0xdf, 0xd6, 0xc9,
+    0xc0, 0xfb, 0xf3, 0xf4, 0xed, 0xe6, 0x1f, 0x10, 0x09, 0x02, 0x3c, 0x3b,
+    0x32, 0x29, 0x20, 0x5f, 0x56, 0x4d, 0x45, 0x42, 0x7b, 0x70, 0x69, 0x66,
+    0x9f, 0x94, 0x8e, 0x89, 0x80, 0xbb, 0xb2, 0xad, 0xa4, 0xdf, 0xd7, 0xd0,
+    0xc9, 0xc2, 0xfb, 0xf4, 0xed, 0xe6, 0xf7, 0x00, 0x24, 0x05, 0x82, 0x00,
+    0xff, 0x31, 0xe8, 0xef, 0xe6, 0xfd, 0xf4, 0xcb, 0xc2, 0xd9, 0xd1, 0xd6,
+    0x2f, 0x24, 0x3d, 0x32, 0x0b, 0x00, 0x1a, 0x1d, 0x14, 0x6f, 0x66, 0x79,
+    0x70, 0x4b, 0x43, 0x44, 0x5d, 0x56, 0xaf, 0xa0, 0xb9, 0xb2, 0x8c, 0x8b,
+    0x82, 0x99, 0x90, 0xef, 0xe6, 0xfd, 0xf5, 0xf2, 0xcb, 0xc0, 0xd9, 0xd6,
+    0x2f, 0x24, 0x3e, 0x39, 0x30, 0x0b, 0x02, 0x1d, 0x14, 0x6f, 0x67, 0x60,
+    0x79, 0x72, 0x4b, 0x44, 0x5d, 0x56, 0x79, 0x01, 0x26, 0x03, 0x82, 0x00,
+    0xff, 0x31, 0x78, 0x7f, 0x76, 0x6d, 0x64, 0x5b, 0x52, 0x49, 0x41, 0x46,
+    0xbf, 0xb4, 0xad, 0xa2, 0x9b, 0x90, 0x8a, 0x8d, 0x84, 0xff, 0xf6, 0xe9,
+    0xe0, 0xdb, 0xd3, 0xd4, 0xcd, 0xc6, 0x3f, 0x30, 0x29, 0x22, 0x1c, 0x1b,
+    0x12, 0x09, 0x00, 0x7f, 0x76, 0x6d, 0x65, 0x62, 0x5b, 0x50, 0x49, 0x46,
+    0xbf, 0xb4, 0xae, 0xa9, 0xa0, 0x9b, 0x92, 0x8d, 0x84, 0xff, 0xf7, 0xf0,
+    0xe9, 0xe2, 0xdb, 0xd4, 0xcd, 0xc6, 0xfb, 0x01, 0x28, 0x01, 0x82, 0x00,
+    0xff, 0x31, 0x88, 0x8f, 0x86, 0x9d, 0x94, 0xab, 0xa2, 0xb9, 0xb1, 0xb6,
+    0x4f, 0x44, 0x5d, 0x52, 0x6b, 0x60, 0x7a, 0x7d, 0x74, 0x0f, 0x06, 0x19,
+    0x10, 0x2b, 0x23, 0x24, 0x3d, 0x36, 0xcf, 0xc0, 0xd9, 0xd2, 0xec, 0xeb,
+    0xe2, 0xf9, 0xf0, 0x8f, 0x86, 0x9d, 0x95, 0x92, 0xab, 0xa0, 0xb9, 0xb6,
+    0x4f, 0x44, 0x5e, 0x59, 0x50, 0x6b, 0x62, 0x7d, 0x74, 0x0f, 0x07, 0x00,
+    0x19, 0x12, 0x2b, 0x24, 0x3d, 0x36, 0x7d, 0x02, 0x2a, 0xff, 0x34, 0x6d,
+    0x61, 0x62, 0x18, 0x1f, 0x16, 0x0d, 0x04, 0x3b, 0x32, 0x29, 0x21, 0x26,
+    0xdf, 0xd4, 0xcd, 0xc2, 0xfb, 0xf0, 0xea, 0xed, 0xe4, 0x9f, 0x96, 0x89,
+    0x80, 0xbb, 0xb3, 0xb4, 0xad, 0xa6, 0x5f, 0x50, 0x49, 0x42, 0x7c, 0x7b,
+    0x72, 0x69, 0x60, 0x1f, 0x16, 0x0d, 0x05, 0x02, 0x3b, 0x30, 0x29, 0x26,
+    0xdf, 0xd4, 0xce, 0xc9, 0xc0, 0xfb, 0xf2, 0xed, 0xe4, 0x9f, 0x97, 0x90,
+    0x89, 0x82, 0xbb, 0xb4, 0xad, 0xa6, 0xff, 0x02, 0x2c, 0xf1, 0x32, 0x6d,
+    0xa8, 0xaf, 0xa6, 0xbd, 0xb4, 0x8b, 0x82, 0x99, 0x91, 0x96, 0x6f, 0x64,
+    0x7d, 0x72, 0x4b, 0x40, 0x5a, 0x5d, 0x54, 0x2f, 0x26, 0x39, 0x30, 0x0b,
+    0x03, 0x04, 0x1d, 0x16, 0xef, 0xe0, 0xf9, 0xf2, 0xcc, 0xcb, 0xc2, 0xd9,
+    0xd0, 0xaf, 0xa6, 0xbd, 0xb5, 0xb2, 0x8b, 0x80, 0x99, 0x96, 0x6f, 0x64,
+    0x7e, 0x79, 0x70, 0x4b, 0x42, 0x5d, 0x54, 0x2f, 0x27, 0x20, 0x39, 0x32,
+    0x0b, 0x04, 0x1d, 0x16, 0x45, 0x01, 0x0f, 0x81, 0x03, 0x28, 0xf0, 0x31,
+    0x38, 0x3f, 0x36, 0x2d, 0x24, 0x1b, 0x12, 0x09, 0x01, 0x06, 0xff, 0xf4,
+    0xed, 0xe2, 0xdb, 0xd0, 0xca, 0xcd, 0xc4, 0xbf, 0xb6, 0xa9, 0xa0, 0x9b,
+    0x93, 0x94, 0x8d, 0x86, 0x7f, 0x70, 0x69, 0x62, 0x5c, 0x5b, 0x52, 0x49,
+    0x40, 0x3f, 0x36, 0x2d, 0x25, 0x22, 0x1b, 0x10, 0x09, 0x06, 0xff, 0xf4,
+    0xee, 0xe9, 0xe0, 0xdb, 0xd2, 0xcd, 0xc4, 0xbf, 0xb7, 0xb0, 0xa9, 0xa2,
+    0x9b, 0x94, 0x8d, 0x86, 0x00, 0x00, 0x00, 0x00, 0x48, 0x02, 0x00, 0x00,
+    0xdf, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x0d, 0x00, 0x20, 0xff, 0x31, 0x48, 0x4f, 0x46, 0x5d, 0x54,
+    0x6b, 0x62, 0x79, 0x71, 0x76, 0x8f, 0x84, 0x9d, 0x92, 0xab, 0xa0, 0xba,
+    0xbd, 0xb4, 0xcf, 0xc6, 0xd9, 0xd0, 0xeb, 0xe3, 0xe4, 0xfd, 0xf6, 0x0f,
+    0x00, 0x19, 0x12, 0x2c, 0x2b, 0x22, 0x39, 0x30, 0x4f, 0x46, 0x5d, 0x55,
+    0x52, 0x6b, 0x60, 0x79, 0x76, 0x8f, 0x84, 0x9e, 0x99, 0x90, 0xab, 0xa2,
+    0xbd, 0xb4, 0xcf, 0xc7, 0xc0, 0xd9, 0xd2, 0xeb, 0xe4, 0xfd, 0xf6, 0x75,
+    0x00, 0x22, 0x07, 0xa9, 0x00, 0xff, 0x30, 0xd8, 0xdf, 0xd6, 0xcd, 0xc4,
+    0xfb, 0xf2, 0xe9, 0xe1, 0xe6, 0x1f, 0x14, 0x0d, 0x02, 0x3b, 0x30, 0x2a,
+    0x2d, 0x24, 0x5f, 0x56, 0x49, 0x40, 0x7b, 0x73, 0x74, 0x6d, 0x66, 0x9f,
+    0x90, 0x89, 0x82, 0xbc, 0xbb, 0xb2, 0xa9, 0xa0, 0xdf, 0xd6, 0xcd, 0xc5,
+    0xc2, 0xfb, 0xf0, 0xe9, 0xe6, 0x1f, 0x14, 0x0e, 0x09, 0x00, 0x3b, 0x32,
+    0x2d, 0x24, 0x5f, 0x57, 0x50, 0x49, 0x42, 0x7b, 0x74, 0x6d, 0xf7, 0x00,
+    0x25, 0x05, 0x82, 0x00, 0xff, 0x31, 0x68, 0x6f, 0x66, 0x7d, 0x74, 0x4b,
+    0x42, 0x59, 0x51, 0x56, 0xaf, 0xa4, 0xbd, 0xb2, 0x8b, 0x80, 0x9a, 0x9d,
+    0x94, 0xef, 0xe6, 0xf9, 0xf0, 0xcb, 0xc3, 0xc4, 0xdd, 0xd6, 0x2f, 0x20,
+    0x39, 0x32, 0x0c, 0x0b, 0x02, 0x19, 0x10, 0x6f, 0x66, 0x7d, 0x75, 0x72,
+    0x4b, 0x40, 0x59, 0x56, 0xaf, 0xa4, 0xbe, 0xb9, 0xb0, 0x8b, 0x82, 0x9d,
+    0x94, 0xef, 0xe7, 0xe0, 0xf9, 0xf2, 0xcb, 0xc4, 0xdd, 0xd6, 0x79, 0x01,
+    0x26, 0x03, 0x82, 0x00, 0xff, 0x31, 0xf8, 0xff, 0xf6, 0xed, 0xe4, 0xdb,
+    0xd2, 0xc9, 0xc1, 0xc6, 0x3f, 0x34, 0x2d, 0x22, 0x1b, 0x10, 0x0a, 0x0d,
+    0x04, 0x7f, 0x76, 0x69, 0x60, 0x5b, 0x53, 0x54, 0x4d, 0x46, 0xbf, 0xb0,
+    0xa9, 0xa2, 0x9c, 0x9b, 0x92, 0x89, 0x80, 0xff, 0xf6, 0xed, 0xe5, 0xe2,
+    0xdb, 0xd0, 0xc9, 0xc6, 0x3f, 0x34, 0x2e, 0x29, 0x20, 0x1b, 0x12, 0x0d,
+    0x04, 0x7f, 0x77, 0x70, 0x69, 0x62, 0x5b, 0x54, 0x4d, 0x46, 0xfb, 0x01,
+    0x28, 0x01, 0x82, 0x00, 0xff, 0x31, 0x08, 0x0f, 0x06, 0x1d, 0x14, 0x2b,
+    0x22, 0x39, 0x31, 0x36, 0xcf, 0xc4, 0xdd, 0xd2, 0xeb, 0xe0, 0xfa, 0xfd,
+    0xf4, 0x8f, 0x86, 0x99, 0x90, 0xab, 0xa3, 0xa4, 0xbd, 0xb6, 0x4f, 0x40,
+    0x59, 0x52, 0x6c, 0x6b, 0x62, 0x79, 0x70, 0x0f, 0x06, 0x1d, 0x15, 0x12,
+    0x2b, 0x20, 0x39, 0x36, 0xcf, 0xc4, 0xde, 0xd9, 0xd0, 0xeb, 0xe2, 0xfd,
+    0xf4, 0x8f, 0x87, 0x80, 0x99, 0x92, 0xab, 0xa4, 0xbd, 0xb6, 0x7d, 0x02,
+    0x2a, 0xff, 0x34, 0x6a, 0x6b, 0x6c, 0x98, 0x9f, 0x96, 0x8d, 0x84, 0xbb,
+    0xb2, 0xa9, 0xa1, 0xa6, 0x5f, 0x54, 0x4d, 0x42, 0x7b, 0x70, 0x6a, 0x6d,
+    0x64, 0x1f, 0x16, 0x09, 0x00, 0x3b, 0x33, 0x34, 0x2d, 0x26, 0xdf, 0xd0,
+    0xc9, 0xc2, 0xfc, 0xfb, 0xf2, 0xe9, 0xe0, 0x9f, 0x96, 0x8d, 0x85, 0x82,
+    0xbb, 0xb0, 0xa9, 0xa6, 0x5f, 0x54, 0x4e, 0x49, 0x40, 0x7b, 0x72, 0x6d,
+    0x64, 0x1f, 0x17, 0x10, 0x09, 0x02, 0x3b, 0x34, 0x2d, 0x26, 0xff, 0x02,
+    0x2c, 0xf1, 0x32, 0x6a, 0x28, 0x2f, 0x26, 0x3d, 0x34, 0x0b, 0x02, 0x19,
+    0x11, 0x16, 0xef, 0xe4, 0xfd, 0xf2, 0xcb, 0xc0, 0xda, 0xdd, 0xd4, 0xaf,
+    0xa6, 0xb9, 0xb0, 0x8b, 0x83, 0x84, 0x9d, 0x96, 0x6f, 0x60, 0x79, 0x72,
+    0x4c, 0x4b, 0x42, 0x59, 0x50, 0x2f, 0x26, 0x3d, 0x35, 0x32, 0x0b, 0x00,
+    0x19, 0x16, 0xef, 0xe4, 0xfe, 0xf9, 0xf0, 0xcb, 0xc2, 0xdd, 0xd4, 0xaf,
+    0xa7, 0xa0, 0xb9, 0xb2, 0x8b, 0x84, 0x9d, 0x96, 0x45, 0x01, 0x0f, 0x81,
+    0x03, 0x28, 0xf0, 0x31, 0xb8, 0xbf, 0xb6, 0xad, 0xa4, 0x9b, 0x92, 0x89,
+    0x81, 0x86, 0x7f, 0x74, 0x6d, 0x62, 0x5b, 0x50, 0x4a, 0x4d, 0x44, 0x3f,
+    0x36, 0x29, 0x20, 0x1b, 0x13, 0x14, 0x0d, 0x06, 0xff, 0xf0, 0xe9, 0xe2,
+    0xdc, 0xdb, 0xd2, 0xc9, 0xc0, 0xbf, 0xb6, 0xad, 0xa5, 0xa2, 0x9b, 0x90,
+    0x89, 0x86, 0x7f, 0x74, 0x6e, 0x69, 0x60, 0x5b, 0x52, 0x4d, 0x44, 0x3f,
+    0x37, 0x30, 0x29, 0x22, 0x1b, 0x14, 0x0d, 0x06, 0x00, 0x00, 0x00, 0x00,
+    0x49, 0x02, 0x00, 0x00, 0xdf, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x61,
+    0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x0d, 0x00, 0x20, 0xff, 0x31, 0xc8,
+    0xcf, 0xc6, 0xdd, 0xd4, 0xeb, 0xe2, 0xf9, 0xf1, 0xf6, 0x0f, 0x04, 0x1d,
+    0x12, 0x2b, 0x20, 0x3a, 0x3d, 0x34, 0x4f, 0x46, 0x59, 0x50, 0x6b, 0x63,
+    0x64, 0x7d, 0x76, 0x8f, 0x80, 0x99, 0x92, 0xac, 0xab, 0xa2, 0xb9, 0xb0,
+    0xcf, 0xc6, 0xdd, 0xd5, 0xd2, 0xeb, 0xe0, 0xf9, 0xf6, 0x0f, 0x04, 0x1e,
+    0x19, 0x10, 0x2b, 0x22, 0x3d, 0x34, 0x4f, 0x47, 0x40, 0x59, 0x52, 0x6b,
+    0x64, 0x7d, 0x76, 0x75, 0x00, 0x22, 0x07, 0xa9, 0x00, 0xff, 0x31, 0x58,
+    0x5f, 0x56, 0x4d, 0x44, 0x7b, 0x72, 0x69, 0x61, 0x66, 0x9f, 0x94, 0x8d,
+    0x82, 0xbb, 0xb0, 0xaa, 0xad, 0xa4, 0xdf, 0xd6, 0xc9, 0xc0, 0xfb, 0xf3,
+    0xf4, 0xed, 0xe6, 0x1f, 0x10, 0x09, 0x02, 0x3c, 0x3b, 0x32, 0x29, 0x20,
+    0x5f, 0x56, 0x4d, 0x45, 0x42, 0x7b, 0x70, 0x69, 0x66, 0x9f, 0x94, 0x8e,
+    0x89, 0x80, 0xbb, 0xb2, 0xad, 0xa4, 0xdf, 0xd7, 0xd0, 0xc9, 0xc2, 0xfb,
+    0xf4, 0xed, 0xe6, 0xf7, 0x00, 0x24, 0x05, 0x82, 0x00, 0xff, 0x31, 0xe8,
+    0xef, 0xe6, 0xfd, 0xf4, 0xcb, 0xc2, 0xd9, 0xd1, 0xd6, 0x2f, 0x24, 0x3d,
+    0x32, 0x0b, 0x00, 0x1a, 0x1d, 0x14, 0x6f, 0x66, 0x79, 0x70, 0x4b, 0x43,
+    0x44, 0x5d, 0x56, 0xaf, 0xa0, 0xb9, 0xb2, 0x8c, 0x8b, 0x82, 0x99, 0x90,
+    0xef, 0xe6, 0xfd, 0xf5, 0xf2, 0xcb, 0xc0, 0xd9, 0xd6, 0x2f, 0x24, 0x3e,
+    0x39, 0x30, 0x0b, 0x02, 0x1d, 0x14, 0x6f, 0x67, 0x60, 0x79, 0x72, 0x4b,
+    0x44, 0x5d, 0x56, 0x79, 0x01, 0x26, 0x03, 0x82, 0x00, 0xff, 0x31, 0x78,
+    0x7f, 0x76, 0x6d, 0x64, 0x5b, 0x52, 0x49, 0x41, 0x46, 0xbf, 0xb4, 0xad,
+    0xa2, 0x9b, 0x90, 0x8a, 0x8d, 0x84, 0xff, 0xf6, 0xe9, 0xe0, 0xdb, 0xd3,
+    0xd4, 0xcd, 0xc6, 0x3f, 0x30, 0x29, 0x22, 0x1c, 0x1b, 0x12, 0x09, 0x00,
+    0x7f, 0x76, 0x6d, 0x65, 0x62, 0x5b, 0x50, 0x49, 0x46, 0xbf, 0xb4, 0xae,
+    0xa9, 0xa0, 0x9b, 0x92, 0x8d, 0x84, 0xff, 0xf7, 0xf0, 0xe9, 0xe2, 0xdb,
+    0xd4, 0xcd, 0xc6, 0xfb, 0x01, 0x28, 0x01, 0x82, 0x00, 0xff, 0x31, 0x88,
+    0x8f, 0x86, 0x9d, 0x94, 0xab, 0xa2, 0xb9, 0xb1, 0xb6, 0x4f, 0x44, 0x5d,
+    0x52, 0x6b, 0x60, 0x7a, 0x7d, 0x74, 0x0f, 0x06, 0x19, 0x10, 0x2b, 0x23,
+    0x24, 0x3d, 0x36, 0xcf, 0xc0, 0xd9, 0xd2, 0xec, 0xeb, 0xe2, 0xf9, 0xf0,
+    0x8f, 0x86, 0x9d, 0x95, 0x92, 0xab, 0xa0, 0xb9, 0xb6, 0x4f, 0x44, 0x5e,
+    0x59, 0x50, 0x6b, 0x62, 0x7d, 0x74, 0x0f, 0x07, 0x00, 0x19, 0x12, 0x2b,
+    0x24, 0x3d, 0x36, 0x7d, 0x02, 0x2a, 0xff, 0x34, 0x67, 0x68, 0x69, 0x18,
+    0x1f, 0x16, 0x0d, 0x04, 0x3b, 0x32, 0x29, 0x21, 0x26, 0xdf, 0xd4, 0xcd,
+    0xc2, 0xfb, 0xf0, 0xea, 0xed, 0xe4, 0x9f, 0x96, 0x89, 0x80, 0xbb, 0xb3,
+    0xb4, 0xad, 0xa6, 0x5f, 0x50, 0x49, 0x42, 0x7c, 0x7b, 0x72, 0x69, 0x60,
+    0x1f, 0x16, 0x0d, 0x05, 0x02, 0x3b, 0x30, 0x29, 0x26, 0xdf, 0xd4, 0xce,
+    0xc9, 0xc0, 0xfb, 0xf2, 0xed, 0xe4, 0x9f, 0x97, 0x90, 0x89, 0x82, 0xbb,
+    0xb4, 0xad, 0xa6, 0xff, 0x02, 0x2c, 0xf1, 0x32, 0x67, 0xa8, 0xaf, 0xa6,
+    0xbd, 0xb4, 0x8b, 0x82, 0x99, 0x91, 0x96, 0x6f, 0x64, 0x7d, 0x72, 0x4b,
+    0x40, 0x5a, 0x5d, 0x54, 0x2f, 0x26, 0x39, 0x30, 0x0b, 0x03, 0x04, 0x1d,
+    0x16, 0xef, 0xe0, 0xf9, 0xf2, 0xcc, 0xcb, 0xc2, 0xd9, 0xd0, 0xaf, 0xa6,
+    0xbd, 0xb5, 0xb2, 0x8b, 0x80, 0x99, 0x96, 0x6f, 0x64, 0x7e, 0x79, 0x70,
+    0x4b, 0x42, 0x5d, 0x54, 0x2f, 0x27, 0x20, 0x39, 0x32, 0x0b, 0x04, 0x1d,
+    0x16, 0x45, 0x01, 0x0f, 0x81, 0x03, 0x28, 0xf0, 0x31, 0x38, 0x3f, 0x36,
+    0x2d, 0x24, 0x1b, 0x12, 0x09, 0x01, 0x06, 0xff, 0xf4, 0xed, 0xe2, 0xdb,
+    0xd0, 0xca, 0xcd, 0xc4, 0xbf, 0xb6, 0xa9, 0xa0, 0x9b, 0x93, 0x94, 0x8d,
+    0x86, 0x7f, 0x70, 0x69, 0x62, 0x5c, 0x5b, 0x52, 0x49, 0x40, 0x3f, 0x36,
+    0x2d, 0x25, 0x22, 0x1b, 0x10, 0x09, 0x06, 0xff, 0xf4, 0xee, 0xe9, 0xe0,
+    0xdb, 0xd2, 0xcd, 0xc4, 0xbf, 0xb7, 0xb0, 0xa9, 0xa2, 0x9b, 0x94, 0x8d,
+    0x86, 0x00, 0x00, 0x00, 0x00, 0x49, 0x02, 0x00, 0x00, 0xdf, 0x65, 0x66,
+    0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x61, 0x62, 0x63, 0x64, 0x0d,
+    0x00, 0x20, 0xff, 0x31, 0x48, 0x4f, 0x46, 0x5d, 0x54, 0x6b, 0x62, 0x79,
+    0x71, 0x76, 0x8f, 0x84, 0x9d, 0x92, 0xab, 0xa0, 0xba, 0xbd, 0xb4, 0xcf,
+    0xc6, 0xd9, 0xd0, 0xeb, 0xe3, 0xe4, 0xfd, 0xf6, 0x0f, 0x00, 0x19, 0x12,
+    0x2c, 0x2b, 0x22, 0x39, 0x30, 0x4f, 0x46, 0x5d, 0x55, 0x52, 0x6b, 0x60,
+    0x79, 0x76, 0x8f, 0x84, 0x9e, 0x99, 0x90, 0xab, 0xa2, 0xbd, 0xb4, 0xcf,
+    0xc7, 0xc0, 0xd9, 0xd2, 0xeb, 0xe4, 0xfd, 0xf6, 0x75, 0x00, 0x22, 0x07,
+    0xa9, 0x00, 0xff, 0x31, 0xd8, 0xdf, 0xd6, 0xcd, 0xc4, 0xfb, 0xf2, 0xe9,
+    0xe1, 0xe6, 0x1f, 0x14, 0x0d, 0x02, 0x3b, 0x30, 0x2a, 0x2d, 0x24, 0x5f,
+    0x56, 0x49, 0x40, 0x7b, 0x73, 0x74, 0x6d, 0x66, 0x9f, 0x90, 0x89, 0x82,
+    0xbc, 0xbb, 0xb2, 0xa9, 0xa0, 0xdf, 0xd6, 0xcd, 0xc5, 0xc2, 0xfb, 0xf0,
+    0xe9, 0xe6, 0x1f, 0x14, 0x0e, 0x09, 0x00, 0x3b, 0x32, 0x2d, 0x24, 0x5f,
+    0x57, 0x50, 0x49, 0x42, 0x7b, 0x74, 0x6d, 0x66, 0xf7, 0x00, 0x24, 0x05,
+    0x82, 0x00, 0xff, 0x31, 0x68, 0x6f, 0x66, 0x7d, 0x74, 0x4b, 0x42, 0x59,
+    0x51, 0x56, 0xaf, 0xa4, 0xbd, 0xb2, 0x8b, 0x80, 0x9a, 0x9d, 0x94, 0xef,
+    0xe6, 0xf9, 0xf0, 0xcb, 0xc3, 0xc4, 0xdd, 0xd6, 0x2f, 0x20, 0x39, 0x32,
+    0x0c, 0x0b, 0x02, 0x19, 0x10, 0x6f, 0x66, 0x7d, 0x75, 0x72, 0x4b, 0x40,
+    0x59, 0x56, 0xaf, 0xa4, 0xbe, 0xb9, 0xb0, 0x8b, 0x82, 0x9d, 0x94, 0xef,
+    0xe7, 0xe0, 0xf9, 0xf2, 0xcb, 0xc4, 0xdd, 0xd6, 0x79, 0x01, 0x26, 0x03,
+    0x82, 0x00, 0xff, 0x31, 0xf8, 0xff, 0xf6, 0xed, 0xe4, 0xdb, 0xd2, 0xc9,
+    0xc1, 0xc6, 0x3f, 0x34, 0x2d, 0x22, 0x1b, 0x10, 0x0a, 0x0d, 0x04, 0x7f,
+    0x76, 0x69, 0x60, 0x5b, 0x53, 0x54, 0x4d, 0x46, 0xbf, 0xb0, 0xa9, 0xa2,
+    0x9c, 0x9b, 0x92, 0x89, 0x80, 0xff, 0xf6, 0xed, 0xe5, 0xe2, 0xdb, 0xd0,
+    0xc9, 0xc6, 0x3f, 0x34, 0x2e, 0x29, 0x20, 0x1b, 0x12, 0x0d, 0x04, 0x7f,
+    0x77, 0x70, 0x69, 0x62, 0x5b, 0x54, 0x4d, 0x46, 0xfb, 0x01, 0x28, 0x01,
+    0x82, 0x00, 0xff, 0x31, 0x08, 0x0f, 0x06, 0x1d, 0x14, 0x2b, 0x22, 0x39,
+    0x31, 0x36, 0xcf, 0xc4, 0xdd, 0xd2, 0xeb, 0xe0, 0xfa, 0xfd, 0xf4, 0x8f,
+    0x86, 0x99, 0x90, 0xab, 0xa3, 0xa4, 0xbd, 0xb6, 0x4f, 0x40, 0x59, 0x52,
+    0x6c, 0x6b, 0x62, 0x79, 0x70, 0x0f, 0x06, 0x1d, 0x15, 0x12, 0x2b, 0x20,
+    0x39, 0x36, 0xcf, 0xc4, 0xde, 0xd9, 0xd0, 0xeb, 0xe2, 0xfd, 0xf4, 0x8f,
+    0x87, 0x80, 0x99, 0x92, 0xab, 0xa4, 0xbd, 0xb6, 0x7d, 0x02, 0x2a, 0xff,
+    0x34, 0x64, 0x65, 0x66, 0x98, 0x9f, 0x96, 0x8d, 0x84, 0xbb, 0xb2, 0xa9,
+    0xa1, 0xa6, 0x5f, 0x54, 0x4d, 0x42, 0x7b, 0x70, 0x6a, 0x6d, 0x64, 0x1f,
+    0x16, 0x09, 0x00, 0x3b, 0x33, 0x34, 0x2d, 0x26, 0xdf, 0xd0, 0xc9, 0xc2,
+    0xfc, 0xfb, 0xf2, 0xe9, 0xe0, 0x9f, 0x96, 0x8d, 0x85, 0x82, 0xbb, 0xb0,
+    0xa9, 0xa6, 0x5f, 0x54, 0x4e, 0x49, 0x40, 0x7b, 0x72, 0x6d, 0x64, 0x1f,
+    0x17, 0x10, 0x09, 0x02, 0x3b, 0x34, 0x2d, 0x26, 0xff, 0x02, 0x2c, 0xf1,
+    0x32, 0x64, 0x28, 0x2f, 0x26, 0x3d, 0x34, 0x0b, 0x02, 0x19, 0x11, 0x16,
+    0xef, 0xe4, 0xfd, 0xf2, 0xcb, 0xc0, 0xda, 0xdd, 0xd4, 0xaf, 0xa6, 0xb9,
+    0xb0, 0x8b, 0x83, 0x84, 0x9d, 0x96, 0x6f, 0x60, 0x79, 0x72, 0x4c, 0x4b,
+    0x42, 0x59, 0x50, 0x2f, 0x26, 0x3d, 0x35, 0x32, 0x0b, 0x00, 0x19, 0x16,
+    0xef, 0xe4, 0xfe, 0xf9, 0xf0, 0xcb, 0xc2, 0xdd, 0xd4, 0xaf, 0xa7, 0xa0,
+    0xb9, 0xb2, 0x8b, 0x84, 0x9d, 0x96, 0x45, 0x01, 0x0f, 0x81, 0x03, 0x28,
+    0xf0, 0x31, 0xb8, 0xbf, 0xb6, 0xad, 0xa4, 0x9b, 0x92, 0x89, 0x81, 0x86,
+    0x7f, 0x74, 0x6d, 0x62, 0x5b, 0x50, 0x4a, 0x4d, 0x44, 0x3f, 0x36, 0x29,
+    0x20, 0x1b, 0x13, 0x14, 0x0d, 0x06, 0xff, 0xf0, 0xe9, 0xe2, 0xdc, 0xdb,
+    0xd2, 0xc9, 0xc0, 0xbf, 0xb6, 0xad, 0xa5, 0xa2, 0x9b, 0x90, 0x89, 0x86,
+    0x7f, 0x74, 0x6e, 0x69, 0x60, 0x5b, 0x52, 0x4d, 0x44, 0x3f, 0x37, 0x30,
+    0x29, 0x22, 0x1b, 0x14, 0x0d, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00,
+};
+// test_pattern(1000) in the legacy format produced by 'lz4 -l'.
+static const unsigned char legacy_lz4[] = {
+    0x02, 0x21, 0x4c, 0x18, 0x31, 0x02, 0x00, 0x00, 0xdf, 0x61, 0x62, 0x63,
+    0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x0d, 0x00,
+    0x20, 0xff, 0x31, 0xc8, 0xcf, 0xc6, 0xdd, 0xd4, 0xeb, 0xe2, 0xf9, 0xf1,
+    0xf6, 0x0f, 0x04, 0x1d, 0x12, 0x2b, 0x20, 0x3a, 0x3d, 0x34, 0x4f, 0x46,
+    0x59, 0x50, 0x6b, 0x63, 0x64, 0x7d, 0x76, 0x8f, 0x80, 0x99, 0x92, 0xac,
+    0xab, 0xa2, 0xb9, 0xb0, 0xcf, 0xc6, 0xdd, 0xd5, 0xd2, 0xeb, 0xe0, 0xf9,
+    0xf6, 0x0f, 0x04, 0x1e, 0x19, 0x10, 0x2b, 0x22, 0x3d, 0x34, 0x4f, 0x47,
+    0x40, 0x59, 0x52, 0x6b, 0x64, 0x7d, 0x76, 0x75, 0x00, 0x22, 0x07, 0xa9,
+    0x00, 0xff, 0x31, 0x58, 0x5f, 0x56, 0x4d, 0x44, 0x7b, 0x72, 0x69, 0x61,
+    0x66, 0x9f, 0x94, 0x8d, 0x82, 0xbb, 0xb0, 0xaa, 0xad, 0xa4, 0xdf, 0xd6,
+    0xc9, 0xc0, 0xfb, 0xf3, 0xf4, 0xed, 0xe6, 0x1f, 0x10, 0x09, 0x02, 0x3c,
+    0x3b, 0x32, 0x29, 0x20, 0x5f, 0x56, 0x4d, 0x45, 0x42, 0x7b, 0x70, 0x69,
+    0x66, 0x9f, 0x94, 0x8e, 0x89, 0x80, 0xbb, 0xb2, 0xad, 0xa4, 0xdf, 0xd7,
+    0xd0, 0xc9, 0xc2, 0xfb, 0xf4, 0xed, 0xe6, 0xf7, 0x00, 0x24, 0x05, 0x82,
+    0x00, 0xff, 0x31, 0xe8, 0xef, 0xe6, 0xfd, 0xf4, 0xcb, 0xc2, 0xd9, 0xd1,
+    0xd6, 0x2f, 0x24, 0x3d, 0x32, 0x0b, 0x00, 0x1a, 0x1d, 0x14, 0x6f, 0x66,
+    0x79, 0x70, 0x4b, 0x43, 0x44, 0x5d, 0x56, 0xaf, 0xa0, 0xb9, 0xb2, 0x8c,
+    0x8b, 0x82, 0x99, 0x90, 0xef, 0xe6, 0xfd, 0xf5, 0xf2, 0xcb, 0xc0, 0xd9,
+    0xd6, 0x2f, 0x24, 0x3e, 0x39, 0x30, 0x0b, 0x02, 0x1d, 0x14, 0x6f, 0x67,
+    0x60, 0x79, 0x72, 0x4b, 0x44, 0x5d, 0x56, 0x79, 0x01, 0x26, 0x03, 0x82,
+    0x00, 0xff, 0x31, 0x78, 0x7f, 0x76, 0x6d, 0x64, 0x5b, 0x52, 0x49, 0x41,
+    0x46, 0xbf, 0xb4, 0xad, 0xa2, 0x9b, 0x90, 0x8a, 0x8d, 0x84, 0xff, 0xf6,
+    0xe9, 0xe0, 0xdb, 0xd3, 0xd4, 0xcd, 0xc6, 0x3f, 0x30, 0x29, 0x22, 0x1c,
+    0x1b, 0x12, 0x09, 0x00, 0x7f, 0x76, 0x6d, 0x65, 0x62, 0x5b, 0x50, 0x49,
+    0x46, 0xbf, 0xb4, 0xae, 0xa9, 0xa0, 0x9b, 0x92, 0x8d, 0x84, 0xff, 0xf7,
+    0xf0, 0xe9, 0xe2, 0xdb, 0xd4, 0xcd, 0xc6, 0xfb, 0x01, 0x28, 0x01, 0x82,
+    0x00, 0xff, 0x31, 0x88, 0x8f, 0x86, 0x9d, 0x94, 0xab, 0xa2, 0xb9, 0xb1,
+    0xb6, 0x4f, 0x44, 0x5d, 0x52, 0x6b, 0x60, 0x7a, 0x7d, 0x74, 0x0f, 0x06,
+    0x19, 0x10, 0x2b, 0x23, 0x24, 0x3d, 0x36, 0xcf, 0xc0, 0xd9, 0xd2, 0xec,
+    0xeb, 0xe2, 0xf9, 0xf0, 0x8f, 0x86, 0x9d, 0x95, 0x92, 0xab, 0xa0, 0xb9,
+    0xb6, 0x4f, 0x44, 0x5e, 0x59, 0x50, 0x6b, 0x62, 0x7d, 0x74, 0x0f, 0x07,
+    0x00, 0x19, 0x12, 0x2b, 0x24, 0x3d, 0x36, 0x7d, 0x02, 0x2a, 0xff, 0x34,
+    0x6d, 0x61, 0x62, 0x18, 0x1f, 0x16, 0x0d, 0x04, 0x3b, 0x32, 0x29, 0x21,
+    0x26, 0xdf, 0xd4, 0xcd, 0xc2, 0xfb, 0xf0, 0xea, 0xed, 0xe4, 0x9f, 0x96,
+    0x89, 0x80, 0xbb, 0xb3, 0xb4, 0xad, 0xa6, 0x5f, 0x50, 0x49, 0x42, 0x7c,
+    0x7b, 0x72, 0x69, 0x60, 0x1f, 0x16, 0x0d, 0x05, 0x02, 0x3b, 0x30, 0x29,
+    0x26, 0xdf, 0xd4, 0xce, 0xc9, 0xc0, 0xfb, 0xf2, 0xed, 0xe4, 0x9f, 0x97,
+    0x90, 0x89, 0x82, 0xbb, 0xb4, 0xad, 0xa6, 0xff, 0x02, 0x2c, 0xf1, 0x32,
+    0x6d, 0xa8, 0xaf, 0xa6, 0xbd, 0xb4, 0x8b, 0x82, 0x99, 0x91, 0x96, 0x6f,
+    0x64, 0x7d, 0x72, 0x4b, 0x40, 0x5a, 0x5d, 0x54, 0x2f, 0x26, 0x39, 0x30,
+    0x0b, 0x03, 0x04, 0x1d, 0x16, 0xef, 0xe0, 0xf9, 0xf2, 0xcc, 0xcb, 0xc2,
+    0xd9, 0xd0, 0xaf, 0xa6, 0xbd, 0xb5, 0xb2, 0x8b, 0x80, 0x99, 0x96, 0x6f,
+    0x64, 0x7e, 0x79, 0x70, 0x4b, 0x42, 0x5d, 0x54, 0x2f, 0x27, 0x20, 0x39,
+    0x32, 0x0b, 0x04, 0x1d, 0x16, 0x45, 0x01, 0x0f, 0x81, 0x03, 0x28, 0xf0,
+    0x19, 0x38, 0x3f, 0x36, 0x2d, 0x24, 0x1b, 0x12, 0x09, 0x01, 0x06, 0xff,
+    0xf4, 0xed, 0xe2, 0xdb, 0xd0, 0xca, 0xcd, 0xc4, 0xbf, 0xb6, 0xa9, 0xa0,
+    0x9b, 0x93, 0x94, 0x8d, 0x86, 0x7f, 0x70, 0x69, 0x62, 0x5c, 0x5b, 0x52,
+    0x49, 0x40, 0x3f, 0x36, 0x2d,
+};
+
+// "hello", as a frame holding a single uncompressed block.
+static const unsigned char stored_lz4[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x60, 0x40, 0x00,
+    0x05, 0x00, 0x00, 0x80, 'h', 'e', 'l', 'l', 'o',
+    0x00, 0x00, 0x00, 0x00,
+};
+
+// 41 'a's and then "bcdef"; the run is a single match that overlaps itself.
+static const unsigned char run_lz4[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x60, 0x40, 0x00,
+    0x0b, 0x00, 0x00, 0x00,
+    0x1f, 'a', 0x01, 0x00, 0x15,
+    0x50, 'b', 'c', 'd', 'e', 'f',
+    0x00, 0x00, 0x00, 0x00,
+};
+
+// A block whose match points back past the start of the output.
+static const unsigned char bad_offset_lz4[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x60, 0x40, 0x00,
+    0x0a, 0x00, 0x00, 0x00,
+    0x10, 'a', 0x02, 0x00,
+    0x50, 'b', 'c', 'd', 'e', 'f',
+    0x00, 0x00, 0x00, 0x00,
+};
+
+
+SCENARIO("decompressing LZ4 streams", "[lz4]") {
+    std::vector<unsigned char> output(8192);
+    size_t length;
+
+    WHEN("a frame of linked, checksummed blocks is decompressed") {
+        std::vector<unsigned char> expected = test_pattern(4096);
+
+        THEN("the original data is recovered") {
+            REQUIRE(lz4_is_lz4(frame_lz4, sizeof(frame_lz4)));
+            REQUIRE(lz4_content_size(frame_lz4, sizeof(frame_lz4)) == 4096);
+            REQUIRE(lz4_decompress(output.data(), output.size(), frame_lz4, sizeof(frame_lz4), &length) == SUCCESS);
+            REQUIRE(length == 4096);
+            REQUIRE(std::equal(expected.begin(), expected.end(), output.begin()));
+        }
+    }
+
+    WHEN("a legacy stream is decompressed") {
+        std::vector<unsigned char> expected = test_pattern(1000);
+
+        THEN("the original data is recovered, though its size isn't known up front") {
+            REQUIRE(lz4_is_lz4(legacy_lz4, sizeof(legacy_lz4)));
+            REQUIRE(lz4_content_size(legacy_lz4, sizeof(legacy_lz4)) == 0);
+            REQUIRE(lz4_decompress(output.data(), output.size(), legacy_lz4, sizeof(legacy_lz4), &length) == SUCCESS);
+            REQUIRE(length == 1000);
+            REQUIRE(std::equal(expected.begin(), expected.end(), output.begin()));
+        }
+
+        THEN("the size word kbuild appends to the stream is ignored") {
+            std::vector<unsigned char> image(legacy_lz4, legacy_lz4 + sizeof(legacy_lz4));
+            const unsigned char size_word[] = { 0xe8, 0x03, 0x00, 0x00 };
+
+            image.insert(image.end(), size_word, size_word + sizeof(size_word));
+
+            REQUIRE(lz4_decompress(output.data(), output.size(), image.data(), image.size(), &length) == SUCCESS);
+            REQUIRE(length == 1000);
+            REQUIRE(std::equal(expected.begin(), expected.end(), output.begin()));
+        }
+    }
+
+    WHEN("a frame holding an uncompressed block is decompressed") {
+        THEN("the block is copied through") {
+            REQUIRE(lz4_decompress(output.data(), output.size(), stored_lz4, sizeof(stored_lz4), &length) == SUCCESS);
+            REQUIRE(length == 5);
+            REQUIRE(!memcmp(output.data(), "hello", 5));
+        }
+    }
+
+    WHEN("a match overlaps its own output") {
+        std::string expected = std::string(41, 'a') + "bcdef";
+
+        THEN("it repeats the bytes it has just written") {
+            REQUIRE(lz4_decompress(output.data(), output.size(), run_lz4, sizeof(run_lz4), &length) == SUCCESS);
+            REQUIRE(length == expected.size());
+            REQUIRE(std::string(output.begin(), output.begin() + length) == expected);
+        }
+    }
+
+    WHEN("the destination is misaligned") {
+        std::vector<unsigned char> expected = test_pattern(4096);
+
+        THEN("the data still lands intact") {
+            for(size_t offset = 1; offset < 8; ++offset) {
+                REQUIRE(lz4_decompress(output.data() + offset, output.size() - offset,
+                        frame_lz4, sizeof(frame_lz4), &length) == SUCCESS);
+                REQUIRE(std::equal(expected.begin(), expected.end(), output.begin() + offset));
+            }
+        }
+    }
+
+    WHEN("only the start of a stream is requested") {
+        std::vector<unsigned char> expected = test_pattern(64);
+        unsigned char header[64];
+
+        THEN("just that prefix is produced") {
+            REQUIRE(lz4_decompress_prefix(header, sizeof(header), frame_lz4, sizeof(frame_lz4)) == SUCCESS);
+            REQUIRE(std::equal(expected.begin(), expected.end(), header));
+            REQUIRE(lz4_decompress_prefix(header, sizeof(header), legacy_lz4, sizeof(legacy_lz4)) == SUCCESS);
+            REQUIRE(std::equal(expected.begin(), expected.end(), header));
+        }
+
+        THEN("streams shorter than the prefix are reported as truncated") {
+            REQUIRE(lz4_decompress_prefix(header, sizeof(header), stored_lz4, sizeof(stored_lz4)) == -FDT_ERR_TRUNCATED);
+        }
+    }
+
+    WHEN("the output doesn't fit in the destination") {
+        THEN("decompression fails cleanly") {
+            REQUIRE(lz4_decompress(output.data(), 4000, frame_lz4, sizeof(frame_lz4), &length) == -FDT_ERR_NOSPACE);
+            REQUIRE(lz4_decompress(output.data(), 4, stored_lz4, sizeof(stored_lz4), &length) == -FDT_ERR_NOSPACE);
+        }
+    }
+
+    WHEN("the stream is damaged") {
+        THEN("the damage is reported") {
+            unsigned char not_lz4[] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+            REQUIRE(!lz4_is_lz4(not_lz4, sizeof(not_lz4)));
+            REQUIRE(lz4_decompress(output.data(), output.size(), not_lz4, sizeof(not_lz4), &length) == -FDT_ERR_BADMAGIC);
+            REQUIRE(lz4_decompress(output.data(), output.size(), frame_lz4, sizeof(frame_lz4) / 2, &length) == -FDT_ERR_TRUNCATED);
+            REQUIRE(lz4_decompress(output.data(), output.size(), bad_offset_lz4, sizeof(bad_offset_lz4), &length) == -FDT_ERR_BADVALUE);
+        }
+    }
+}
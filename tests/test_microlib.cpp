@@ -187,6 +187,74 @@ SCENARIO("when using the microlib implementation of memchr", "[memchr]") {
 }
 
 
+SCENARIO("when using the word-at-a-time string routines", "[memcmp][memchr][strnlen]") {
+    alignas(8) unsigned char first[64];
+    alignas(8) unsigned char second[64];
+    size_t offset, length, i;
+
+    for(i = 0; i < sizeof(first); ++i)
+        first[i] = second[i] = 'a' + (i % 26);
+
+    WHEN("regions are compared at every alignment and length") {
+        THEN("memcmp finds the first differing byte, treating bytes as unsigned") {
+            for(offset = 0; offset < 16; ++offset) {
+                for(length = 1; length < 40; ++length) {
+                    unsigned char *a = first + offset, *b = second + offset;
+
+                    REQUIRE(memcmp(a, b, length) == 0);
+
+                    // Make the last byte differ, with a byte that's negative when signed.
+                    b[length - 1] = 0x80;
+                    REQUIRE(memcmp(a, b, length) < 0);
+                    REQUIRE(memcmp(b, a, length) > 0);
+                    b[length - 1] = a[length - 1];
+
+                    // Regions with different alignments take the slow path; check it too.
+                    REQUIRE(memcmp(first + offset, second + offset + 1, length) != 0);
+                }
+            }
+        }
+    }
+
+    WHEN("a buffer is searched at every alignment and length") {
+        THEN("memchr finds the target only where it lies within the buffer") {
+            for(offset = 0; offset < 16; ++offset) {
+                for(length = 0; length < 40; ++length) {
+                    unsigned char *p = first + offset;
+
+                    REQUIRE(memchr(p, 0xEE, length) == NULL);
+
+                    if(length) {
+                        p[length - 1] = 0xEE;
+                        REQUIRE(memchr(p, 0xEE, length) == p + length - 1);
+                        REQUIRE(memchr(p, 0xEE, length - 1) == NULL);
+                        p[length - 1] = 'a' + ((offset + length - 1) % 26);
+                    }
+                }
+            }
+        }
+    }
+
+    WHEN("strings are measured at every alignment and length") {
+        THEN("strnlen stops at the terminator or the limit, whichever is first") {
+            for(offset = 0; offset < 16; ++offset) {
+                for(length = 0; length < 40; ++length) {
+                    char *p = (char *)first + offset;
+                    char saved = p[length];
+
+                    p[length] = '\0';
+                    REQUIRE(strnlen(p, 63 - offset) == length);
+                    REQUIRE(strnlen(p, length / 2) == length / 2);
+                    REQUIRE(strnlen(p, SIZE_MAX) == length);
+                    REQUIRE(strlen(p) == length);
+                    p[length] = saved;
+                }
+            }
+        }
+    }
+}
+
+
 SCENARIO("when using the microlib implementation of memset", "[memset]") {
     int buffer[12];
     int i;
@@ -210,3 +278,28 @@ SCENARIO("when using the microlib implementation of memset", "[memset]") {
         }
     }
 }
+
+
+SCENARIO("when using the microlib implementation of printf", "[printf][strnlen]") {
+    alignas(8) char buffer[64];
+    size_t offset;
+
+    WHEN("a string is printed with no precision given") {
+        THEN("the whole string is printed, whatever its alignment") {
+            // printf's default precision asks strnlen for SIZE_MAX characters.
+            for(offset = 0; offset < 16; ++offset) {
+                char *s = buffer + offset;
+
+                strcpy(s, "kernel-image");
+                REQUIRE(printf("[%s]", s) == 14);
+            }
+        }
+    }
+
+    WHEN("a string is printed with a precision") {
+        THEN("at most that many characters are printed") {
+            REQUIRE(printf("[%.6s]", "kernel-image") == 8);
+            REQUIRE(printf("[%.20s]", "kernel-image") == 14);
+        }
+    }
+}
@@ -0,0 +1,182 @@
+/**
+ * Tests for finding the payloads passed in the FDT
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "catch.hpp"
+#include "helpers.h"
+
+#include <vector>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <fdt_index.h>
+  #include "image.h"
+}
+
+
+/**
+ * Adds a module node with the given reg cells to the FDT being built.
+ */
+static void add_module(void *fdt, const char *name, const char *compatible,
+    const std::vector<uint32_t> &reg)
+{
+    std::vector<fdt32_t> cells;
+
+    for(size_t i = 0; i < reg.size(); ++i)
+        cells.push_back(cpu_to_fdt32(reg[i]));
+
+    REQUIRE(fdt_begin_node(fdt, name) == 0);
+    REQUIRE(fdt_property_string(fdt, "compatible", compatible) == 0);
+    REQUIRE(fdt_property(fdt, "reg", cells.data(), cells.size() * sizeof(fdt32_t)) == 0);
+    REQUIRE(fdt_end_node(fdt) == 0);
+}
+
+
+SCENARIO("finding the payloads passed in the FDT", "[image]") {
+    std::vector<char> buffer(4096);
+    void *fdt = buffer.data();
+    ArenaScope arena;
+    struct fdt_index index;
+    struct payload_table table;
+    const struct payload *kernel, *ramdisk;
+
+    REQUIRE(fdt_create(fdt, buffer.size()) == 0);
+    REQUIRE(fdt_finish_reservemap(fdt) == 0);
+    REQUIRE(fdt_begin_node(fdt, "") == 0);
+
+    WHEN("modules use the root's two-cell addresses and sizes") {
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+        add_module(fdt, "module@0", "multiboot,kernel", { 0x1, 0x80000000, 0x0, 0x1000000 });
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_finish(fdt) == 0);
+
+        REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+        REQUIRE(find_payloads(&index, &table) == SUCCESS);
+
+        THEN("each module's extents are read in full") {
+            kernel = find_payload(&table, PAYLOAD_KERNEL);
+            REQUIRE(kernel);
+            REQUIRE((uintptr_t)kernel->location == 0x180000000ULL);
+            REQUIRE(kernel->size == 0x1000000);
+        }
+    }
+
+    WHEN("modules live in a /chosen with one-cell addresses and sizes") {
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+        REQUIRE(fdt_begin_node(fdt, "chosen") == 0);
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 1) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 1) == 0);
+        add_module(fdt, "module@80080000", "multiboot,kernel", { 0x80080000, 0x2000000 });
+        add_module(fdt, "module@84000000", "multiboot,ramdisk", { 0x84000000, 0x400000 });
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_finish(fdt) == 0);
+
+        REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+        REQUIRE(find_payloads(&index, &table) == SUCCESS);
+
+        THEN("their extents are read using /chosen's cell sizes") {
+            kernel = find_payload(&table, PAYLOAD_KERNEL);
+            ramdisk = find_payload(&table, PAYLOAD_RAMDISK);
+            REQUIRE(kernel);
+            REQUIRE(ramdisk);
+            REQUIRE((uintptr_t)kernel->location == 0x80080000);
+            REQUIRE(kernel->size == 0x2000000);
+            REQUIRE((uintptr_t)ramdisk->location == 0x84000000);
+            REQUIRE(ramdisk->size == 0x400000);
+        }
+    }
+
+    WHEN("payloads in /chosen have names other than 'module'") {
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+        REQUIRE(fdt_begin_node(fdt, "chosen") == 0);
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 1) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 1) == 0);
+        add_module(fdt, "framebuffer@90000000", "simple-framebuffer", { 0x90000000, 0x800000 });
+        add_module(fdt, "kernel@80080000", "multiboot,kernel", { 0x80080000, 0x2000000 });
+        add_module(fdt, "initrd@84000000", "multiboot,ramdisk", { 0x84000000, 0x400000 });
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_finish(fdt) == 0);
+
+        REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+        REQUIRE(find_payloads(&index, &table) == SUCCESS);
+
+        THEN("they're found by their compatible strings, and other nodes are ignored") {
+            kernel = find_payload(&table, PAYLOAD_KERNEL);
+            ramdisk = find_payload(&table, PAYLOAD_RAMDISK);
+            REQUIRE(table.count == 2);
+            REQUIRE(kernel);
+            REQUIRE(ramdisk);
+            REQUIRE((uintptr_t)kernel->location == 0x80080000);
+            REQUIRE((uintptr_t)ramdisk->location == 0x84000000);
+        }
+    }
+
+    WHEN("modules use two-cell addresses and one-cell sizes") {
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 1) == 0);
+        add_module(fdt, "module@0", "multiboot,kernel", { 0x0, 0x80080000, 0x2000000 });
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_finish(fdt) == 0);
+
+        REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+        REQUIRE(find_payloads(&index, &table) == SUCCESS);
+
+        THEN("the size is read from the single cell after the address") {
+            kernel = find_payload(&table, PAYLOAD_KERNEL);
+            REQUIRE(kernel);
+            REQUIRE((uintptr_t)kernel->location == 0x80080000);
+            REQUIRE(kernel->size == 0x2000000);
+        }
+    }
+
+    WHEN("a module's reg is too short for the cell sizes") {
+        REQUIRE(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+        REQUIRE(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+        add_module(fdt, "module@0", "multiboot,kernel", { 0x0, 0x80080000 });
+        add_module(fdt, "module@1", "multiboot,ramdisk", { 0x0, 0x84000000, 0x0, 0x400000 });
+        REQUIRE(fdt_end_node(fdt) == 0);
+        REQUIRE(fdt_finish(fdt) == 0);
+
+        REQUIRE(fdt_index_build(&index, fdt) == SUCCESS);
+
+        THEN("that module is rejected, and the others are still found") {
+            void *location;
+            size_t size;
+
+            REQUIRE(get_image_extents(&index, index.payload_nodes[0], index.payload_parents[0], "kernel",
+                    &location, &size) == -FDT_ERR_BADVALUE);
+
+            REQUIRE(find_payloads(&index, &table) == SUCCESS);
+            REQUIRE(!find_payload(&table, PAYLOAD_KERNEL));
+            REQUIRE(find_payload(&table, PAYLOAD_RAMDISK));
+        }
+    }
+}
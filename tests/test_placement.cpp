@@ -0,0 +1,147 @@
+/**
+ * Tests for the payload placement planner
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+
+extern "C" {
+  #include <placement.h>
+  #include <libfdt.h>
+}
+
+/**
+ * Builds a region set describing a single block of memory.
+ */
+static struct region_set memory_block(uint64_t start, uint64_t size)
+{
+    struct region_set memory;
+
+    REQUIRE(region_set_init(&memory, 1) == SUCCESS);
+    REQUIRE(region_set_insert(&memory, start, size) == SUCCESS);
+    region_set_normalize(&memory);
+
+    return memory;
+}
+
+
+SCENARIO("planning where payloads go", "[placement]") {
+    struct region_set memory = memory_block(0x80000000, 0x10000000);
+    struct placement_plan plan;
+    int stub, kernel, ramdisk;
+
+    placement_init(&plan);
+    stub = placement_add_resident(&plan, "stub", 0x8f000000, 0x100000);
+
+    GIVEN("a ramdisk that's out of the kernel's way") {
+        kernel = placement_add_fixed(&plan, "kernel", 0x88000000, 0x1000000, 0x80080000, 0x2000000, true);
+        ramdisk = placement_add_floating(&plan, "ramdisk", 0x84000000, 0x1000000);
+
+        THEN("the ramdisk stays put, and only the kernel moves") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == SUCCESS);
+            REQUIRE(plan.regions[ramdisk].destination == 0x84000000);
+            REQUIRE(plan.move_count == 1);
+            REQUIRE(plan.moves[0] == kernel);
+            REQUIRE(!placement_region_moves(&plan.regions[stub]));
+        }
+    }
+
+    GIVEN("a ramdisk where the kernel is going") {
+        kernel = placement_add_fixed(&plan, "kernel", 0x88000000, 0x1000000, 0x80080000, 0x2000000, true);
+        ramdisk = placement_add_floating(&plan, "ramdisk", 0x81000000, 0x1000000);
+
+        THEN("the ramdisk is moved out of the way first, to the lowest free spot") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == SUCCESS);
+            REQUIRE(plan.regions[ramdisk].destination == 0x82080000);
+            REQUIRE(plan.move_count == 2);
+            REQUIRE(plan.moves[0] == ramdisk);
+            REQUIRE(plan.moves[1] == kernel);
+        }
+    }
+
+    GIVEN("a ramdisk over the stub") {
+        ramdisk = placement_add_floating(&plan, "ramdisk", 0x8f0ff000, 0x2000);
+
+        THEN("the ramdisk is moved, and aligned") {
+            REQUIRE(placement_solve(&plan, &memory, 0x100000) == SUCCESS);
+            REQUIRE(plan.regions[ramdisk].destination == 0x80000000);
+            REQUIRE(plan.move_count == 1);
+        }
+    }
+
+    GIVEN("a ramdisk in the way, and no room to move it to") {
+        kernel = placement_add_fixed(&plan, "kernel", 0x80000000, 0x1000000, 0x80000000, 0x8000000, true);
+        ramdisk = placement_add_floating(&plan, "ramdisk", 0x81000000, 0x7100000);
+
+        THEN("the planner says so") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == -FDT_ERR_NOSPACE);
+        }
+    }
+
+    GIVEN("a kernel that's already where it belongs") {
+        kernel = placement_add_fixed(&plan, "kernel", 0x80080000, 0x1000000, 0x80080000, 0x2000000, true);
+
+        THEN("nothing is moved") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == SUCCESS);
+            REQUIRE(plan.move_count == 0);
+        }
+    }
+
+    GIVEN("a kernel that would be decompressed over itself") {
+        kernel = placement_add_fixed(&plan, "kernel", 0x80800000, 0x800000, 0x80080000, 0x2000000, false);
+
+        THEN("the plan is rejected") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == -FDT_ERR_BADLAYOUT);
+        }
+    }
+
+    GIVEN("a kernel that would be loaded over the stub") {
+        kernel = placement_add_fixed(&plan, "kernel", 0x80000000, 0x1000000, 0x8e000000, 0x2000000, true);
+
+        THEN("the plan is rejected") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == -FDT_ERR_BADLAYOUT);
+        }
+    }
+
+    GIVEN("two payloads that need to swap places") {
+        placement_add_fixed(&plan, "first", 0x80000000, 0x1000000, 0x81000000, 0x1000000, true);
+        placement_add_fixed(&plan, "second", 0x81000000, 0x1000000, 0x80000000, 0x1000000, true);
+
+        THEN("the plan is rejected, as neither can go first") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == -FDT_ERR_BADLAYOUT);
+        }
+    }
+
+    GIVEN("a chain of payloads, each moving over the next") {
+        int first = placement_add_fixed(&plan, "first", 0x80000000, 0x1000000, 0x81000000, 0x1000000, true);
+        int second = placement_add_fixed(&plan, "second", 0x81000000, 0x1000000, 0x82000000, 0x1000000, true);
+
+        THEN("the moves are ordered so nothing is overwritten before it's moved") {
+            REQUIRE(placement_solve(&plan, &memory, 0x1000) == SUCCESS);
+            REQUIRE(plan.move_count == 2);
+            REQUIRE(plan.moves[0] == second);
+            REQUIRE(plan.moves[1] == first);
+        }
+    }
+}
@@ -0,0 +1,226 @@
+/**
+ * Tests for region sets
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "catch.hpp"
+#include "helpers.h"
+
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+extern "C" {
+  #include <libfdt.h>
+  #include <regions.h>
+}
+
+typedef std::vector<std::pair<uint64_t, uint64_t> > region_list;
+
+
+/**
+ * Builds a region set holding each of the given (start, size) pairs.
+ */
+static void build_set(struct region_set *set, const region_list &regions)
+{
+    REQUIRE(region_set_init(set, 1) == SUCCESS);
+
+    for(size_t i = 0; i < regions.size(); ++i)
+        REQUIRE(region_set_insert(set, regions[i].first, regions[i].second) == SUCCESS);
+}
+
+
+/**
+ * @return The (start, size) pairs held in the given region set.
+ */
+static region_list contents(const struct region_set *set)
+{
+    region_list regions;
+
+    for(size_t i = 0; i < set->count; ++i)
+        regions.push_back(std::make_pair(set->regions[i].start, set->regions[i].size));
+
+    return regions;
+}
+
+
+SCENARIO("normalizing region sets", "[regions]") {
+    ArenaScope arena;
+    struct region_set set;
+
+    WHEN("regions touch end-to-start") {
+        build_set(&set, { {0x3000, 0x1000}, {0x1000, 0x1000}, {0x2000, 0x1000} });
+        region_set_normalize(&set);
+
+        THEN("they're merged into one") {
+            REQUIRE(contents(&set) == region_list({ {0x1000, 0x3000} }));
+        }
+    }
+
+    WHEN("regions overlap, or one contains another") {
+        build_set(&set, { {0x1000, 0x2000}, {0x2800, 0x1000}, {0x1800, 0x100}, {0x8000, 0x1000} });
+        region_set_normalize(&set);
+
+        THEN("they're merged, and the separate region is kept apart") {
+            REQUIRE(contents(&set) == region_list({ {0x1000, 0x2800}, {0x8000, 0x1000} }));
+        }
+    }
+
+    WHEN("empty regions are inserted") {
+        build_set(&set, { {0x1000, 0}, {0x2000, 0x1000} });
+
+        THEN("they're ignored") {
+            REQUIRE(contents(&set) == region_list({ {0x2000, 0x1000} }));
+        }
+    }
+
+    WHEN("more regions are inserted than the set was created with room for") {
+        region_list regions, expected;
+
+        // Insert 64 separate regions in reverse order.
+        for(uint64_t i = 64; i-- > 0;)
+            regions.push_back(std::make_pair(i * 0x10000, 0x1000));
+        for(uint64_t i = 0; i < 64; ++i)
+            expected.push_back(std::make_pair(i * 0x10000, 0x1000));
+
+        build_set(&set, regions);
+        region_set_normalize(&set);
+
+        THEN("the set grows, and every region is kept, in order") {
+            REQUIRE(set.capacity >= 64);
+            REQUIRE(contents(&set) == expected);
+        }
+    }
+}
+
+
+SCENARIO("subtracting one region set from another", "[regions]") {
+    ArenaScope arena;
+    struct region_set set, exclusions;
+
+    WHEN("a hole is cut from the middle of a region") {
+        build_set(&set, { {0x80000000, 0x40000000} });
+        build_set(&exclusions, { {0x90000000, 0x200000} });
+        REQUIRE(region_set_subtract(&set, &exclusions) == SUCCESS);
+
+        THEN("the region is split in two") {
+            REQUIRE(contents(&set) == region_list({
+                {0x80000000, 0x10000000}, {0x90200000, 0x2fe00000} }));
+        }
+    }
+
+    WHEN("a hole covers the start or end of a region") {
+        build_set(&set, { {0x1000, 0x3000}, {0x8000, 0x3000} });
+        build_set(&exclusions, { {0x0, 0x2000}, {0xa000, 0x4000} });
+        REQUIRE(region_set_subtract(&set, &exclusions) == SUCCESS);
+
+        THEN("the region is trimmed") {
+            REQUIRE(contents(&set) == region_list({ {0x2000, 0x2000}, {0x8000, 0x2000} }));
+        }
+    }
+
+    WHEN("a single hole spans several regions") {
+        build_set(&set, { {0x1000, 0x1000}, {0x3000, 0x1000}, {0x5000, 0x1000}, {0x7000, 0x1000} });
+        build_set(&exclusions, { {0x1800, 0x6000} });
+        REQUIRE(region_set_subtract(&set, &exclusions) == SUCCESS);
+
+        THEN("regions it covers are removed, and those at its edges are trimmed") {
+            REQUIRE(contents(&set) == region_list({ {0x1000, 0x800}, {0x7800, 0x800} }));
+        }
+    }
+
+    WHEN("many holes are cut in a single pass") {
+        region_list holes, expected;
+
+        // Cut a 4 KiB hole out of every 64 KiB of a 16 MiB region.
+        for(uint64_t i = 0; i < 256; ++i)
+            holes.push_back(std::make_pair(i * 0x10000 + 0x8000, 0x1000));
+
+        expected.push_back(std::make_pair(0, 0x8000));
+        for(uint64_t i = 0; i < 255; ++i)
+            expected.push_back(std::make_pair(i * 0x10000 + 0x9000, 0xf000));
+        expected.push_back(std::make_pair(255 * 0x10000 + 0x9000, 0x7000));
+
+        build_set(&set, { {0, 0x1000000} });
+        build_set(&exclusions, holes);
+        REQUIRE(region_set_subtract(&set, &exclusions) == SUCCESS);
+
+        THEN("each hole splits the region") {
+            REQUIRE(contents(&set) == expected);
+        }
+    }
+
+    WHEN("the holes cover everything") {
+        build_set(&set, { {0x1000, 0x1000}, {0x3000, 0x1000} });
+        build_set(&exclusions, { {0x3000, 0x1000}, {0x0, 0x2000} });
+        REQUIRE(region_set_subtract(&set, &exclusions) == SUCCESS);
+
+        THEN("nothing is left") {
+            REQUIRE(set.count == 0);
+        }
+    }
+
+    WHEN("random sets are subtracted") {
+        THEN("the result matches subtracting them byte by byte") {
+            srand(1);
+
+            for(int round = 0; round < 200; ++round) {
+                ArenaScope round_arena;
+                std::vector<bool> expected(512, false), actual(512, false);
+                region_list regions, holes;
+
+                for(int i = rand() % 16; i > 0; --i) {
+                    uint64_t start = rand() % 480, size = rand() % 32;
+                    regions.push_back(std::make_pair(start, size));
+                    for(uint64_t b = start; b < start + size; ++b)
+                        expected[b] = true;
+                }
+
+                for(int i = rand() % 16; i > 0; --i) {
+                    uint64_t start = rand() % 480, size = rand() % 32;
+                    holes.push_back(std::make_pair(start, size));
+                    for(uint64_t b = start; b < start + size; ++b)
+                        expected[b] = false;
+                }
+
+                build_set(&set, regions);
+                build_set(&exclusions, holes);
+                REQUIRE(region_set_subtract(&set, &exclusions) == SUCCESS);
+
+                // The result should also be normalized: sorted, with gaps between regions.
+                for(size_t i = 0; i < set.count; ++i) {
+                    REQUIRE(set.regions[i].size > 0);
+                    if(i)
+                        REQUIRE(set.regions[i].start > set.regions[i - 1].start + set.regions[i - 1].size);
+
+                    for(uint64_t b = set.regions[i].start; b < set.regions[i].start + set.regions[i].size; ++b)
+                        actual[b] = true;
+                }
+
+                REQUIRE(actual == expected);
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+/**
+ * Tests for SHA-256
+ *
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *      Author: ktemkin <temkink@ainfosec.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a 
+ *  copy of this software and associated documentation files (the "Software"), 
+ *  to deal in the Software without restriction, including without limitation 
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ *  and/or sell copies of the Software, and to permit persons to whom the 
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in 
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS 
+ *  OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include <sha256.h>
+}
+
+/**
+ * Formats a digest as a hex string, for readable comparisons.
+ */
+static std::string hex(const uint8_t *digest)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+
+    for(int i = 0; i < SHA256_DIGEST_BYTES; ++i) {
+        result += digits[digest[i] >> 4];
+        result += digits[digest[i] & 0xf];
+    }
+
+    return result;
+}
+
+
+/**
+ * Computes the digest of a string, as a hex string.
+ */
+static std::string sha256_of(const std::string &data)
+{
+    uint8_t digest[SHA256_DIGEST_BYTES];
+
+    sha256(data.data(), data.size(), digest);
+    return hex(digest);
+}
+
+
+SCENARIO("computing SHA-256 digests", "[sha256]") {
+
+    WHEN("the FIPS 180-2 test vectors are hashed") {
+        THEN("the published digests are produced") {
+            REQUIRE(sha256_of("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+            REQUIRE(sha256_of("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+            REQUIRE(sha256_of("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+                "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+            REQUIRE(sha256_of(std::string(1000000, 'a')) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        }
+    }
+
+    WHEN("data is hashed in pieces that don't line up with blocks") {
+        std::string data(1000, 'x');
+        struct sha256_context context;
+        uint8_t digest[SHA256_DIGEST_BYTES];
+
+        for(size_t i = 0; i < data.size(); ++i)
+            data[i] = (i * 37) ^ (i >> 2);
+
+        THEN("the digest matches hashing it all at once") {
+            sha256_init(&context);
+            for(size_t offset = 0, piece = 1; offset < data.size(); offset += piece, piece = piece * 2 + 1)
+                sha256_update(&context, data.data() + offset, std::min(piece, data.size() - offset));
+            sha256_final(&context, digest);
+
+            REQUIRE(hex(digest) == sha256_of(data));
+        }
+    }
+
+    WHEN("data is copied and hashed at the same time") {
+        std::vector<char> source(4099), dest(4200);
+
+        for(size_t i = 0; i < source.size(); ++i)
+            source[i] = i * 13;
+
+        THEN("the copy is exact and the digest is correct, whatever the alignment") {
+            for(size_t src_offset = 0; src_offset < 4; ++src_offset) {
+                for(size_t dest_offset = 0; dest_offset < 8; dest_offset += 3) {
+                    struct sha256_context context;
+                    uint8_t digest[SHA256_DIGEST_BYTES];
+                    size_t length = source.size() - src_offset;
+
+                    std::fill(dest.begin(), dest.end(), 0);
+
+                    sha256_init(&context);
+                    sha256_copy(&context, dest.data() + dest_offset, source.data() + src_offset, 100);
+                    sha256_copy(&context, dest.data() + dest_offset + 100, source.data() + src_offset + 100, length - 100);
+                    sha256_final(&context, digest);
+
+                    REQUIRE(std::equal(source.begin() + src_offset, source.end(), dest.begin() + dest_offset));
+                    REQUIRE(hex(digest) == sha256_of(std::string(source.begin() + src_offset, source.end())));
+                }
+            }
+        }
+    }
+}